@@ -6,8 +6,13 @@
 */
 #pragma once
 #include <chrono>
+#include <cstdint>
 #include <regex>
 
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
 
 namespace seeker {
 
@@ -187,13 +192,13 @@ class ByteArray {
             ++strin;
             break;
           case 0x7F:
-            rst.swap(std::vector<uint8_t>());
+            std::vector<uint8_t>().swap(rst);
             break;
           default:
             if (c < 0x1F) {
-              rst.swap(std::vector<uint8_t>());
+              std::vector<uint8_t>().swap(rst);
             } else if (c >= 0x80 && c <= 0x9F) {
-              rst.swap(std::vector<uint8_t>());
+              std::vector<uint8_t>().swap(rst);
             } else {
               rst.push_back(c);
               ++strin;
@@ -242,4 +247,44 @@ class ByteArray {
 };
 
 
+// bit scans of a non-zero value: compiler intrinsics where there are some, a loop elsewhere.
+class Bits {
+ public:
+  // index of the lowest set bit (count of trailing zeros).
+  static int lowest(uint64_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(v);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    unsigned long i;
+    _BitScanForward64(&i, v);
+    return (int)i;
+#else
+    int n = 0;
+    while ((v & 1) == 0) {
+      v >>= 1;
+      n++;
+    }
+    return n;
+#endif
+  }
+
+  // index of the highest set bit, floor(log2(v)).
+  static int highest(uint64_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzll(v);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    unsigned long i;
+    _BitScanReverse64(&i, v);
+    return (int)i;
+#else
+    int n = 0;
+    while (v >>= 1) {
+      n++;
+    }
+    return n;
+#endif
+  }
+};
+
+
 }  // namespace seeker
\ No newline at end of file
@@ -0,0 +1,191 @@
+/**
+@project seeker
+@author Tao Zhang
+@since 2020/3/1
+@version 0.0.1-SNAPSHOT 2026/10/19
+*/
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include "seeker/common.h"
+
+
+namespace seeker {
+
+
+/*
+High dynamic range histogram of integer values (latencies in ns, say), the bucket layout of
+HdrHistogram: values from lowest to highest are kept with a fixed number of significant
+decimal digits, so a 1 ms value and a 10 s value both carry the same relative error.
+
+Buckets cover the powers of two above lowest; each one is split into linear sub-buckets,
+2 * 10^digits of them rounded up to a power of two, so a value's slot is found with a count
+of leading zeros and a shift, no search and no floating point. Recording is O(1) and never
+allocates; the counts array is sized once (about 27k slots for 1 ns .. 60 s at 3 digits).
+
+Percentiles report the highest value equivalent to the slot they land in, as HdrHistogram
+does. min, max and mean are kept exactly. Values above highest are clamped to it and counted
+in clamped(). Not thread safe, merge per-thread histograms with add().
+*/
+class HdrHistogram {
+  int64_t lowest;
+  int64_t highest;
+  int digits;
+  int unitMagnitude;
+  int subBucketHalfCountMagnitude;
+  int64_t subBucketCount;
+  int64_t subBucketHalfCount;
+  int64_t subBucketMask;
+  int bucketCount;
+  std::vector<uint64_t> counts;
+
+  uint64_t total = 0;
+  uint64_t clampedCount = 0;
+  int64_t minValue = INT64_MAX;
+  int64_t maxValue = 0;
+  double sum = 0;
+
+
+  static int log2Floor(uint64_t v) { return Bits::highest(v); }
+
+  int bucketOf(int64_t v) const {
+    return log2Floor((uint64_t)(v | subBucketMask)) - unitMagnitude -
+           subBucketHalfCountMagnitude;
+  }
+
+  size_t indexOf(int64_t v) const {
+    int bucket = bucketOf(v);
+    int64_t subBucket = v >> (bucket + unitMagnitude);
+    return (size_t)(((int64_t)(bucket + 1) << subBucketHalfCountMagnitude) +
+                    (subBucket - subBucketHalfCount));
+  }
+
+  // lowest value of slot i.
+  int64_t valueAt(size_t i) const {
+    int bucket = (int)(i >> subBucketHalfCountMagnitude) - 1;
+    int64_t subBucket = (int64_t)(i & (subBucketHalfCount - 1)) + subBucketHalfCount;
+    if (bucket < 0) {
+      subBucket -= subBucketHalfCount;
+      bucket = 0;
+    }
+    return subBucket << (bucket + unitMagnitude);
+  }
+
+  // highest value sharing the slot of v.
+  int64_t highestEquivalent(int64_t v) const {
+    int bucket = bucketOf(v);
+    int64_t subBucket = v >> (bucket + unitMagnitude);
+    int shift = unitMagnitude + bucket + (subBucket >= subBucketCount ? 1 : 0);
+    int64_t low = subBucket << (bucket + unitMagnitude);
+    return low + ((int64_t)1 << shift) - 1;
+  }
+
+
+ public:
+  /*
+  lowest >= 1 is the smallest value told apart from 0, highest >= 2 * lowest the largest
+  tracked, digits 1 to 5 the significant decimal digits kept.
+  */
+  HdrHistogram(int64_t lowest_, int64_t highest_, int digits_)
+      : lowest(lowest_), highest(highest_), digits(digits_) {
+    if (lowest < 1 || highest < 2 * lowest || digits < 1 || digits > 5) {
+      throw std::runtime_error("HdrHistogram: bad range or precision.");
+    }
+    int64_t largestSingleUnitResolution = 2;
+    for (int i = 0; i < digits; i++) {
+      largestSingleUnitResolution *= 10;
+    }
+    int subBucketCountMagnitude = log2Floor((uint64_t)largestSingleUnitResolution - 1) + 1;
+    subBucketHalfCountMagnitude = std::max(subBucketCountMagnitude, 1) - 1;
+    unitMagnitude = log2Floor((uint64_t)lowest);
+    subBucketCount = (int64_t)1 << (subBucketHalfCountMagnitude + 1);
+    subBucketHalfCount = subBucketCount / 2;
+    subBucketMask = (subBucketCount - 1) << unitMagnitude;
+
+    int64_t smallestUntrackable = subBucketCount << unitMagnitude;
+    bucketCount = 1;
+    while (smallestUntrackable <= highest) {
+      if (smallestUntrackable > INT64_MAX / 2) {
+        bucketCount++;
+        break;
+      }
+      smallestUntrackable <<= 1;
+      bucketCount++;
+    }
+    counts.assign((size_t)(bucketCount + 1) * (size_t)subBucketHalfCount, 0);
+  }
+
+  // 1 ns to 60 s with 3 significant digits.
+  HdrHistogram() : HdrHistogram(1, 60000000000LL, 3) {}
+
+  void record(int64_t value, uint64_t count = 1) {
+    if (value < 0) {
+      value = 0;
+    }
+    if (value > highest) {
+      value = highest;
+      clampedCount += count;
+    }
+    counts[indexOf(value)] += count;
+    total += count;
+    sum += (double)value * count;
+    minValue = std::min(minValue, value);
+    maxValue = std::max(maxValue, value);
+  }
+
+  // add the values of another histogram of the same layout.
+  void add(const HdrHistogram& other) {
+    if (other.lowest != lowest || other.highest != highest || other.digits != digits) {
+      throw std::runtime_error("HdrHistogram: adding a histogram of another layout.");
+    }
+    for (size_t i = 0; i < counts.size(); i++) {
+      counts[i] += other.counts[i];
+    }
+    total += other.total;
+    clampedCount += other.clampedCount;
+    sum += other.sum;
+    minValue = std::min(minValue, other.minValue);
+    maxValue = std::max(maxValue, other.maxValue);
+  }
+
+  void reset() {
+    std::fill(counts.begin(), counts.end(), 0);
+    total = 0;
+    clampedCount = 0;
+    minValue = INT64_MAX;
+    maxValue = 0;
+    sum = 0;
+  }
+
+  // percentile in [0, 100], 0 if nothing was recorded.
+  int64_t valueAtPercentile(double percentile) const {
+    if (total == 0) {
+      return 0;
+    }
+    percentile = std::min(std::max(percentile, 0.0), 100.0);
+    uint64_t rank = (uint64_t)(percentile / 100.0 * total + 0.5);
+    rank = std::max<uint64_t>(rank, 1);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); i++) {
+      seen += counts[i];
+      if (seen >= rank) {
+        return std::min(highestEquivalent(valueAt(i)), maxValue);
+      }
+    }
+    return maxValue;
+  }
+
+  uint64_t count() const { return total; }
+  uint64_t clamped() const { return clampedCount; }
+  int64_t min() const { return total == 0 ? 0 : minValue; }
+  int64_t max() const { return maxValue; }
+  double mean() const { return total == 0 ? 0.0 : sum / total; }
+  // bytes of the counts array.
+  size_t footprint() const { return counts.size() * sizeof(uint64_t); }
+};
+
+
+}  // namespace seeker
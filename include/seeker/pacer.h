@@ -0,0 +1,227 @@
+/**
+@project seeker
+@author Tao Zhang
+@since 2020/3/1
+@version 0.0.1-SNAPSHOT 2026/10/19
+*/
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+#include "asio.hpp"
+#include "seeker/timingWheel.h"
+
+
+namespace seeker {
+
+
+/*
+Pacing for many periodic streams (media packets every ptime) on one thread, with one asio
+timer in total instead of one per stream.
+
+The next send time of every stream is a timer in a TimingWheel with a fine tick (20 us by
+default). Each wakeup advances the wheel to now and hands every stream that came due, with
+the time it was due, to the handler in one batch, so the sends of a tick can share one pass
+through a batched send path (BatchedUdpSocket queues them and flushes once per loop turn).
+The asio timer is only armed for the next occupied tick.
+
+Send times are absolute: the next one is the due time plus the interval, not the wakeup time
+plus the interval, so wakeup latency does not accumulate into drift. A stream that fell more
+than one interval behind (a stalled loop) is realigned to now instead of bursting its
+backlog, and counted in Stats::skipped.
+
+A stream is never released before its due time; lateness is the tick rounding plus wakeup
+latency, measured in Stats.
+*/
+class Pacer {
+ public:
+  using StreamId = uint32_t;
+  using clock = std::chrono::steady_clock;
+
+  struct Due {
+    StreamId stream;
+    int64_t dueNs;  // ns since the pacer started
+  };
+
+  // every stream due in one wakeup. May add, remove and change streams.
+  using Handler = std::function<void(std::vector<Due>&)>;
+
+  struct Stats {
+    uint64_t wakeups = 0;
+    uint64_t released = 0;
+    uint64_t skipped = 0;
+    uint64_t lateOver100us = 0;
+    int64_t lateSumNs = 0;
+    int64_t lateMaxNs = 0;
+
+    double meanLateUs() const { return released == 0 ? 0.0 : lateSumNs / 1e3 / released; }
+  };
+
+ private:
+  struct Entry {
+    int64_t intervalNs = 0;
+    int64_t nextNs = 0;
+    TimingWheel<StreamId>::TimerId timer = TimingWheel<StreamId>::invalidId;
+    bool active = false;
+  };
+
+  asio::steady_timer timer;
+  TimingWheel<StreamId> wheel;
+  clock::time_point origin;
+  int64_t tickNs;
+  Handler handler;
+  uint64_t armedTick = UINT64_MAX;
+
+  std::vector<Entry> entries;
+  std::vector<StreamId> freeIds;
+  std::vector<Due> due;
+  Stats stats;
+
+
+  int64_t nowNs() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - origin).count();
+  }
+
+  // first tick not before atNs: never early.
+  uint64_t tickAtOrAfter(int64_t atNs) const {
+    return atNs <= 0 ? 0 : (uint64_t)((atNs + tickNs - 1) / tickNs);
+  }
+
+  void place(StreamId id) {
+    Entry& e = entries[id];
+    uint64_t at = tickAtOrAfter(e.nextNs);
+    uint64_t ticks = at > wheel.now() ? at - wheel.now() : 1;
+    e.timer = wheel.schedule(ticks, id);
+  }
+
+  void onExpired(std::vector<StreamId>& expired, int64_t now) {
+    due.clear();
+    for (StreamId id : expired) {
+      Entry& e = entries[id];
+      if (!e.active) {
+        continue;
+      }
+      int64_t late = now - e.nextNs;
+      stats.lateSumNs += late;
+      stats.lateMaxNs = std::max(stats.lateMaxNs, late);
+      stats.lateOver100us += late > 100000 ? 1 : 0;
+      due.push_back(Due{id, e.nextNs});
+
+      e.nextNs += e.intervalNs;
+      if (e.nextNs + e.intervalNs < now) {
+        e.nextNs = now;
+        stats.skipped++;
+      }
+      place(id);
+    }
+    stats.released += due.size();
+    if (!due.empty()) {
+      handler(due);
+    }
+  }
+
+  void run() {
+    int64_t now = nowNs();
+    stats.wakeups++;
+    wheel.advance((uint64_t)(now / tickNs),
+                  [this, now](std::vector<StreamId>& expired) { onExpired(expired, now); });
+    rearm();
+  }
+
+  void rearm() {
+    uint64_t next = wheel.nextEventTick();
+    if (next == UINT64_MAX || next == armedTick) {
+      return;
+    }
+    armedTick = next;
+    timer.expires_at(origin + std::chrono::nanoseconds(tickNs * (int64_t)next));
+    timer.async_wait([this, next](const asio::error_code& ec) {
+      if (ec == asio::error::operation_aborted || next != armedTick) {
+        return;
+      }
+      armedTick = UINT64_MAX;
+      run();
+    });
+  }
+
+
+ public:
+  Pacer(asio::io_context& ioContext, std::chrono::nanoseconds tick, Handler handler_)
+      : timer(ioContext),
+        origin(clock::now()),
+        tickNs(tick.count()),
+        handler(std::move(handler_)) {
+    if (tickNs <= 0) {
+      throw std::runtime_error("Pacer tick must be positive.");
+    }
+  }
+
+  Pacer(asio::io_context& ioContext, Handler handler_)
+      : Pacer(ioContext, std::chrono::microseconds(20), std::move(handler_)) {}
+
+  Pacer(const Pacer&) = delete;
+  Pacer& operator=(const Pacer&) = delete;
+
+  // a stream due every interval, first after firstDelay.
+  StreamId add(std::chrono::nanoseconds interval, std::chrono::nanoseconds firstDelay) {
+    if (interval.count() <= 0) {
+      throw std::runtime_error("Pacer interval must be positive.");
+    }
+    StreamId id;
+    if (!freeIds.empty()) {
+      id = freeIds.back();
+      freeIds.pop_back();
+    } else {
+      id = (StreamId)entries.size();
+      entries.emplace_back();
+    }
+    Entry& e = entries[id];
+    e.intervalNs = interval.count();
+    e.nextNs = nowNs() + firstDelay.count();
+    e.active = true;
+    // an idle wheel may be far behind, catch up so the timer lands in the fine level.
+    if (wheel.size() == 0) {
+      wheel.advance((uint64_t)(nowNs() / tickNs), [](std::vector<StreamId>&) {});
+    }
+    place(id);
+    if (wheel.nextEventTick() < armedTick) {
+      rearm();
+    }
+    return id;
+  }
+
+  StreamId add(std::chrono::nanoseconds interval) {
+    return add(interval, std::chrono::nanoseconds(0));
+  }
+
+  // the stream is not released any more, its id may be reused by add().
+  void remove(StreamId id) {
+    if (id >= entries.size() || !entries[id].active) {
+      return;
+    }
+    wheel.cancel(entries[id].timer);
+    entries[id].active = false;
+    freeIds.push_back(id);
+  }
+
+  // from the next release on.
+  void setInterval(StreamId id, std::chrono::nanoseconds interval) {
+    if (id < entries.size() && entries[id].active && interval.count() > 0) {
+      entries[id].intervalNs = interval.count();
+    }
+  }
+
+  // ns since the pacer started, the clock of Due::dueNs.
+  int64_t now() const { return nowNs(); }
+
+  size_t size() const { return entries.size() - freeIds.size(); }
+  const Stats& statistics() const { return stats; }
+  void resetStatistics() { stats = Stats(); }
+};
+
+
+}  // namespace seeker
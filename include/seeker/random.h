@@ -55,7 +55,7 @@ class Random {
     static std::random_device rd;
     static std::mt19937 gen{seed == INT_MIN ? rd() : seed};
     std::uniform_int_distribution<> dis(min, max - 1);
-    auto func = [=] { return dis(gen); };
+    auto func = [=]() mutable { return dis(gen); };
     return func;
   };
 
@@ -63,7 +63,7 @@ class Random {
     static std::random_device rd;
     static std::mt19937 gen{seed == INT_MIN ? rd() : seed};
     std::uniform_real_distribution<> dis(min, max);
-    auto func = [=]() { return dis(gen); };
+    auto func = [=]() mutable { return dis(gen); };
     return func;
   };
 
@@ -0,0 +1,351 @@
+/**
+@project seeker
+@author Tao Zhang
+@since 2020/3/1
+@version 0.0.1-SNAPSHOT 2026/10/19
+*/
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define SEEKER_HAS_FUTEX 1
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#define SEEKER_CPU_RELAX() _mm_pause()
+#elif defined(__aarch64__)
+#define SEEKER_CPU_RELAX() asm volatile("yield" ::: "memory")
+#else
+#define SEEKER_CPU_RELAX() std::this_thread::yield()
+#endif
+
+
+namespace seeker {
+
+
+static const size_t cacheLineSize = 64;
+
+
+/*
+Wait strategies, used when a blocking push/pop finds the ring full/empty.
+  SpinWait   busy poll with a pause instruction, lowest latency, burns the core.
+  YieldWait  poll and give the core away between tries.
+  FutexWait  spin a little, then sleep on a futex. The other side only pays a syscall when
+             somebody is actually asleep. Falls back to YieldWait without futex.
+*/
+struct SpinWait {
+  static constexpr bool sleeps = false;
+  static void idle() { SEEKER_CPU_RELAX(); }
+};
+
+struct YieldWait {
+  static constexpr bool sleeps = false;
+  static void idle() { std::this_thread::yield(); }
+};
+
+struct FutexWait {
+#ifdef SEEKER_HAS_FUTEX
+  static constexpr bool sleeps = true;
+#else
+  static constexpr bool sleeps = false;
+#endif
+  static constexpr int spinBeforeSleep = 256;
+  static void idle() { SEEKER_CPU_RELAX(); }
+};
+
+
+// one side of a ring waits here for the other side to make progress.
+template <typename Wait>
+class alignas(cacheLineSize) WaitPoint {
+  std::atomic<uint32_t> epoch{0};
+  std::atomic<uint32_t> sleepers{0};
+
+  void sleep(uint32_t seen) {
+#ifdef SEEKER_HAS_FUTEX
+    syscall(SYS_futex, (uint32_t*)&epoch, FUTEX_WAIT_PRIVATE, seen, nullptr, nullptr, 0);
+#else
+    (void)seen;
+    std::this_thread::yield();
+#endif
+  }
+
+ public:
+  // call tryOnce() until it returns true.
+  template <typename F>
+  void waitUntil(F&& tryOnce) {
+    for (int round = 0;; round++) {
+      if (tryOnce()) {
+        return;
+      }
+      if (!Wait::sleeps || round < FutexWait::spinBeforeSleep) {
+        Wait::idle();
+        continue;
+      }
+      // announce the sleeper before the last check, notify() checks it after publishing.
+      sleepers.fetch_add(1, std::memory_order_seq_cst);
+      uint32_t seen = epoch.load(std::memory_order_acquire);
+      if (tryOnce()) {
+        sleepers.fetch_sub(1, std::memory_order_relaxed);
+        return;
+      }
+      sleep(seen);
+      sleepers.fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+
+  // the other side made progress, wake sleepers if any.
+  void notify() {
+    if (!Wait::sleeps) {
+      return;
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleepers.load(std::memory_order_relaxed) > 0) {
+      epoch.fetch_add(1, std::memory_order_release);
+#ifdef SEEKER_HAS_FUTEX
+      syscall(SYS_futex, (uint32_t*)&epoch, FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr,
+              0);
+#endif
+    }
+  }
+};
+
+
+inline size_t ringCapacityFor(size_t minCapacity) {
+  if (minCapacity == 0 || minCapacity > (SIZE_MAX >> 1)) {
+    throw std::runtime_error("invalid ring capacity.");
+  }
+  size_t capacity = 1;
+  while (capacity < minCapacity) {
+    capacity <<= 1;
+  }
+  return capacity;
+}
+
+
+
+/*
+Bounded single-producer / single-consumer ring.
+
+Producer and consumer indexes sit on their own cache lines, each next to a private copy of the
+other side's index. The shared index is only re-read when the copy says the ring is full (or
+empty), so in steady state a push or a pop touches no cache line owned by the other core.
+Batch calls publish the whole batch with one store.
+
+T is a small descriptor (pointer + length, buffer index...), moved in and out.
+*/
+template <typename T, typename Wait = SpinWait>
+class SpscRing {
+  const size_t capacity;
+  const size_t mask;
+  std::unique_ptr<T[]> items;
+
+  struct alignas(cacheLineSize) {
+    std::atomic<size_t> tail{0};
+    size_t cachedHead = 0;
+  } producer;
+
+  struct alignas(cacheLineSize) {
+    std::atomic<size_t> head{0};
+    size_t cachedTail = 0;
+  } consumer;
+
+  WaitPoint<Wait> notEmpty;
+  WaitPoint<Wait> notFull;
+
+
+ public:
+  // capacity is rounded up to a power of 2.
+  explicit SpscRing(size_t minCapacity)
+      : capacity(ringCapacityFor(minCapacity)), mask(capacity - 1), items(new T[capacity]) {}
+
+  SpscRing(const SpscRing&) = delete;
+  SpscRing& operator=(const SpscRing&) = delete;
+
+  // producer side. Move up to n items in, return how many were taken.
+  size_t pushBatch(T* in, size_t n) {
+    size_t tail = producer.tail.load(std::memory_order_relaxed);
+    size_t space = capacity - (tail - producer.cachedHead);
+    if (space < n) {
+      producer.cachedHead = consumer.head.load(std::memory_order_acquire);
+      space = capacity - (tail - producer.cachedHead);
+    }
+    n = n < space ? n : space;
+    for (size_t i = 0; i < n; i++) {
+      items[(tail + i) & mask] = std::move(in[i]);
+    }
+    if (n > 0) {
+      producer.tail.store(tail + n, std::memory_order_release);
+      notEmpty.notify();
+    }
+    return n;
+  }
+
+  bool tryPush(T&& item) { return pushBatch(&item, 1) == 1; }
+
+  // consumer side. Move up to max items out, return how many.
+  size_t popBatch(T* out, size_t max) {
+    size_t head = consumer.head.load(std::memory_order_relaxed);
+    size_t available = consumer.cachedTail - head;
+    if (available < max) {
+      consumer.cachedTail = producer.tail.load(std::memory_order_acquire);
+      available = consumer.cachedTail - head;
+    }
+    size_t n = max < available ? max : available;
+    for (size_t i = 0; i < n; i++) {
+      out[i] = std::move(items[(head + i) & mask]);
+    }
+    if (n > 0) {
+      consumer.head.store(head + n, std::memory_order_release);
+      notFull.notify();
+    }
+    return n;
+  }
+
+  bool tryPop(T& out) { return popBatch(&out, 1) == 1; }
+
+  // blocking variants, wait with the Wait strategy.
+  void push(T item) {
+    notFull.waitUntil([&]() { return tryPush(std::move(item)); });
+  }
+
+  void pop(T& out) {
+    notEmpty.waitUntil([&]() { return tryPop(out); });
+  }
+
+  // wait for at least one item, then take up to max.
+  size_t popBatchWait(T* out, size_t max) {
+    size_t n = 0;
+    notEmpty.waitUntil([&]() { return (n = popBatch(out, max)) > 0; });
+    return n;
+  }
+
+  // approximate when called concurrently.
+  size_t size() const {
+    return producer.tail.load(std::memory_order_acquire) -
+           consumer.head.load(std::memory_order_acquire);
+  }
+
+  size_t maxSize() const { return capacity; }
+};
+
+
+
+/*
+Bounded multi-producer / single-consumer ring (after D. Vyukov's bounded MPMC queue).
+
+Each cell carries a sequence number telling whether it is free for position p (seq == p) or
+holds the item of position p (seq == p + 1). Producers claim positions with one CAS on the
+tail, a batch claims a whole range at once, then fill their cells independently; the consumer
+takes cells in order as their sequence says they are ready, without any CAS.
+*/
+template <typename T, typename Wait = SpinWait>
+class MpscRing {
+  struct Cell {
+    std::atomic<size_t> seq;
+    T value;
+  };
+
+  const size_t capacity;
+  const size_t mask;
+  std::unique_ptr<Cell[]> cells;
+
+  alignas(cacheLineSize) std::atomic<size_t> tail{0};
+  alignas(cacheLineSize) std::atomic<size_t> head{0};
+
+  WaitPoint<Wait> notEmpty;
+  WaitPoint<Wait> notFull;
+
+
+ public:
+  explicit MpscRing(size_t minCapacity)
+      : capacity(ringCapacityFor(minCapacity)), mask(capacity - 1), cells(new Cell[capacity]) {
+    for (size_t i = 0; i < capacity; i++) {
+      cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  MpscRing(const MpscRing&) = delete;
+  MpscRing& operator=(const MpscRing&) = delete;
+
+  // any producer thread. Move up to n items in, return how many were taken.
+  size_t pushBatch(T* in, size_t n) {
+    size_t pos = tail.load(std::memory_order_relaxed);
+    size_t claimed;
+    for (;;) {
+      // the consumer publishes head only after freeing the cells below it.
+      size_t space = capacity - (pos - head.load(std::memory_order_acquire));
+      claimed = n < space ? n : space;
+      if (claimed == 0) {
+        return 0;
+      }
+      if (tail.compare_exchange_weak(pos, pos + claimed, std::memory_order_relaxed)) {
+        break;
+      }
+    }
+    for (size_t i = 0; i < claimed; i++) {
+      Cell& cell = cells[(pos + i) & mask];
+      cell.value = std::move(in[i]);
+      cell.seq.store(pos + i + 1, std::memory_order_release);
+    }
+    notEmpty.notify();
+    return claimed;
+  }
+
+  bool tryPush(T&& item) { return pushBatch(&item, 1) == 1; }
+
+  // consumer thread only. Stops at the first cell a producer has claimed but not filled yet.
+  size_t popBatch(T* out, size_t max) {
+    size_t pos = head.load(std::memory_order_relaxed);
+    size_t n = 0;
+    while (n < max) {
+      Cell& cell = cells[(pos + n) & mask];
+      if (cell.seq.load(std::memory_order_acquire) != pos + n + 1) {
+        break;
+      }
+      out[n] = std::move(cell.value);
+      cell.seq.store(pos + n + capacity, std::memory_order_release);
+      n++;
+    }
+    if (n > 0) {
+      head.store(pos + n, std::memory_order_release);
+      notFull.notify();
+    }
+    return n;
+  }
+
+  bool tryPop(T& out) { return popBatch(&out, 1) == 1; }
+
+  void push(T item) {
+    notFull.waitUntil([&]() { return tryPush(std::move(item)); });
+  }
+
+  void pop(T& out) {
+    notEmpty.waitUntil([&]() { return tryPop(out); });
+  }
+
+  size_t popBatchWait(T* out, size_t max) {
+    size_t n = 0;
+    notEmpty.waitUntil([&]() { return (n = popBatch(out, max)) > 0; });
+    return n;
+  }
+
+  size_t size() const {
+    return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+  }
+
+  size_t maxSize() const { return capacity; }
+};
+
+
+}  // namespace seeker
@@ -0,0 +1,375 @@
+/**
+@project seeker
+@author Tao Zhang
+@since 2020/3/1
+@version 0.0.1-SNAPSHOT 2026/10/19
+*/
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "seeker/common.h"
+#include "seeker/loggerApi.h"
+
+#if __has_include("sqlite3.h")
+#include "seeker/database.h"
+#define SEEKER_COUNTER_SQLITE 1
+#endif
+
+
+namespace seeker {
+
+using std::string;
+
+
+/*
+Packet / byte counters written by many I/O threads without any shared cache line.
+
+Every writer thread owns a Shard: a lazily grown array of plain slots, one per counter id.
+add() is two relaxed load/store pairs on the writer's own memory, no atomic read-modify-write,
+nothing another core writes. Updates are wrapped in a per-shard seqlock (a sequence number
+made odd while writing), so a reader copying a slot never sees packets and bytes from
+different updates; a Batch guard takes the seqlock once for a whole receive batch.
+
+A reader (collect(), or the export thread of startExport()) sums the shards chunk by chunk,
+retrying a chunk whose sequence moved under it, and hands totals to a sink: the logger or
+a SQLite table.
+
+Counter ids come from acquire(name), on the control path and under a lock; the same name
+gives the same id while it is held. Once released by every holder the counter is exported
+one last time by the next collect() and its id recycled.
+*/
+class ShardedCounters {
+ public:
+  struct Total {
+    string name;
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+    bool final = false;  // last export of a released counter
+  };
+
+  using Sink = std::function<void(const std::vector<Total>&)>;
+
+ private:
+  static constexpr uint32_t chunkBits = 10;
+  static constexpr uint32_t chunkSize = 1u << chunkBits;
+  static constexpr uint32_t maxChunks = 1024;
+
+  struct Slot {
+    std::atomic<uint64_t> packets{0};
+    std::atomic<uint64_t> bytes{0};
+  };
+
+ public:
+  class alignas(64) Shard {
+    friend class ShardedCounters;
+
+    std::atomic<uint32_t> seq{0};
+    uint32_t depth = 0;  // writer only
+    std::atomic<Slot*> chunks[maxChunks]{};
+
+    Slot& slot(uint32_t id) {
+      uint32_t c = id >> chunkBits;
+      Slot* chunk = chunks[c].load(std::memory_order_relaxed);
+      if (chunk == nullptr) {
+        chunk = new Slot[chunkSize];
+        chunks[c].store(chunk, std::memory_order_release);
+      }
+      return chunk[id & (chunkSize - 1)];
+    }
+
+    static void bump(std::atomic<uint64_t>& v, uint64_t n) {
+      v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+   public:
+    Shard() = default;
+    Shard(const Shard&) = delete;
+    Shard& operator=(const Shard&) = delete;
+
+    ~Shard() {
+      for (auto& c : chunks) {
+        delete[] c.load(std::memory_order_relaxed);
+      }
+    }
+
+    void begin() {
+      if (depth++ == 0) {
+        seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+      }
+    }
+
+    void end() {
+      if (--depth == 0) {
+        seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+      }
+    }
+
+    // one packet of `bytes` on counter id. Owner thread only.
+    void add(uint32_t id, uint64_t bytes) {
+      begin();
+      Slot& s = slot(id);
+      bump(s.packets, 1);
+      bump(s.bytes, bytes);
+      end();
+    }
+  };
+
+  // hold the seqlock of a shard for a batch of add().
+  class Batch {
+    Shard& shard;
+
+   public:
+    explicit Batch(Shard& shard_) : shard(shard_) { shard.begin(); }
+    ~Batch() { shard.end(); }
+    Batch(const Batch&) = delete;
+    Batch& operator=(const Batch&) = delete;
+  };
+
+ private:
+  struct Name {
+    string name;
+    uint32_t holders = 0;
+  };
+
+  std::vector<std::unique_ptr<Shard>> shards;
+
+  std::mutex mutex;  // registry, control path only
+  std::vector<Name> names;
+  std::unordered_map<string, uint32_t> ids;
+  std::vector<uint32_t> freeIds;
+  std::vector<uint32_t> released;  // waiting for their final export
+
+  std::mutex exportMutex;
+  std::condition_variable exportCv;
+  std::thread exporter;
+  bool exporting = false;
+
+
+  // consistent copy of chunk c of a shard, added into out. false if the chunk is absent.
+  static bool readChunk(const Shard& shard, uint32_t c, std::vector<uint64_t>& packets,
+                        std::vector<uint64_t>& bytes) {
+    const Slot* chunk = shard.chunks[c].load(std::memory_order_acquire);
+    if (chunk == nullptr) {
+      return false;
+    }
+    uint64_t p[chunkSize];
+    uint64_t b[chunkSize];
+    for (;;) {
+      uint32_t s1 = shard.seq.load(std::memory_order_acquire);
+      if (s1 & 1) {
+        std::this_thread::yield();
+        continue;
+      }
+      for (uint32_t i = 0; i < chunkSize; i++) {
+        p[i] = chunk[i].packets.load(std::memory_order_relaxed);
+        b[i] = chunk[i].bytes.load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (shard.seq.load(std::memory_order_relaxed) == s1) {
+        break;
+      }
+    }
+    size_t base = (size_t)c << chunkBits;
+    for (uint32_t i = 0; i < chunkSize && base + i < packets.size(); i++) {
+      packets[base + i] += p[i];
+      bytes[base + i] += b[i];
+    }
+    return true;
+  }
+
+  // reset a released id in every shard. Nobody writes it any more.
+  void clearSlot(uint32_t id) {
+    for (auto& shard : shards) {
+      Slot* chunk = shard->chunks[id >> chunkBits].load(std::memory_order_acquire);
+      if (chunk != nullptr) {
+        chunk[id & (chunkSize - 1)].packets.store(0, std::memory_order_relaxed);
+        chunk[id & (chunkSize - 1)].bytes.store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+
+
+ public:
+  explicit ShardedCounters(size_t shardCount) {
+    if (shardCount == 0) {
+      throw std::runtime_error("ShardedCounters needs at least one shard.");
+    }
+    for (size_t i = 0; i < shardCount; i++) {
+      shards.emplace_back(new Shard());
+    }
+  }
+
+  ShardedCounters(const ShardedCounters&) = delete;
+  ShardedCounters& operator=(const ShardedCounters&) = delete;
+
+  ~ShardedCounters() { stopExport(); }
+
+  size_t shardCount() const { return shards.size(); }
+
+  // writer side of shard i, for the thread that owns it.
+  Shard& shard(size_t i) { return *shards.at(i); }
+
+  // id of counter name, shared by everybody holding the same name.
+  uint32_t acquire(const string& name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = ids.find(name);
+    if (it != ids.end()) {
+      names[it->second].holders++;
+      return it->second;
+    }
+    uint32_t id;
+    if (!freeIds.empty()) {
+      id = freeIds.back();
+      freeIds.pop_back();
+      names[id] = Name{name, 1};
+    } else {
+      if (names.size() >= (size_t)maxChunks * chunkSize) {
+        throw std::runtime_error("too many counters.");
+      }
+      id = (uint32_t)names.size();
+      names.push_back(Name{name, 1});
+    }
+    ids.emplace(name, id);
+    return id;
+  }
+
+  // writers must not add() to id after their release.
+  void release(uint32_t id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (id >= names.size() || names[id].holders == 0) {
+      return;
+    }
+    if (--names[id].holders == 0) {
+      ids.erase(names[id].name);
+      released.push_back(id);
+    }
+  }
+
+  // totals of every live counter, plus the final value of counters released since last time.
+  std::vector<Total> collect() {
+    std::vector<Name> snapshotNames;
+    std::vector<uint32_t> finals;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      snapshotNames = names;
+      finals.swap(released);
+    }
+    std::vector<uint64_t> packets(snapshotNames.size());
+    std::vector<uint64_t> bytes(snapshotNames.size());
+    uint32_t chunkCount = (uint32_t)((snapshotNames.size() + chunkSize - 1) >> chunkBits);
+    for (auto& shard : shards) {
+      for (uint32_t c = 0; c < chunkCount; c++) {
+        readChunk(*shard, c, packets, bytes);
+      }
+    }
+
+    std::vector<Total> rst;
+    for (uint32_t id = 0; id < snapshotNames.size(); id++) {
+      if (snapshotNames[id].holders > 0) {
+        rst.push_back(Total{snapshotNames[id].name, packets[id], bytes[id], false});
+      }
+    }
+    for (uint32_t id : finals) {
+      rst.push_back(Total{snapshotNames[id].name, packets[id], bytes[id], true});
+      clearSlot(id);
+    }
+    if (!finals.empty()) {
+      std::lock_guard<std::mutex> lock(mutex);
+      freeIds.insert(freeIds.end(), finals.begin(), finals.end());
+    }
+    return rst;
+  }
+
+  // run collect() every intervalMs on a thread of its own and pass the totals to sink.
+  void startExport(int64_t intervalMs, Sink sink) {
+    std::lock_guard<std::mutex> lock(exportMutex);
+    if (exporting) {
+      throw std::runtime_error("counter export already started.");
+    }
+    exporting = true;
+    exporter = std::thread([this, intervalMs, sink]() {
+      std::unique_lock<std::mutex> lock(exportMutex);
+      while (exporting) {
+        exportCv.wait_for(lock, std::chrono::milliseconds(intervalMs));
+        lock.unlock();
+        sink(collect());
+        lock.lock();
+      }
+    });
+  }
+
+  // stop the export thread after one last export.
+  void stopExport() {
+    {
+      std::lock_guard<std::mutex> lock(exportMutex);
+      if (!exporting) {
+        return;
+      }
+      exporting = false;
+    }
+    exportCv.notify_all();
+    if (exporter.joinable()) {
+      exporter.join();
+    }
+  }
+
+  static Sink logSink() {
+    return [](const std::vector<Total>& totals) {
+      for (auto& t : totals) {
+        I_LOG("counter {} packets={} bytes={}{}", t.name, t.packets, t.bytes,
+              t.final ? " (final)" : "");
+      }
+    };
+  }
+
+#ifdef SEEKER_COUNTER_SQLITE
+  /*
+  append the totals to `table` (created if missing) of the SqliteDB, one row per counter:
+  time (ms since epoch), name, packets, bytes, final.
+  */
+  static Sink sqliteSink(const string& table) {
+    string create = "CREATE TABLE IF NOT EXISTS " + table +
+                    " (time INTEGER, name TEXT, packets INTEGER, bytes INTEGER," +
+                    " final INTEGER);";
+    string err;
+    if (SqliteDB::exec(create, nullptr, nullptr, err) != SQLITE_OK) {
+      throw std::runtime_error("create counter table failed: " + err);
+    }
+    string insert = "INSERT INTO " + table + " VALUES (?, ?, ?, ?, ?);";
+    return [insert](const std::vector<Total>& totals) {
+      std::lock_guard<std::mutex> lock(SqliteDB::getInsertMutex());
+      auto stmt = SqliteDB::perpare(insert);
+      int64_t now = Time::currentTime();
+      string err;
+      SqliteDB::exec("BEGIN;", nullptr, nullptr, err);
+      for (auto& t : totals) {
+        sqlite3_bind_int64(stmt.get(), 1, now);
+        sqlite3_bind_text(stmt.get(), 2, t.name.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int64(stmt.get(), 3, (sqlite3_int64)t.packets);
+        sqlite3_bind_int64(stmt.get(), 4, (sqlite3_int64)t.bytes);
+        sqlite3_bind_int(stmt.get(), 5, t.final ? 1 : 0);
+        if (sqlite3_step(stmt.get()) != SQLITE_DONE) {
+          W_LOG("counter insert failed: {}", t.name);
+        }
+        sqlite3_reset(stmt.get());
+      }
+      SqliteDB::exec("COMMIT;", nullptr, nullptr, err);
+    };
+  }
+#endif
+};
+
+
+}  // namespace seeker
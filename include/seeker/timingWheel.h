@@ -0,0 +1,368 @@
+/**
+@project seeker
+@author Tao Zhang
+@since 2020/3/1
+@version 0.0.1-SNAPSHOT 2026/10/19
+*/
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "asio.hpp"
+
+
+namespace seeker {
+
+
+/*
+Hierarchical timing wheel, 4 levels x 256 slots, 2^32 ticks of range.
+
+- Timers are nodes in one flat pool, chained into slot lists by index. schedule() and
+  cancel() are O(1) and never allocate once the pool has grown to its peak size.
+- A timer far in the future sits in a coarse level and is cascaded down when the finer level
+  wraps, as in the classic Varghese & Lauck scheme.
+- advance() collects everything that expired into one batch and hands it to the caller.
+- Per-level occupancy bitmaps let advance() jump over empty stretches, and tell the driver
+  how long it can sleep.
+
+T is the payload carried by a timer, keep it small and cheap to move.
+*/
+template <typename T>
+class TimingWheel {
+ public:
+  using TimerId = uint64_t;
+  static constexpr TimerId invalidId = 0;
+
+ private:
+  static constexpr uint32_t nil = UINT32_MAX;
+  static constexpr int levels = 4;
+  static constexpr int slotBits = 8;
+  static constexpr uint32_t slotCount = 1u << slotBits;
+  static constexpr uint32_t slotMask = slotCount - 1;
+
+  struct Node {
+    uint64_t expire = 0;
+    uint32_t prev = nil;
+    uint32_t next = nil;
+    uint32_t generation = 1;
+    uint16_t slot = 0;  // level * slotCount + index
+    bool active = false;
+    T payload{};
+  };
+
+  std::vector<Node> nodes;
+  uint32_t freeHead = nil;
+
+  uint32_t heads[levels * slotCount];
+  uint64_t occupied[levels][slotCount / 64];
+
+  uint64_t current = 0;
+  size_t count = 0;
+
+  std::vector<T> batch;
+
+
+  static TimerId makeId(uint32_t index, uint32_t generation) {
+    return ((uint64_t)generation << 32) | (uint64_t)index;
+  }
+
+  uint32_t allocNode() {
+    if (freeHead != nil) {
+      uint32_t index = freeHead;
+      freeHead = nodes[index].next;
+      return index;
+    }
+    nodes.emplace_back();
+    return (uint32_t)(nodes.size() - 1);
+  }
+
+  void freeNode(uint32_t index) {
+    Node& n = nodes[index];
+    n.active = false;
+    n.generation++;
+    n.payload = T{};
+    n.next = freeHead;
+    freeHead = index;
+  }
+
+  void setOccupied(int level, uint32_t index, bool on) {
+    uint64_t bit = 1ULL << (index & 63);
+    if (on) {
+      occupied[level][index >> 6] |= bit;
+    } else {
+      occupied[level][index >> 6] &= ~bit;
+    }
+  }
+
+  bool levelEmpty(int level) const {
+    for (uint32_t w = 0; w < slotCount / 64; w++) {
+      if (occupied[level][w]) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void link(uint32_t index) {
+    Node& n = nodes[index];
+    uint64_t delta = n.expire > current ? n.expire - current : 0;
+
+    int level = 0;
+    while (level < levels - 1 && delta >= (1ULL << (slotBits * (level + 1)))) {
+      level++;
+    }
+    uint32_t slotIndex = (uint32_t)(n.expire >> (slotBits * level)) & slotMask;
+    uint16_t slot = (uint16_t)(level * slotCount + slotIndex);
+
+    n.slot = slot;
+    n.prev = nil;
+    n.next = heads[slot];
+    if (n.next != nil) {
+      nodes[n.next].prev = index;
+    }
+    heads[slot] = index;
+    setOccupied(level, slotIndex, true);
+  }
+
+  void unlink(uint32_t index) {
+    Node& n = nodes[index];
+    if (n.prev != nil) {
+      nodes[n.prev].next = n.next;
+    } else {
+      heads[n.slot] = n.next;
+    }
+    if (n.next != nil) {
+      nodes[n.next].prev = n.prev;
+    }
+    if (heads[n.slot] == nil) {
+      setOccupied(n.slot / slotCount, n.slot & slotMask, false);
+    }
+  }
+
+  // take a whole slot list, clear the slot.
+  uint32_t detach(int level, uint32_t slotIndex) {
+    uint16_t slot = (uint16_t)(level * slotCount + slotIndex);
+    uint32_t head = heads[slot];
+    heads[slot] = nil;
+    setOccupied(level, slotIndex, false);
+    return head;
+  }
+
+  void cascade(int level) {
+    uint32_t slotIndex = (uint32_t)(current >> (slotBits * level)) & slotMask;
+    uint32_t index = detach(level, slotIndex);
+    while (index != nil) {
+      uint32_t next = nodes[index].next;
+      link(index);
+      index = next;
+    }
+  }
+
+  void expireSlot() {
+    uint32_t index = detach(0, (uint32_t)current & slotMask);
+    while (index != nil) {
+      uint32_t next = nodes[index].next;
+      batch.emplace_back(std::move(nodes[index].payload));
+      freeNode(index);
+      count--;
+      index = next;
+    }
+  }
+
+  // first level-0 slot after current that holds timers, within the current rotation.
+  uint64_t nextOccupiedInLevel0() const {
+    uint32_t start = ((uint32_t)current & slotMask) + 1;
+    for (uint32_t i = start; i < slotCount; i++) {
+      if (occupied[0][i >> 6] & (1ULL << (i & 63))) {
+        return (current & ~(uint64_t)slotMask) + i;
+      }
+    }
+    return UINT64_MAX;
+  }
+
+
+ public:
+  TimingWheel() {
+    for (auto& h : heads) {
+      h = nil;
+    }
+    for (auto& level : occupied) {
+      for (auto& w : level) {
+        w = 0;
+      }
+    }
+  }
+
+  TimingWheel(const TimingWheel&) = delete;
+  TimingWheel& operator=(const TimingWheel&) = delete;
+
+  // fire after `ticks` ticks (at least 1).
+  TimerId schedule(uint64_t ticks, T payload) {
+    if (ticks == 0) {
+      ticks = 1;
+    }
+    if (ticks > UINT32_MAX) {
+      ticks = UINT32_MAX;
+    }
+    uint32_t index = allocNode();
+    Node& n = nodes[index];
+    n.expire = current + ticks;
+    n.active = true;
+    n.payload = std::move(payload);
+    link(index);
+    count++;
+    return makeId(index, n.generation);
+  }
+
+  // return false if the timer already fired or was cancelled.
+  bool cancel(TimerId id) {
+    uint32_t index = (uint32_t)id;
+    uint32_t generation = (uint32_t)(id >> 32);
+    if (index >= nodes.size()) {
+      return false;
+    }
+    Node& n = nodes[index];
+    if (!n.active || n.generation != generation) {
+      return false;
+    }
+    unlink(index);
+    freeNode(index);
+    count--;
+    return true;
+  }
+
+  // tick at which something may happen next, UINT64_MAX if the wheel is empty.
+  uint64_t nextEventTick() const {
+    if (count == 0) {
+      return UINT64_MAX;
+    }
+    // level L is cascaded at every multiple of 256^L, level 0 wraps at multiples of 256.
+    uint64_t boundary = UINT64_MAX;
+    for (int level = 1; level < levels; level++) {
+      if (!levelEmpty(level) || (level == 1 && !levelEmpty(0))) {
+        uint64_t span = 1ULL << (slotBits * level);
+        boundary = (current & ~(span - 1)) + span;
+        break;
+      }
+    }
+    return std::min(nextOccupiedInLevel0(), boundary);
+  }
+
+  // move time forward to `toTick`, hand every expired payload to onExpired in one batch.
+  // onExpired(std::vector<T>&) may schedule and cancel timers.
+  template <typename F>
+  size_t advance(uint64_t toTick, F&& onExpired) {
+    batch.clear();
+    while (current < toTick) {
+      uint64_t next = nextEventTick();
+      if (next > toTick) {
+        current = toTick;
+        break;
+      }
+      current = next;
+
+      if ((current & slotMask) == 0) {
+        for (int level = levels - 1; level > 0; level--) {
+          uint64_t lowerMask = (1ULL << (slotBits * level)) - 1;
+          if ((current & lowerMask) == 0) {
+            cascade(level);
+          }
+        }
+      }
+      expireSlot();
+    }
+
+    size_t fired = batch.size();
+    if (fired > 0) {
+      // onExpired may call advance() again, hand it its own vector.
+      std::vector<T> expired;
+      expired.swap(batch);
+      onExpired(expired);
+      if (batch.empty()) {
+        expired.clear();
+        batch.swap(expired);
+      }
+    }
+    return fired;
+  }
+
+  uint64_t now() const { return current; }
+  size_t size() const { return count; }
+  size_t poolSize() const { return nodes.size(); }
+};
+
+
+
+/*
+Drive a TimingWheel from one asio::steady_timer, one instance per io_context thread.
+The asio timer is armed only for the next tick where the wheel has work, so an idle wheel or
+one holding only long timers costs almost no wakeups.
+*/
+template <typename T>
+class AsioTimingWheel {
+ public:
+  using TimerId = typename TimingWheel<T>::TimerId;
+  using clock = std::chrono::steady_clock;
+  // called with all payloads that expired in one wakeup.
+  using Handler = std::function<void(std::vector<T>&)>;
+
+ private:
+  asio::steady_timer timer;
+  TimingWheel<T> wheel;
+  clock::time_point origin;
+  clock::duration tick;
+  Handler handler;
+  uint64_t armedTick = UINT64_MAX;
+
+
+  uint64_t tickOf(clock::time_point t) const { return (uint64_t)((t - origin) / tick); }
+
+  void rearm() {
+    uint64_t next = wheel.nextEventTick();
+    if (next == UINT64_MAX || next == armedTick) {
+      return;
+    }
+    armedTick = next;
+    timer.expires_at(origin + tick * next);
+    timer.async_wait([this, next](const asio::error_code& ec) {
+      if (ec == asio::error::operation_aborted || next != armedTick) {
+        return;
+      }
+      armedTick = UINT64_MAX;
+      wheel.advance(tickOf(clock::now()), handler);
+      rearm();
+    });
+  }
+
+
+ public:
+  AsioTimingWheel(asio::io_context& ioContext, clock::duration tick_, Handler handler_)
+      : timer(ioContext), origin(clock::now()), tick(tick_), handler(std::move(handler_)) {}
+
+  AsioTimingWheel(const AsioTimingWheel&) = delete;
+  AsioTimingWheel& operator=(const AsioTimingWheel&) = delete;
+
+  TimerId schedule(clock::duration delay, T payload) {
+    // measure the delay from now, not from the last wakeup. The wheel is only advanced by the
+    // timer callback, so callers never see handlers run from inside schedule().
+    uint64_t ticks = (uint64_t)((delay + tick - clock::duration(1)) / tick);
+    uint64_t nowTick = tickOf(clock::now());
+    if (nowTick > wheel.now()) {
+      ticks += nowTick - wheel.now();
+    }
+    TimerId id = wheel.schedule(ticks, std::move(payload));
+    if (wheel.nextEventTick() < armedTick) {
+      rearm();
+    }
+    return id;
+  }
+
+  bool cancel(TimerId id) { return wheel.cancel(id); }
+
+  size_t size() const { return wheel.size(); }
+};
+
+
+}  // namespace seeker
@@ -0,0 +1,387 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "asio.hpp"
+#include "seeker/hdrHistogram.h"
+#include "seeker/logger.h"
+#include "seeker/pacer.h"
+#include "EndpointResolver.h"
+#include "RelayFrame.h"
+#include "TurnClient.h"
+
+using asio::ip::udp;
+using HelloCoturn::RelayFrame;
+using HelloCoturn::TurnClient;
+using Endpoints = HelloCoturn::EndpointResolver::Endpoints;
+
+
+struct BenchOptions {
+  double rate = 50;     // probes per second and path
+  size_t payload = 64;  // bytes, at least the probe header
+  int64_t seconds = 10;
+  std::string peerAddress = "127.0.0.1";
+};
+
+
+/*
+One way through the relay: ChannelData on a bound channel, or Send indications under a
+permission only, which the relay answers with Data indications.
+*/
+struct Path {
+  static constexpr size_t probeBytes = 12;  // send time (ns) and sequence number
+
+  const char* name;
+  TurnClient::Session* session = nullptr;
+  uint16_t channel = 0;  // 0: Send / Data indications
+  bool allocated = false;
+  bool ready = false;
+  seeker::Pacer::StreamId paced = 0;
+  uint32_t sequence = 0;
+  uint64_t sent = 0;
+  uint64_t received = 0;
+  uint64_t sendErrors = 0;
+  uint64_t foreign = 0;  // datagrams that are no echo of ours
+  seeker::HdrHistogram rtt;
+  std::vector<uint8_t> tx;
+  std::vector<uint8_t> rx;
+
+  Path(const char* name_, size_t payload)
+      : name(name_), tx(std::max(payload, probeBytes)), rx(RelayFrame::maxPayload + 64) {}
+
+  uint64_t lost() const { return sent > received ? sent - received : 0; }
+};
+
+
+/*
+Echo through the relay: a peer socket of this process sends every datagram back where it
+came from, the relayed address of the allocation. Two allocations probe it at the same rate,
+one with a ChannelBind and one with a CreatePermission only, so both directions of a probe
+take the same path: ChannelData out and back, or a Send indication out and a Data indication
+back. Each probe carries its send time, the round trip goes into an HdrHistogram per path.
+*/
+class EchoRelayBench {
+  static constexpr int64_t drainMs = 1000;
+
+  TurnClient& client;
+  BenchOptions options;
+  udp::socket echo;
+  udp::endpoint echoFrom;
+  std::vector<uint8_t> echoBuffer;
+  Path channelPath;
+  Path indicationPath;
+  size_t pendingSetups = 2;
+  asio::steady_timer control;
+  seeker::Pacer pacer;
+
+  static int64_t nowNs() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+  }
+
+  Path* byStream(seeker::Pacer::StreamId id) {
+    return channelPath.ready && id == channelPath.paced ? &channelPath : &indicationPath;
+  }
+
+  void receiveEcho() {
+    echo.async_receive_from(asio::buffer(echoBuffer), echoFrom,
+                            [this](const asio::error_code& ec, size_t n) {
+                              if (ec) {
+                                return;
+                              }
+                              asio::error_code ignored;
+                              echo.send_to(asio::buffer(echoBuffer.data(), n), echoFrom, 0,
+                                           ignored);
+                              receiveEcho();
+                            });
+  }
+
+  void onChannelSetup(const TurnClient::SetupResult& r) {
+    channelPath.allocated = r.allocation.errorCode == 0;
+    if (r.errorCode != 0 || r.channels.empty() || r.channels[0] == 0) {
+      W_LOG("channel path setup failed, error={}", r.errorCode);
+    } else {
+      channelPath.channel = r.channels[0];
+      channelPath.ready = true;
+      I_LOG("channel path: relayed {}, channel {:#x}, setup {}ms",
+            r.allocation.relayed.address().to_string(), channelPath.channel, r.setupMs);
+    }
+    onSetupDone();
+  }
+
+  void onIndicationAllocated(const TurnClient::AllocateResult& r) {
+    if (r.errorCode != 0) {
+      W_LOG("indication path allocate failed, error={}", r.errorCode);
+      onSetupDone();
+      return;
+    }
+    indicationPath.allocated = true;
+    indicationPath.session->createPermission({echo.local_endpoint()}, [this](int errorCode) {
+      if (errorCode != 0) {
+        W_LOG("indication path permission failed, error={}", errorCode);
+      } else {
+        indicationPath.ready = true;
+      }
+      onSetupDone();
+    });
+  }
+
+  void onSetupDone() {
+    if (--pendingSetups != 0) {
+      return;
+    }
+    if (!channelPath.ready && !indicationPath.ready) {
+      E_LOG("no path through the relay.");
+      finish();
+      return;
+    }
+    I_LOG("probing {}s at {} probes/s per path, payload {}B", options.seconds, options.rate,
+          indicationPath.tx.size());
+    auto interval = std::chrono::nanoseconds((int64_t)(1e9 / options.rate));
+    // the paths take turns, half an interval apart.
+    for (Path* p : {&channelPath, &indicationPath}) {
+      if (!p->ready) {
+        continue;
+      }
+      receive(*p);
+      auto offset = p == &channelPath ? std::chrono::nanoseconds(0) : interval / 2;
+      p->paced = pacer.add(interval, offset);
+    }
+    control.expires_after(std::chrono::seconds(options.seconds));
+    control.async_wait([this](const asio::error_code&) { stop(); });
+  }
+
+  void onDue(std::vector<seeker::Pacer::Due>& due) {
+    for (auto& d : due) {
+      send(*byStream(d.stream));
+    }
+  }
+
+  void send(Path& p) {
+    uint32_t seq = p.sequence++;
+    seeker::ByteArray::writeData(p.tx.data(), (uint64_t)nowNs(), false);
+    seeker::ByteArray::writeData(p.tx.data() + 8, seq, false);
+    asio::error_code ec;
+    if (p.channel != 0) {
+      auto frame = RelayFrame::channelData(p.channel, p.tx.data(), p.tx.size());
+      p.session->udpSocket().send(frame.buffers(), 0, ec);
+    } else {
+      uint32_t transId[3] = {0x4543484F, 0, seq};  // "ECHO", indications need no match
+      auto frame =
+          RelayFrame::sendIndication(transId, echo.local_endpoint(), p.tx.data(), p.tx.size());
+      p.session->udpSocket().send(frame.buffers(), 0, ec);
+    }
+    if (ec) {
+      p.sendErrors++;
+    } else {
+      p.sent++;
+    }
+  }
+
+  void receive(Path& p) {
+    p.session->udpSocket().async_receive(
+        asio::buffer(p.rx), [this, &p](const asio::error_code& ec, size_t n) {
+          if (ec) {
+            return;
+          }
+          onEcho(p, n, nowNs());
+          receive(p);
+        });
+  }
+
+  void onEcho(Path& p, size_t n, int64_t arrivalNs) {
+    const uint8_t* payload = nullptr;
+    size_t size = 0;
+    bool ok;
+    if (p.channel != 0) {
+      uint16_t channel = 0;
+      ok = RelayFrame::parseChannelData(p.rx.data(), n, channel, payload, size) &&
+           channel == p.channel;
+    } else {
+      udp::endpoint from;
+      // 0x0017: Data indication
+      ok = n >= 2 && p.rx[0] == 0x00 && p.rx[1] == 0x17 &&
+           RelayFrame::parseIndication(p.rx.data(), n, from, payload, size) &&
+           from == echo.local_endpoint();
+    }
+    if (!ok || size < Path::probeBytes) {
+      p.foreign++;
+      return;
+    }
+    uint64_t sentNs;
+    seeker::ByteArray::readData((uint8_t*)payload, sentNs, false);
+    p.received++;
+    p.rtt.record(arrivalNs - (int64_t)sentNs);
+  }
+
+  void stop() {
+    for (Path* p : {&channelPath, &indicationPath}) {
+      if (p->ready) {
+        pacer.remove(p->paced);
+      }
+    }
+    // probes still in flight after drainMs are counted as lost.
+    control.expires_after(std::chrono::milliseconds(drainMs));
+    control.async_wait([this](const asio::error_code&) {
+      report();
+      finish();
+    });
+  }
+
+  static void reportPath(const Path& p) {
+    if (!p.ready) {
+      return;
+    }
+    const seeker::HdrHistogram& h = p.rtt;
+    I_LOG("{}: sent={} received={} lost={} ({:.3f}%) sendErrors={} foreign={}", p.name, p.sent,
+          p.received, p.lost(), p.sent ? p.lost() * 100.0 / p.sent : 0.0, p.sendErrors,
+          p.foreign);
+    I_LOG("{}: rtt us p50 {:.1f} p90 {:.1f} p99 {:.1f} p99.9 {:.1f} max {:.1f} mean {:.1f}",
+          p.name, h.valueAtPercentile(50) / 1e3, h.valueAtPercentile(90) / 1e3,
+          h.valueAtPercentile(99) / 1e3, h.valueAtPercentile(99.9) / 1e3, h.max() / 1e3,
+          h.mean() / 1e3);
+  }
+
+  void report() {
+    reportPath(channelPath);
+    reportPath(indicationPath);
+    if (channelPath.received == 0 || indicationPath.received == 0) {
+      return;
+    }
+    const seeker::HdrHistogram& c = channelPath.rtt;
+    const seeker::HdrHistogram& i = indicationPath.rtt;
+    I_LOG("indication - channel: p50 {:+.1f}us p99 {:+.1f}us p99.9 {:+.1f}us",
+          (i.valueAtPercentile(50) - c.valueAtPercentile(50)) / 1e3,
+          (i.valueAtPercentile(99) - c.valueAtPercentile(99)) / 1e3,
+          (i.valueAtPercentile(99.9) - c.valueAtPercentile(99.9)) / 1e3);
+  }
+
+  // stop reading, delete the allocations; run() returns once the last one is gone.
+  void finish() {
+    asio::error_code ignored;
+    echo.close(ignored);
+    for (Path* p : {&channelPath, &indicationPath}) {
+      TurnClient::Session* session = p->session;
+      if (session == nullptr) {
+        continue;
+      }
+      p->session = nullptr;
+      if (!p->allocated) {
+        client.close(*session);
+        continue;
+      }
+      // our receive must not compete with the client for the Refresh response.
+      session->udpSocket().cancel(ignored);
+      session->refresh(0, [this, session](int) {
+        client.close(*session);
+      });
+    }
+  }
+
+ public:
+  EchoRelayBench(asio::io_context& ioContext_, TurnClient& client_, const BenchOptions& o)
+      : client(client_),
+        options(o),
+        echo(ioContext_),
+        echoBuffer(RelayFrame::maxPayload),
+        channelPath("channel", o.payload),
+        indicationPath("indication", o.payload),
+        control(ioContext_),
+        pacer(ioContext_, [this](std::vector<seeker::Pacer::Due>& due) { onDue(due); }) {
+    if (options.rate <= 0) {
+      throw std::runtime_error("rate must be positive.");
+    }
+  }
+
+  void start() {
+    asio::ip::address peerAddress = asio::ip::make_address(options.peerAddress);
+    echo.open(peerAddress.is_v6() ? udp::v6() : udp::v4());
+    echo.bind(udp::endpoint(peerAddress, 0));
+    receiveEcho();
+
+    channelPath.session = &client.open();
+    channelPath.session->setup(
+        {echo.local_endpoint()},
+        [this](const TurnClient::SetupResult& r) { onChannelSetup(r); });
+    indicationPath.session = &client.open();
+    indicationPath.session->allocate(
+        [this](const TurnClient::AllocateResult& r) { onIndicationAllocated(r); });
+  }
+};
+
+
+/*
+usage: echoRelayBench serverHost port [username password] [key=value ...]
+  keys: rate=probes per second and path (50), payload=bytes (64), seconds=10,
+  peer=127.0.0.1 (address of the echo peer, as the relay sees it).
+  sends timestamped probes through the relay to an echo peer of this process, over ChannelData
+  and over Send / Data indications, and prints the round trip percentiles of both paths.
+*/
+int main(int argc, char* argv[]) {
+  seeker::Logger::init();
+
+  if (argc < 3) {
+    std::cout << "usage: echoRelayBench server port [username password] [key=value ...]"
+              << std::endl;
+    return 1;
+  }
+
+  try {
+    asio::io_context ioContext(1);
+    std::string host = argv[1];
+    uint16_t port = (uint16_t)std::stoi(argv[2]);
+
+    TurnClient::Options options;
+    BenchOptions bench;
+    std::vector<std::string> credentials;
+    for (int i = 3; i < argc; i++) {
+      std::string arg = argv[i];
+      auto eq = arg.find('=');
+      if (eq == std::string::npos) {
+        credentials.push_back(arg);
+        continue;
+      }
+      std::string key = arg.substr(0, eq);
+      std::string value = arg.substr(eq + 1);
+      if (key == "rate") {
+        bench.rate = std::stod(value);
+      } else if (key == "payload") {
+        bench.payload = std::stoul(value);
+      } else if (key == "seconds") {
+        bench.seconds = std::stoll(value);
+      } else if (key == "peer") {
+        bench.peerAddress = value;
+      } else {
+        std::cout << "unknown option: " << arg << std::endl;
+        return 1;
+      }
+    }
+    if (credentials.size() == 2) {
+      options.username = credentials[0];
+      options.password = credentials[1];
+    }
+    bench.payload = std::min(bench.payload, RelayFrame::maxPayload);
+
+    HelloCoturn::EndpointResolver resolver(ioContext);
+    std::unique_ptr<TurnClient> client;
+    std::unique_ptr<EchoRelayBench> echo;
+    resolver.resolve(host, port, [&](const asio::error_code& ec, const Endpoints& servers) {
+      if (ec) {
+        E_LOG("resolve {} failed: {}", host, ec.message());
+        return;
+      }
+      client.reset(new TurnClient(ioContext, servers.front(), options));
+      echo.reset(new EchoRelayBench(ioContext, *client, bench));
+      echo->start();
+    });
+    ioContext.run();
+  } catch (std::exception& ex) {
+    std::cout << "Got exception: " << ex.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
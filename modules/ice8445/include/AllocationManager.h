@@ -0,0 +1,526 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "asio.hpp"
+#include "seeker/loggerApi.h"
+#include "seeker/random.h"
+#include "seeker/timingWheel.h"
+#include "MessageBuilder.h"
+#include "PermissionCache.h"
+#include "TransactionTable.h"
+
+
+namespace HelloCoturn {
+
+using std::string;
+
+
+struct TurnCredentials {
+  string username;
+  string password;
+  string realm;
+  string nonce;
+};
+
+
+
+/*
+Client side lifecycle of TURN allocations (RFC 5766 7.), with their permissions and channel
+bindings.
+
+- track() is called with the LIFETIME of an Allocate success response.
+- A Refresh is sent somewhere in [refreshAt, refreshAt + jitter] of the granted lifetime, the
+  exact point is random per allocation so a batch created together does not refresh together.
+- Peers added with addPeer() / bindChannel() go to the allocation's PermissionCache. Due
+  permissions are coalesced into one CreatePermission carrying several XOR-PEER-ADDRESS, and
+  renewed before expiry only if touch() reported traffic. A peer or channel the server keeps
+  refusing is dropped and reported to the PeerFailedHandler.
+- 438 (Stale Nonce) is retried with the NONCE carried by the error response.
+- releaseAll() sends Refresh with LIFETIME=0 for every allocation.
+
+All allocations share one seeker::AsioTimingWheel, so there is one asio timer no matter how
+many allocations are tracked. Every outstanding request lives in one TransactionTable.
+*/
+class AllocationManager {
+ public:
+  using AllocationId = uint32_t;
+
+  // transmit a ready-to-send STUN message for the allocation.
+  using Sender = std::function<void(AllocationId, const std::vector<uint8_t>&)>;
+
+  // allocation is gone. errorCode is the STUN error code, 408 on timeout, 0 after release.
+  using ClosedHandler = std::function<void(AllocationId, int errorCode)>;
+
+  // a permission (channel 0) or channel binding for peer was given up after errorCode.
+  using PeerFailedHandler = std::function<void(
+      AllocationId, const asio::ip::udp::endpoint& peer, uint16_t channel, int errorCode)>;
+
+  struct Options {
+    double refreshAt = 0.75;
+    double jitter = 0.15;
+    uint32_t retransmitMs = 500;
+    uint16_t maxAttempts = 5;
+    uint16_t maxStaleNonceRetries = 3;
+    size_t maxAllocations = 100000;
+    size_t maxTransactions = 200000;
+    PermissionCache::Options permissions;
+  };
+
+ private:
+  using TimerId = seeker::TimingWheel<int>::TimerId;
+
+  enum class State : uint8_t { idle, refreshing, releasing };
+
+  struct Allocation {
+    TurnCredentials credentials;
+    uint32_t lifetime = 0;
+    int64_t expireAt = 0;
+    State state = State::idle;
+    uint16_t staleNonceRetries = 0;
+    TimerId refreshTimer = 0;
+    TimerId permissionTimer = 0;
+    int64_t permissionTimerAt = INT64_MAX;
+    PermissionCache permissions;
+  };
+
+  // one outstanding request, the value of the transaction table.
+  struct Request {
+    AllocationId id = 0;
+    StunMethod method = StunMethod::Refresh;
+    uint32_t lifetime = 0;                        // Refresh
+    std::vector<asio::ip::udp::endpoint> peers;  // CreatePermission, ChannelBind
+    uint16_t channel = 0;                         // ChannelBind
+    std::vector<uint8_t> message;
+  };
+
+  struct TimerEvent {
+    enum Kind : uint8_t { refresh, permissions, retransmit };
+    Kind kind = refresh;
+    AllocationId id = 0;
+    TransactionKey key;
+  };
+
+  Options options;
+  Sender sender;
+  ClosedHandler closedHandler;
+  PeerFailedHandler peerFailedHandler;
+
+  AllocationId nextId = 1;
+  std::unordered_map<AllocationId, Allocation> allocations;
+  TransactionTable<Request> transactions;
+  seeker::AsioTimingWheel<TimerEvent> timers;
+
+  seeker::RandomIntGenerator transIdGenerator{INT_MIN, INT_MAX};
+  seeker::RandomIntGenerator jitterGenerator{0, 10000};
+
+
+  static int64_t nowMs() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+  }
+
+  TimerId schedule(TimerEvent::Kind kind, AllocationId id, int64_t delayMs,
+                   const TransactionKey& key = TransactionKey{}) {
+    TimerEvent event;
+    event.kind = kind;
+    event.id = id;
+    event.key = key;
+    return timers.schedule(std::chrono::milliseconds(std::max<int64_t>(0, delayMs)), event);
+  }
+
+  void scheduleRefresh(AllocationId id, Allocation& a) {
+    double fraction = options.refreshAt + options.jitter * jitterGenerator() / 10000.0;
+    a.expireAt = nowMs() + (int64_t)a.lifetime * 1000;
+    timers.cancel(a.refreshTimer);
+    a.refreshTimer = schedule(TimerEvent::refresh, id, (int64_t)(a.lifetime * 1000 * fraction));
+  }
+
+  void schedulePermissions(AllocationId id, Allocation& a) {
+    int64_t at = a.permissions.nextDueAt();
+    if (at == a.permissionTimerAt) {
+      return;
+    }
+    timers.cancel(a.permissionTimer);
+    a.permissionTimer = 0;
+    a.permissionTimerAt = at;
+    if (at != INT64_MAX) {
+      a.permissionTimer = schedule(TimerEvent::permissions, id, at - nowMs());
+    }
+  }
+
+  void onTimers(std::vector<TimerEvent>& expired) {
+    for (TimerEvent& event : expired) {
+      auto it = allocations.find(event.id);
+      if (it == allocations.end()) {
+        if (event.kind == TimerEvent::retransmit) {
+          // closed while the request was in flight, free its slot.
+          TransactionTable<Request>::Slot dropped;
+          transactions.take(event.key, dropped);
+        }
+        continue;
+      }
+      Allocation& a = it->second;
+
+      switch (event.kind) {
+        case TimerEvent::refresh:
+          a.refreshTimer = 0;
+          if (a.state == State::idle) {
+            startRefresh(event.id, a, a.lifetime, State::refreshing);
+          }
+          break;
+        case TimerEvent::permissions:
+          a.permissionTimer = 0;
+          a.permissionTimerAt = INT64_MAX;
+          flushPermissions(event.id, a);
+          break;
+        case TimerEvent::retransmit:
+          retransmit(event.id, a, event.key);
+          break;
+      }
+    }
+  }
+
+  std::vector<uint8_t> buildRequest(const Allocation& a, const Request& r,
+                                    uint32_t transId[3]) {
+    StunMessage message{};
+
+    for (int i = 0; i < 3; i++) {
+      transId[i] = (uint32_t)transIdGenerator();
+    }
+
+    message.setTransactionId(transId);
+    message.setMethod(r.method);
+    message.setClass(StunClass::request);
+
+    if (r.method == StunMethod::Refresh) {
+      message.setAttr_LIFETIME(r.lifetime);
+    } else if (r.method == StunMethod::ChannelBind) {
+      message.setAttr_CHANNEL_NUMBER(r.channel);
+    }
+    for (auto& peer : r.peers) {
+      message.setAttr_XOR_PEER_ADDRESS(peer);
+    }
+
+    const TurnCredentials& c = a.credentials;
+    if (!c.username.empty()) {
+      message.setAttr_USERNAME(c.username);
+      message.setPassword(c.password);
+      message.setAttr_REALM(c.realm);
+      message.setAttr_NONCE((uint8_t*)c.nonce.c_str(), c.nonce.size());
+      message.setMessageIntegrity(true);
+    }
+
+    message.setFingerprint(true);
+    return message.binary();
+  }
+
+  void startTransaction(AllocationId id, Allocation& a, Request request) {
+    uint32_t transId[3];
+    request.id = id;
+    request.message = buildRequest(a, request, transId);
+
+    TransactionKey key{transId};
+    auto slot = transactions.insert(key, std::move(request));
+    if (slot == nullptr) {
+      W_LOG("allocation {}: too many outstanding transactions.", id);
+      return;
+    }
+    slot->attempts = 1;
+    slot->rtoMs = (uint16_t)options.retransmitMs;
+    sender(id, slot->value.message);
+    schedule(TimerEvent::retransmit, id, slot->rtoMs, key);
+  }
+
+  void startRefresh(AllocationId id, Allocation& a, uint32_t lifetime, State state) {
+    a.state = state;
+    Request r;
+    r.method = StunMethod::Refresh;
+    r.lifetime = lifetime;
+    startTransaction(id, a, std::move(r));
+  }
+
+  void flushPermissions(AllocationId id, Allocation& a) {
+    int64_t now = nowMs();
+
+    Request r;
+    r.method = StunMethod::CreatePermission;
+    a.permissions.collectPermissions(now, r.peers);
+    if (!r.peers.empty()) {
+      D_LOG("allocation {}: CreatePermission for {} peers", id, r.peers.size());
+      startTransaction(id, a, std::move(r));
+    }
+
+    std::vector<std::pair<uint16_t, asio::ip::udp::endpoint>> channels;
+    a.permissions.collectChannels(now, channels);
+    for (auto& pair : channels) {
+      Request c;
+      c.method = StunMethod::ChannelBind;
+      c.channel = pair.first;
+      c.peers.push_back(pair.second);
+      startTransaction(id, a, std::move(c));
+    }
+
+    schedulePermissions(id, a);
+  }
+
+  void retransmit(AllocationId id, Allocation& a, const TransactionKey& key) {
+    auto slot = transactions.find(key);
+    if (slot == nullptr) {
+      return;  // answered
+    }
+
+    Request& r = slot->value;
+    bool refreshExpired = r.method == StunMethod::Refresh && a.state != State::releasing &&
+                          nowMs() >= a.expireAt;
+    if (slot->attempts < options.maxAttempts && !refreshExpired) {
+      slot->attempts++;
+      slot->rtoMs = (uint16_t)std::min<uint32_t>(slot->rtoMs * 2u, UINT16_MAX);
+      sender(id, r.message);
+      schedule(TimerEvent::retransmit, id, slot->rtoMs, key);
+      return;
+    }
+
+    W_LOG("allocation {}: request method={} timeout after {} attempts", id, (int)r.method,
+          slot->attempts);
+    TransactionTable<Request>::Slot timedOut;
+    transactions.take(key, timedOut);
+    onFailure(id, a, timedOut.value, 408);
+  }
+
+  void onSuccess(AllocationId id, Allocation& a, const Request& r, StunMessage& msg) {
+    a.staleNonceRetries = 0;
+    int64_t now = nowMs();
+
+    switch (r.method) {
+      case StunMethod::Refresh: {
+        if (a.state == State::releasing) {
+          close(id, 0);
+          return;
+        }
+        uint32_t lifetime = 0;
+        if (msg.getAttr_LIFETIME(lifetime)) {
+          a.lifetime = lifetime;
+        }
+        a.state = State::idle;
+        scheduleRefresh(id, a);
+        D_LOG("allocation {} refreshed, lifetime={}", id, a.lifetime);
+        break;
+      }
+      case StunMethod::CreatePermission: {
+        std::vector<asio::ip::udp::endpoint> dropped;  // stays empty on success
+        a.permissions.onPermissionResult(r.peers, 0, now, dropped);
+        schedulePermissions(id, a);
+        break;
+      }
+      case StunMethod::ChannelBind:
+        a.permissions.onChannelResult(r.channel, 0, now);
+        schedulePermissions(id, a);
+        break;
+      default:
+        break;
+    }
+  }
+
+  void onFailure(AllocationId id, Allocation& a, const Request& r, int code) {
+    int64_t now = nowMs();
+
+    switch (r.method) {
+      case StunMethod::Refresh:
+        W_LOG("allocation {} refresh failed, error={}", id, code);
+        close(id, code);
+        break;
+      case StunMethod::CreatePermission: {
+        W_LOG("allocation {} CreatePermission failed, error={}", id, code);
+        std::vector<asio::ip::udp::endpoint> dropped;
+        a.permissions.onPermissionResult(r.peers, code, now, dropped);
+        schedulePermissions(id, a);
+        for (auto& peer : dropped) {
+          peerFailed(id, peer, 0, code);
+        }
+        break;
+      }
+      case StunMethod::ChannelBind: {
+        W_LOG("allocation {} ChannelBind {} failed, error={}", id, r.channel, code);
+        bool dropped = a.permissions.onChannelResult(r.channel, code, now);
+        schedulePermissions(id, a);
+        if (dropped && !r.peers.empty()) {
+          peerFailed(id, r.peers[0], r.channel, code);
+        }
+        break;
+      }
+      default:
+        break;
+    }
+  }
+
+  void peerFailed(AllocationId id, const asio::ip::udp::endpoint& peer, uint16_t channel,
+                  int errorCode) {
+    W_LOG("allocation {}: gave up {} for {}:{}, error={}", id,
+          channel == 0 ? "permission" : "channel", peer.address().to_string(), peer.port(),
+          errorCode);
+    if (peerFailedHandler) {
+      peerFailedHandler(id, peer, channel, errorCode);
+    }
+  }
+
+  void close(AllocationId id, int errorCode) {
+    auto it = allocations.find(id);
+    if (it == allocations.end()) {
+      return;
+    }
+    // outstanding transactions of this allocation are dropped when they are answered or
+    // their next retransmit timer fires, either way they find no allocation.
+    timers.cancel(it->second.refreshTimer);
+    timers.cancel(it->second.permissionTimer);
+    allocations.erase(it);
+    if (closedHandler) {
+      closedHandler(id, errorCode);
+    }
+  }
+
+
+ public:
+  AllocationManager(asio::io_context& ioContext, Sender sender_, ClosedHandler closedHandler_,
+                    const Options& options_)
+      : options(options_),
+        sender(std::move(sender_)),
+        closedHandler(std::move(closedHandler_)),
+        transactions(options_.maxTransactions),
+        timers(ioContext, std::chrono::milliseconds(10),
+               [this](std::vector<TimerEvent>& expired) { onTimers(expired); }) {}
+
+  AllocationManager(asio::io_context& ioContext, Sender sender_, ClosedHandler closedHandler_)
+      : AllocationManager(ioContext, std::move(sender_), std::move(closedHandler_), Options()) {}
+
+  AllocationManager(const AllocationManager&) = delete;
+  AllocationManager& operator=(const AllocationManager&) = delete;
+
+  void setPeerFailedHandler(PeerFailedHandler handler) {
+    peerFailedHandler = std::move(handler);
+  }
+
+
+  // start tracking an allocation after Allocate success. lifetime in seconds, from LIFETIME.
+  AllocationId track(uint32_t lifetime, const TurnCredentials& credentials) {
+    if (allocations.size() >= options.maxAllocations) {
+      throw std::runtime_error("too many allocations.");
+    }
+    AllocationId id = nextId++;
+    Allocation& a = allocations[id];
+    a.credentials = credentials;
+    a.lifetime = lifetime;
+    a.permissions = PermissionCache(options.permissions);
+    scheduleRefresh(id, a);
+    return id;
+  }
+
+  // feed every Refresh / CreatePermission / ChannelBind response here.
+  // Return false if msg is not one of ours.
+  bool onResponse(StunMessage& msg) {
+    StunMethod method = msg.getMethod();
+    if (method != StunMethod::Refresh && method != StunMethod::CreatePermission &&
+        method != StunMethod::ChannelBind) {
+      return false;
+    }
+
+    TransactionTable<Request>::Slot slot;
+    if (!transactions.take(TransactionKey{msg.getTransactionId()}, slot)) {
+      return false;
+    }
+
+    Request& r = slot.value;
+    AllocationId id = r.id;
+    auto it = allocations.find(id);
+    if (it == allocations.end()) {
+      return true;
+    }
+    Allocation& a = it->second;
+
+    if (msg.getClass() == StunClass::successResponse) {
+      onSuccess(id, a, r, msg);
+      return true;
+    }
+
+    int code = msg.getAttr_ERROR_CODE();
+    string nonce = msg.getAttr_NONCE();
+    if ((code == 438 || code == 401) && !nonce.empty() &&
+        a.staleNonceRetries < options.maxStaleNonceRetries) {
+      a.staleNonceRetries++;
+      a.credentials.nonce = nonce;
+      string realm = msg.getAttr_REALM();
+      if (!realm.empty()) {
+        a.credentials.realm = realm;
+      }
+      D_LOG("allocation {} got {}, retry with new nonce", id, code);
+      startTransaction(id, a, std::move(r));
+      return true;
+    }
+
+    onFailure(id, a, r, code);
+    return true;
+  }
+
+  // want to send to peer: a permission is requested with the next coalesced CreatePermission.
+  void addPeer(AllocationId id, const asio::ip::udp::endpoint& peer) {
+    auto it = allocations.find(id);
+    if (it != allocations.end()) {
+      it->second.permissions.addPeer(peer, nowMs());
+      schedulePermissions(id, it->second);
+    }
+  }
+
+  // channel number for peer, 0 if the allocation is unknown or out of channel numbers.
+  uint16_t bindChannel(AllocationId id, const asio::ip::udp::endpoint& peer) {
+    auto it = allocations.find(id);
+    if (it == allocations.end()) {
+      return 0;
+    }
+    uint16_t ch = it->second.permissions.bindChannel(peer, nowMs());
+    schedulePermissions(id, it->second);
+    return ch;
+  }
+
+  // report traffic with peer, active permissions and channels get renewed before expiry.
+  void touch(AllocationId id, const asio::ip::udp::endpoint& peer) {
+    auto it = allocations.find(id);
+    if (it != allocations.end() && it->second.permissions.touch(peer, nowMs())) {
+      schedulePermissions(id, it->second);
+    }
+  }
+
+  const PermissionCache* permissions(AllocationId id) const {
+    auto it = allocations.find(id);
+    return it == allocations.end() ? nullptr : &it->second.permissions;
+  }
+
+  // delete one allocation on the server, LIFETIME=0.
+  void release(AllocationId id) {
+    auto it = allocations.find(id);
+    if (it != allocations.end() && it->second.state != State::releasing) {
+      startRefresh(id, it->second, 0, State::releasing);
+    }
+  }
+
+  // on shutdown: release everything, then run the io_context until pending() is 0.
+  void releaseAll() {
+    for (auto& pair : allocations) {
+      if (pair.second.state != State::releasing) {
+        startRefresh(pair.first, pair.second, 0, State::releasing);
+      }
+    }
+  }
+
+  size_t pending() const { return allocations.size(); }
+
+  const TurnCredentials* credentials(AllocationId id) const {
+    auto it = allocations.find(id);
+    return it == allocations.end() ? nullptr : &it->second.credentials;
+  }
+};
+
+
+}  // namespace HelloCoturn
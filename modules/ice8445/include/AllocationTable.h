@@ -0,0 +1,283 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "seeker/common.h"
+#include "PermissionCache.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define HELLO_COTURN_SWEEP_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HELLO_COTURN_SWEEP_SSE2 1
+#endif
+
+
+namespace HelloCoturn {
+
+class BatchedUdpSocket;
+
+
+/*
+Server side allocation table, split by access pattern.
+
+  records [capacity]   hot: one 64-byte, cache-line aligned Record per allocation, all the
+                       relay path reads or writes for a packet (key, channel table, relayed
+                       socket, byte counters).
+  expiry  [capacity]   expiry of each slot as int32 seconds since the table epoch, a separate
+                       array so the sweep streams 4 bytes per allocation through SIMD compares
+                       and never loads a Record or the cold state.
+  index   [2^k]        open addressing client key -> slot, linear probing, backward shift
+                       deletion as in TransactionTable.
+  cold    [capacity]   Cold state (sockets, credentials, ...) allocated per live allocation.
+
+Memory budget: the table itself costs at most 96 bytes per slot (64 record + 4 expiry +
+up to 16 index + 8 cold pointer), allocated once for `capacity` slots. Everything else is in
+Cold and is accounted by its owner.
+*/
+template <typename Cold, typename Channels>
+class AllocationTable {
+ public:
+  static constexpr size_t budgetBytesPerSlot = 96;
+  static constexpr uint32_t npos = UINT32_MAX;
+
+  struct alignas(64) Record {
+    uint64_t clientHash = 0;
+    PeerKey client;  // client 5-tuple on the listening side: address, port and transport
+    uint32_t slot = npos;
+    Channels* channels = nullptr;
+    BatchedUdpSocket* relay = nullptr;
+    uint64_t toPeerBytes = 0;
+    uint64_t toClientBytes = 0;
+  };
+  static_assert(sizeof(Record) == 64, "Record must fit one cache line.");
+
+ private:
+  static constexpr int32_t never = INT32_MAX;
+
+  size_t capacity;
+  size_t indexMask;
+  int64_t epochMs;
+  size_t count = 0;
+  size_t highWater = 0;  // slots >= highWater were never used
+
+  std::unique_ptr<Record[]> records;
+  std::unique_ptr<int32_t[]> expiry;
+  std::unique_ptr<uint32_t[]> index;  // slot + 1, 0 = empty
+  std::vector<std::unique_ptr<Cold>> cold;
+  std::vector<uint32_t> freeSlots;
+
+  std::vector<uint32_t> expired;
+
+
+  int32_t toSeconds(int64_t ms) const {
+    int64_t s = (ms - epochMs + 999) / 1000;
+    return s >= never ? never - 1 : (int32_t)(s < 0 ? 0 : s);
+  }
+
+  size_t home(uint64_t hash) const { return (size_t)(hash ^ (hash >> 29)) & indexMask; }
+
+  // index position of key, or npos.
+  size_t findPos(const PeerKey& key, uint64_t hash) const {
+    for (size_t pos = home(hash);; pos = (pos + 1) & indexMask) {
+      uint32_t v = index[pos];
+      if (v == 0) {
+        return npos;
+      }
+      const Record& r = records[v - 1];
+      if (r.clientHash == hash && r.client == key) {
+        return pos;
+      }
+    }
+  }
+
+  void erasePos(size_t i) {
+    size_t j = i;
+    for (;;) {
+      j = (j + 1) & indexMask;
+      if (index[j] == 0) {
+        break;
+      }
+      size_t h = home(records[index[j] - 1].clientHash);
+      bool homeInRange = i <= j ? (i < h && h <= j) : (i < h || h <= j);
+      if (!homeInRange) {
+        index[i] = index[j];
+        i = j;
+      }
+    }
+    index[i] = 0;
+  }
+
+  // slots in [from, to) with expiry <= now, appended to `expired`.
+  void scan(size_t from, size_t to, int32_t now) {
+    size_t i = from;
+#if defined(HELLO_COTURN_SWEEP_AVX2)
+    const __m256i nowv = _mm256_set1_epi32(now);
+    for (; i + 8 <= to; i += 8) {
+      __m256i e = _mm256_loadu_si256((const __m256i*)(expiry.get() + i));
+      // live if expiry > now
+      __m256i alive = _mm256_cmpgt_epi32(e, nowv);
+      unsigned live = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(alive));
+      unsigned dead = ~live & 0xFFu;
+      while (dead) {
+        expired.push_back((uint32_t)(i + seeker::Bits::lowest(dead)));
+        dead &= dead - 1;
+      }
+    }
+#elif defined(HELLO_COTURN_SWEEP_SSE2)
+    const __m128i nowv = _mm_set1_epi32(now);
+    for (; i + 4 <= to; i += 4) {
+      __m128i e = _mm_loadu_si128((const __m128i*)(expiry.get() + i));
+      // live if expiry > now
+      unsigned live = (unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(e, nowv)));
+      unsigned dead = ~live & 0xFu;
+      for (unsigned k = 0; k < 4; k++) {
+        if (dead & (1u << k)) {
+          expired.push_back((uint32_t)(i + k));
+        }
+      }
+    }
+#endif
+    for (; i < to; i++) {
+      if (expiry[i] <= now) {
+        expired.push_back((uint32_t)i);
+      }
+    }
+  }
+
+
+ public:
+  // capacity: most allocations ever live at once. epochMs: origin of the expiry clock.
+  AllocationTable(size_t capacity_, int64_t epochMs_)
+      : capacity(capacity_), epochMs(epochMs_) {
+    if (capacity == 0 || capacity >= npos / 2) {
+      throw std::runtime_error("invalid allocation table capacity.");
+    }
+    size_t indexSize = 16;
+    while (indexSize < capacity * 2) {
+      indexSize <<= 1;
+    }
+    indexMask = indexSize - 1;
+
+    records.reset(new Record[capacity]);
+    expiry.reset(new int32_t[capacity]);
+    index.reset(new uint32_t[indexSize]);
+    std::fill(expiry.get(), expiry.get() + capacity, never);
+    std::memset(index.get(), 0, indexSize * sizeof(uint32_t));
+    cold.resize(capacity);
+    freeSlots.reserve(capacity);
+  }
+
+  AllocationTable(const AllocationTable&) = delete;
+  AllocationTable& operator=(const AllocationTable&) = delete;
+
+  Record* find(const PeerKey& key) {
+    uint64_t hash = PeerKeyHash()(key);
+    size_t pos = findPos(key, hash);
+    return pos == npos ? nullptr : &records[index[pos] - 1];
+  }
+
+  // return nullptr if the key exists or the table is full.
+  Record* insert(const PeerKey& key, std::unique_ptr<Cold> state, int64_t expireAtMs) {
+    uint64_t hash = PeerKeyHash()(key);
+    if (count >= capacity || findPos(key, hash) != npos) {
+      return nullptr;
+    }
+    uint32_t slot;
+    if (!freeSlots.empty()) {
+      slot = freeSlots.back();
+      freeSlots.pop_back();
+    } else {
+      slot = (uint32_t)highWater++;
+    }
+
+    Record& r = records[slot];
+    r = Record();
+    r.clientHash = hash;
+    r.client = key;
+    r.slot = slot;
+    expiry[slot] = toSeconds(expireAtMs);
+    cold[slot] = std::move(state);
+
+    size_t pos = home(hash);
+    while (index[pos] != 0) {
+      pos = (pos + 1) & indexMask;
+    }
+    index[pos] = slot + 1;
+    count++;
+    return &r;
+  }
+
+  void erase(Record& r) {
+    uint32_t slot = r.slot;
+    size_t pos = findPos(r.client, r.clientHash);
+    if (pos != npos) {
+      erasePos(pos);
+    }
+    expiry[slot] = never;
+    cold[slot].reset();
+    r = Record();
+    freeSlots.push_back(slot);
+    count--;
+  }
+
+  Cold& state(const Record& r) { return *cold[r.slot]; }
+
+  void setExpiry(const Record& r, int64_t expireAtMs) {
+    expiry[r.slot] = toSeconds(expireAtMs);
+  }
+
+  int64_t expiryOf(const Record& r) const { return epochMs + (int64_t)expiry[r.slot] * 1000; }
+
+  // erase every allocation whose expiry is at or before now, after calling onExpired on it.
+  template <typename F>
+  size_t sweep(int64_t nowMs, F&& onExpired) {
+    expired.clear();
+    scan(0, highWater, (int32_t)((nowMs - epochMs) / 1000));
+    for (uint32_t slot : expired) {
+      Record& r = records[slot];
+      onExpired(r, *cold[slot]);
+      erase(r);
+    }
+    size_t n = expired.size();
+    expired.clear();
+    return n;
+  }
+
+  // visit every live allocation. Do not insert or erase from within fn.
+  template <typename F>
+  void forEach(F&& fn) {
+    for (size_t i = 0; i < highWater; i++) {
+      if (cold[i]) {
+        fn(records[i], *cold[i]);
+      }
+    }
+  }
+
+  void clear() {
+    expired.clear();
+    forEach([this](Record& r, Cold&) { expired.push_back(r.slot); });
+    for (uint32_t slot : expired) {
+      erase(records[slot]);
+    }
+    expired.clear();
+  }
+
+  size_t size() const { return count; }
+  size_t maxSize() const { return capacity; }
+
+  // memory held by the table structures, Cold excluded.
+  size_t memoryBytes() const {
+    return sizeof(*this) + capacity * (sizeof(Record) + sizeof(int32_t) + sizeof(void*)) +
+           (indexMask + 1) * sizeof(uint32_t) + freeSlots.capacity() * sizeof(uint32_t);
+  }
+};
+
+
+}  // namespace HelloCoturn
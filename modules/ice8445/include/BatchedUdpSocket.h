@@ -0,0 +1,643 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "asio.hpp"
+#include "seeker/loggerApi.h"
+
+#if defined(__linux__)
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#define HELLO_COTURN_MMSG 1
+// older libc headers lack these, the kernel support is probed at runtime.
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#endif
+
+
+namespace HelloCoturn {
+
+
+/*
+UDP socket that moves datagrams in batches.
+
+asio is only used for readiness: async_wait(wait_read / wait_write) on the reactor. Once the
+socket is readable, it is drained with recvmmsg() up to `batch` datagrams per syscall, into
+buffers and mmsghdr arrays allocated once in the constructor. Outgoing datagrams go through
+a send ring and leave with sendmmsg(); the ring is flushed when a batch is full and once per
+event loop turn, so datagrams produced while handling one receive batch share syscalls.
+
+Queued datagrams are normally copied into their ring slot: send() and queueGather() return
+with the caller's buffer free, which lets datagrams from many receive batches (of many
+sockets) wait for one flush. That copy is the deliberate price of batching across sources.
+sendRef() skips it: the slot points at the caller's buffer, which must stay untouched until
+settle(). settle() flushes, and copies only what the kernel did not take because the socket
+was full, so a relayed payload is copied in user space only under backpressure.
+
+Segmentation offload (Linux 4.18+ for UDP_SEGMENT, 5.0+ for UDP_GRO):
+- GSO is used whenever the kernel supports it. Consecutive queued datagrams for the same
+  destination with the same size (the last one may be shorter) are sent as one message with
+  a UDP_SEGMENT control message, the kernel or NIC cuts it back into datagrams. A run of
+  relayed RTP packets to one peer then costs one pass through the stack.
+- GRO is opt-in (enableGro()) because every receive buffer must then hold 64 KB. Coalesced
+  messages are split back into the original datagrams before the handler sees them.
+
+Platforms without recvmmsg/sendmmsg fall back to one receive_from/send_to per datagram.
+*/
+class BatchedUdpSocket {
+ public:
+  struct Datagram {
+    uint8_t* data;
+    size_t size;
+    asio::ip::udp::endpoint endpoint;
+  };
+
+  // one call per drained batch. Datagram buffers are reused once the handler returns.
+  using ReceiveHandler = std::function<void(Datagram* batch, size_t count)>;
+
+  struct Stats {
+    uint64_t recvCalls = 0;
+    uint64_t recvDatagrams = 0;
+    uint64_t sendCalls = 0;
+    uint64_t sendDatagrams = 0;
+    uint64_t sendDrops = 0;
+    uint64_t settleCopies = 0;  // sendRef() payloads copied by settle(), socket was full
+    uint64_t gsoMessages = 0;  // sent messages carrying more than one datagram
+    uint64_t groMessages = 0;  // received messages carrying more than one datagram
+  };
+
+  // kernel limits of one GSO message (UDP_MAX_SEGMENTS) and of one coalesced receive.
+  static constexpr size_t maxSegments = 64;
+  static constexpr size_t maxOffloadBytes = 65000;
+  static constexpr size_t groBufferSize = 65535;
+
+ private:
+  struct SendSlot {
+    std::vector<uint8_t> buffer;
+    size_t size = 0;
+    const uint8_t* ref = nullptr;  // the caller's buffer, sendRef()
+    asio::ip::udp::endpoint endpoint;
+
+    const uint8_t* data() const { return ref != nullptr ? ref : buffer.data(); }
+  };
+
+  asio::io_context& ioContext;
+  asio::ip::udp::socket sock;
+  const size_t batch;
+  const size_t bufferSize;
+
+  // receive side, one buffer per message of a batch.
+  std::vector<uint8_t> recvBuffers;
+  std::vector<Datagram> received;
+  size_t receivedCount = 0;
+
+  // send ring.
+  std::vector<SendSlot> ring;
+  size_t ringHead = 0;
+  size_t ringCount = 0;
+  size_t refCount = 0;  // queued slots pointing at a caller's buffer
+  bool flushPosted = false;
+  bool waitingWritable = false;
+
+  bool gsoEnabled = false;
+  bool groEnabled = false;
+
+#ifdef HELLO_COTURN_MMSG
+  static constexpr size_t recvCtrlSize = CMSG_SPACE(sizeof(int));
+  static constexpr size_t sendCtrlSize = CMSG_SPACE(sizeof(uint16_t));
+
+  std::vector<mmsghdr> recvHdrs;
+  std::vector<iovec> recvIov;
+  std::vector<sockaddr_storage> recvAddrs;
+  std::vector<uint8_t> recvCtrl;
+
+  // one iovec per ring slot, a message points at a run of them.
+  std::vector<mmsghdr> sendHdrs;
+  std::vector<iovec> sendIov;
+  std::vector<uint8_t> sendCtrl;
+  std::vector<size_t> sendSegments;
+#endif
+
+  ReceiveHandler receiveHandler;
+  Stats stats;
+
+  // handlers already queued when the socket is destroyed see it expired and do nothing.
+  std::shared_ptr<int> alive = std::make_shared<int>(0);
+
+
+  void init() {
+    sock.non_blocking(true);
+    ring.resize(batch * 4);
+    for (auto& slot : ring) {
+      slot.buffer.resize(bufferSize);
+    }
+
+#ifdef HELLO_COTURN_MMSG
+    recvHdrs.resize(batch);
+    recvIov.resize(batch);
+    recvAddrs.resize(batch);
+    recvCtrl.resize(batch * recvCtrlSize);
+    sendHdrs.resize(batch);
+    sendIov.resize(batch);
+    sendCtrl.resize(batch * sendCtrlSize);
+    sendSegments.resize(batch);
+
+    int value = 0;
+    socklen_t len = sizeof(value);
+    gsoEnabled = ::getsockopt(sock.native_handle(), SOL_UDP, UDP_SEGMENT, &value, &len) == 0;
+#endif
+    allocReceiveBuffers(bufferSize);
+  }
+
+  void allocReceiveBuffers(size_t size) {
+    recvBuffers.assign(batch * size, 0);
+    received.resize(groEnabled ? batch * maxSegments : batch);
+#ifdef HELLO_COTURN_MMSG
+    for (size_t i = 0; i < batch; i++) {
+      recvIov[i].iov_base = recvBuffers.data() + i * size;
+      recvIov[i].iov_len = size;
+    }
+#endif
+  }
+
+  void waitReadable() {
+    std::weak_ptr<int> guard = alive;
+    auto onReady = [this, guard](const asio::error_code& ec) {
+      if (guard.expired()) {
+        return;
+      }
+      if (ec) {
+        if (ec != asio::error::operation_aborted) {
+          E_LOG("BatchedUdpSocket wait_read error: {}", ec.message());
+        }
+        return;
+      }
+      drain();
+      waitReadable();
+    };
+    sock.async_wait(asio::ip::udp::socket::wait_read, onReady);
+  }
+
+  // read until the socket would block, or a few full batches to stay fair to other handlers.
+  void drain() {
+    for (int round = 0; round < 8; round++) {
+      size_t n = receiveBatch();
+      if (receivedCount > 0) {
+        receiveHandler(received.data(), receivedCount);
+      }
+      if (n < batch) {
+        break;
+      }
+    }
+  }
+
+#ifdef HELLO_COTURN_MMSG
+  // segment size of a GRO coalesced message, 0 if it holds a single datagram.
+  static size_t groSegmentSize(msghdr& hdr) {
+    for (cmsghdr* c = CMSG_FIRSTHDR(&hdr); c != nullptr; c = CMSG_NXTHDR(&hdr, c)) {
+      if (c->cmsg_level == SOL_UDP && c->cmsg_type == UDP_GRO) {
+        int size = 0;
+        std::memcpy(&size, CMSG_DATA(c), sizeof(size));
+        return size > 0 ? (size_t)size : 0;
+      }
+    }
+    return 0;
+  }
+
+  // return the number of messages read, received[0, receivedCount) holds the datagrams.
+  size_t receiveBatch() {
+    for (size_t i = 0; i < batch; i++) {
+      msghdr& hdr = recvHdrs[i].msg_hdr;
+      std::memset(&hdr, 0, sizeof(msghdr));
+      hdr.msg_iov = &recvIov[i];
+      hdr.msg_iovlen = 1;
+      hdr.msg_name = &recvAddrs[i];
+      hdr.msg_namelen = sizeof(sockaddr_storage);
+      if (groEnabled) {
+        hdr.msg_control = recvCtrl.data() + i * recvCtrlSize;
+        hdr.msg_controllen = recvCtrlSize;
+      }
+    }
+
+    receivedCount = 0;
+    int n = ::recvmmsg(sock.native_handle(), recvHdrs.data(), (unsigned)batch, MSG_DONTWAIT,
+                       nullptr);
+    stats.recvCalls++;
+    if (n <= 0) {
+      if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        W_LOG("recvmmsg error: {}", std::strerror(errno));
+      }
+      return 0;
+    }
+
+    for (int i = 0; i < n; i++) {
+      asio::ip::udp::endpoint from;
+      size_t nameLen = recvHdrs[i].msg_hdr.msg_namelen;
+      std::memcpy(from.data(), &recvAddrs[i], std::min(nameLen, from.capacity()));
+
+      uint8_t* data = (uint8_t*)recvIov[i].iov_base;
+      size_t len = recvHdrs[i].msg_len;
+      size_t segment = groEnabled ? groSegmentSize(recvHdrs[i].msg_hdr) : 0;
+      if (segment == 0 || segment >= len) {
+        segment = len;
+      } else {
+        stats.groMessages++;
+      }
+
+      size_t offset = 0;
+      do {
+        if (receivedCount == received.size()) {
+          received.resize(received.size() * 2);
+        }
+        Datagram& d = received[receivedCount++];
+        d.data = data + offset;
+        d.size = std::min(segment, len - offset);
+        d.endpoint = from;
+        offset += segment;
+      } while (offset < len);
+    }
+    stats.recvDatagrams += receivedCount;
+    return (size_t)n;
+  }
+
+  // how many ring slots from `first` on can share one GSO message, at most `limit`.
+  size_t segmentRun(size_t first, size_t limit) const {
+    const SendSlot& head = ring[first];
+    if (!gsoEnabled || head.size == 0) {
+      return 1;
+    }
+    size_t count = 1;
+    size_t bytes = head.size;
+    limit = std::min(limit, maxSegments);
+    while (count < limit) {
+      const SendSlot& slot = ring[first + count];
+      if (slot.size == 0 || slot.size > head.size || bytes + slot.size > maxOffloadBytes ||
+          slot.endpoint != head.endpoint) {
+        break;
+      }
+      bytes += slot.size;
+      count++;
+      if (slot.size < head.size) {
+        break;  // only the last segment may be short.
+      }
+    }
+    return count;
+  }
+
+  // send up to one batch from the ring head, return how many left, -1 if the socket is full.
+  int sendBatch() {
+    size_t n = std::min(std::min(ringCount, ring.size() - ringHead), batch);
+    size_t messages = 0;
+    for (size_t i = 0; i < n;) {
+      size_t segments = segmentRun(ringHead + i, n - i);
+      for (size_t k = 0; k < segments; k++) {
+        SendSlot& slot = ring[ringHead + i + k];
+        sendIov[i + k].iov_base = (void*)slot.data();
+        sendIov[i + k].iov_len = slot.size;
+      }
+
+      SendSlot& head = ring[ringHead + i];
+      msghdr& hdr = sendHdrs[messages].msg_hdr;
+      std::memset(&hdr, 0, sizeof(msghdr));
+      hdr.msg_iov = &sendIov[i];
+      hdr.msg_iovlen = segments;
+      hdr.msg_name = head.endpoint.data();
+      hdr.msg_namelen = (socklen_t)head.endpoint.size();
+      if (segments > 1) {
+        uint8_t* ctrl = sendCtrl.data() + messages * sendCtrlSize;
+        std::memset(ctrl, 0, sendCtrlSize);
+        hdr.msg_control = ctrl;
+        hdr.msg_controllen = sendCtrlSize;
+        cmsghdr* c = CMSG_FIRSTHDR(&hdr);
+        c->cmsg_level = SOL_UDP;
+        c->cmsg_type = UDP_SEGMENT;
+        c->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        uint16_t segmentSize = (uint16_t)head.size;
+        std::memcpy(CMSG_DATA(c), &segmentSize, sizeof(segmentSize));
+      }
+      sendSegments[messages++] = segments;
+      i += segments;
+    }
+
+    int sent = ::sendmmsg(sock.native_handle(), sendHdrs.data(), (unsigned)messages,
+                          MSG_DONTWAIT);
+    stats.sendCalls++;
+    size_t done = 0;
+    if (sent < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return -1;
+      }
+      if (sendSegments[0] > 1 && (errno == EIO || errno == EINVAL)) {
+        // no checksum offload on the route's device, or segment above its MTU.
+        W_LOG("UDP GSO refused ({}), disabled for this socket", std::strerror(errno));
+        gsoEnabled = false;
+        return (int)ringCount;
+      }
+      // the head message is refused (e.g. unreachable destination), drop it and go on.
+      W_LOG("sendmmsg error: {}", std::strerror(errno));
+      done = sendSegments[0];
+      stats.sendDrops += done;
+    } else {
+      for (int m = 0; m < sent; m++) {
+        done += sendSegments[m];
+        stats.gsoMessages += sendSegments[m] > 1 ? 1 : 0;
+      }
+      stats.sendDatagrams += done;
+    }
+    release(done);
+    return (int)ringCount;
+  }
+#else
+  size_t receiveBatch() {
+    size_t n = 0;
+    asio::error_code ec;
+    while (n < batch) {
+      Datagram& d = received[n];
+      d.data = recvBuffers.data() + n * bufferSize;
+      d.size = sock.receive_from(asio::buffer(d.data, bufferSize), d.endpoint, 0, ec);
+      stats.recvCalls++;
+      if (ec) {
+        break;
+      }
+      n++;
+    }
+    receivedCount = n;
+    stats.recvDatagrams += n;
+    return n;
+  }
+
+  int sendBatch() {
+    SendSlot& slot = ring[ringHead];
+    asio::error_code ec;
+    sock.send_to(asio::buffer(slot.data(), slot.size), slot.endpoint, 0, ec);
+    stats.sendCalls++;
+    if (ec == asio::error::would_block) {
+      return -1;
+    }
+    if (ec) {
+      stats.sendDrops++;
+    } else {
+      stats.sendDatagrams++;
+    }
+    release(1);
+    return (int)ringCount;
+  }
+#endif
+
+  // the first `count` queued datagrams left (or were dropped).
+  void release(size_t count) {
+    for (size_t i = 0; i < count && refCount > 0; i++) {
+      SendSlot& slot = ring[(ringHead + i) % ring.size()];
+      if (slot.ref != nullptr) {
+        slot.ref = nullptr;
+        refCount--;
+      }
+    }
+    ringHead = (ringHead + count) % ring.size();
+    ringCount -= count;
+  }
+
+  void waitWritable() {
+    if (waitingWritable) {
+      return;
+    }
+    waitingWritable = true;
+    std::weak_ptr<int> guard = alive;
+    auto onReady = [this, guard](const asio::error_code& ec) {
+      if (guard.expired()) {
+        return;
+      }
+      waitingWritable = false;
+      if (!ec) {
+        flush();
+      }
+    };
+    sock.async_wait(asio::ip::udp::socket::wait_write, onReady);
+  }
+
+  SendSlot* reserveSlot(size_t size) {
+    if (size > bufferSize) {
+      stats.sendDrops++;
+      return nullptr;
+    }
+    if (ringCount == ring.size()) {
+      flush();
+      if (ringCount == ring.size()) {
+        stats.sendDrops++;
+        return nullptr;
+      }
+    }
+    return &ring[(ringHead + ringCount) % ring.size()];
+  }
+
+  void commitSlot(SendSlot& slot, size_t size, const asio::ip::udp::endpoint& to) {
+    slot.size = size;
+    slot.endpoint = to;
+    ringCount++;
+    if (ringCount >= batch) {
+      flush();
+    } else {
+      postFlush();
+    }
+  }
+
+  void postFlush() {
+    if (flushPosted) {
+      return;
+    }
+    flushPosted = true;
+    std::weak_ptr<int> guard = alive;
+    asio::post(ioContext, [this, guard]() {
+      if (guard.expired()) {
+        return;
+      }
+      flushPosted = false;
+      flush();
+    });
+  }
+
+
+ public:
+  BatchedUdpSocket(asio::io_context& ioContext_, const asio::ip::udp::endpoint& local,
+                   size_t batch_ = 64, size_t bufferSize_ = 2048)
+      : ioContext(ioContext_),
+        sock(ioContext_, local),
+        batch(batch_),
+        bufferSize(bufferSize_) {
+    init();
+  }
+
+  // adopt a socket that is already open and bound, e.g. with SO_REUSEPORT set before bind.
+  BatchedUdpSocket(asio::io_context& ioContext_, asio::ip::udp::socket&& socket_,
+                   size_t batch_ = 64, size_t bufferSize_ = 2048)
+      : ioContext(ioContext_),
+        sock(std::move(socket_)),
+        batch(batch_),
+        bufferSize(bufferSize_) {
+    init();
+  }
+
+  BatchedUdpSocket(const BatchedUdpSocket&) = delete;
+  BatchedUdpSocket& operator=(const BatchedUdpSocket&) = delete;
+
+  asio::ip::udp::socket& socket() { return sock; }
+
+  // turn on receive coalescing, call before startReceive(). Return false if not supported.
+  bool enableGro() {
+#ifdef HELLO_COTURN_MMSG
+    if (!groEnabled) {
+      int on = 1;
+      if (::setsockopt(sock.native_handle(), SOL_UDP, UDP_GRO, &on, sizeof(on)) != 0) {
+        return false;
+      }
+      groEnabled = true;
+      allocReceiveBuffers(groBufferSize);
+    }
+#endif
+    return groEnabled;
+  }
+
+  // GSO is on by default where the kernel has it, this turns it off (e.g. for measurements).
+  void disableGso() { gsoEnabled = false; }
+
+  bool gso() const { return gsoEnabled; }
+  bool gro() const { return groEnabled; }
+
+  void startReceive(ReceiveHandler handler) {
+    receiveHandler = std::move(handler);
+    waitReadable();
+  }
+
+  // queue one datagram. Return false if it was dropped: too big, or the ring is full and the
+  // socket is not writable.
+  bool send(const uint8_t* data, size_t size, const asio::ip::udp::endpoint& to) {
+    SendSlot* slot = reserveSlot(size);
+    if (slot == nullptr) {
+      return false;
+    }
+    std::memcpy(slot->buffer.data(), data, size);
+    commitSlot(*slot, size, to);
+    return true;
+  }
+
+  /*
+  queue one datagram without copying it: data is referenced until it is sent, the caller
+  must keep it unchanged until settle() returns. Return false if it was dropped.
+  */
+  bool sendRef(const uint8_t* data, size_t size, const asio::ip::udp::endpoint& to) {
+    SendSlot* slot = reserveSlot(size);
+    if (slot == nullptr) {
+      return false;
+    }
+    slot->ref = data;
+    refCount++;
+    commitSlot(*slot, size, to);
+    return true;
+  }
+
+  /*
+  flush, then copy into the ring whatever sendRef() data is still queued (the socket is
+  full), so the callers' buffers may be reused.
+  */
+  void settle() {
+    if (refCount == 0) {
+      return;
+    }
+    flush();
+    for (size_t i = 0; i < ringCount && refCount > 0; i++) {
+      SendSlot& slot = ring[(ringHead + i) % ring.size()];
+      if (slot.ref != nullptr) {
+        std::memcpy(slot.buffer.data(), slot.ref, slot.size);
+        slot.ref = nullptr;
+        refCount--;
+        stats.settleCopies++;
+      }
+    }
+  }
+
+  // true while sendRef() data is queued, settle() is due.
+  bool holdsReferences() const { return refCount > 0; }
+
+  /*
+  send one datagram made of several buffers (e.g. RelayFrame::buffers()) right away with a
+  single sendmsg(), the pieces are not copied. Only if datagrams are already queued (order
+  must be kept) or the socket would block, the pieces are gathered into the send ring.
+  */
+  template <typename ConstBufferSequence>
+  bool sendGather(const ConstBufferSequence& buffers, const asio::ip::udp::endpoint& to) {
+    if (ringCount == 0) {
+      asio::error_code ec;
+      sock.send_to(buffers, to, 0, ec);
+      stats.sendCalls++;
+      if (!ec) {
+        stats.sendDatagrams++;
+        return true;
+      }
+      if (ec != asio::error::would_block) {
+        stats.sendDrops++;
+        return false;
+      }
+    }
+    return queueGather(buffers, to);
+  }
+
+  // gather the pieces into the send ring: one copy, but the datagram then shares sendmmsg()
+  // calls and GSO with the rest of the batch, across receive batches and sockets. The relay
+  // path prefers this to sendGather() towards clients, all allocations share that socket.
+  template <typename ConstBufferSequence>
+  bool queueGather(const ConstBufferSequence& buffers, const asio::ip::udp::endpoint& to) {
+    size_t size = asio::buffer_size(buffers);
+    SendSlot* slot = reserveSlot(size);
+    if (slot == nullptr) {
+      return false;
+    }
+    asio::buffer_copy(asio::buffer(slot->buffer.data(), size), buffers);
+    commitSlot(*slot, size, to);
+    return true;
+  }
+
+  // push queued datagrams to the kernel now.
+  void flush() {
+    while (ringCount > 0) {
+      if (sendBatch() < 0) {
+        waitWritable();
+        return;
+      }
+    }
+  }
+
+  size_t queued() const { return ringCount; }
+  const Stats& statistics() const { return stats; }
+
+  // user space memory held by this socket: receive buffers, send ring and batch headers.
+  size_t memoryBytes() const {
+    size_t rst = sizeof(*this) + recvBuffers.capacity() +
+                 received.capacity() * sizeof(Datagram) + ring.capacity() * sizeof(SendSlot);
+    for (const SendSlot& slot : ring) {
+      rst += slot.buffer.capacity();
+    }
+#ifdef HELLO_COTURN_MMSG
+    rst += recvHdrs.capacity() * sizeof(mmsghdr) + recvIov.capacity() * sizeof(iovec) +
+           recvAddrs.capacity() * sizeof(sockaddr_storage) + recvCtrl.capacity() +
+           sendHdrs.capacity() * sizeof(mmsghdr) + sendIov.capacity() * sizeof(iovec) +
+           sendCtrl.capacity() + sendSegments.capacity() * sizeof(size_t);
+#endif
+    return rst;
+  }
+};
+
+
+}  // namespace HelloCoturn
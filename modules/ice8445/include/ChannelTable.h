@@ -0,0 +1,190 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include "asio.hpp"
+#include "seeker/common.h"
+#include "PermissionCache.h"
+
+
+namespace HelloCoturn {
+
+
+/*
+Channel bindings of one allocation, channel number -> T and peer -> channel number.
+
+Channel numbers are 0x4000 - 0x7FFF (RFC 5766 11.), 16384 values, so the forward direction is
+a two-level direct index instead of a hash:
+
+  pages [256]   one pointer per 64 channel numbers, nullptr until a channel in it is bound.
+  Page          a bitmap of bound entries and the 64 entries.
+
+find() is two dependent loads (page pointer, then the entry next to its bitmap), no hashing
+and no probing, it is what the ChannelData path runs for every packet. The page array itself
+is allocated on the first bind and everything is released when the last channel goes, so an
+allocation without channels costs one pointer and an empty map.
+
+The reverse direction (peer transport address -> channel, for relaying peer data back as
+ChannelData) is a hash map, it is needed once per packet from the peer and only holds bound
+peers.
+
+T must have an `asio::ip::udp::endpoint peer` member, the reverse map is keyed on it.
+*/
+template <typename T>
+class ChannelTable {
+ public:
+  static constexpr uint16_t minChannel = PermissionCache::minChannel;
+  static constexpr uint16_t maxChannel = PermissionCache::maxChannel;
+
+ private:
+  static constexpr unsigned pageBits = 6;
+  static constexpr unsigned pageSize = 1u << pageBits;
+  static constexpr unsigned pageCount = (maxChannel - minChannel + 1) >> pageBits;
+
+  struct Page {
+    uint64_t used = 0;
+    unsigned count = 0;
+    T entries[pageSize];
+  };
+
+  std::unique_ptr<std::unique_ptr<Page>[]> pages;
+  std::unordered_map<PeerKey, uint16_t, PeerKeyHash> channelOfPeer;
+  size_t count = 0;
+
+  static bool valid(uint16_t channel) {
+    return channel >= minChannel && channel <= maxChannel;
+  }
+
+
+ public:
+  ChannelTable() = default;
+  ChannelTable(ChannelTable&&) = default;
+  ChannelTable& operator=(ChannelTable&&) = default;
+
+  // entry bound to channel, nullptr if none.
+  T* find(uint16_t channel) const {
+    unsigned i = (unsigned)(channel - minChannel);
+    if (i >= pageCount * pageSize || !pages) {
+      return nullptr;
+    }
+    Page* page = pages[i >> pageBits].get();
+    unsigned bit = i & (pageSize - 1);
+    if (page == nullptr || (page->used & (1ULL << bit)) == 0) {
+      return nullptr;
+    }
+    return &page->entries[bit];
+  }
+
+  // channel bound to the peer transport address, 0 if none.
+  uint16_t channelOf(const PeerKey& peer) const {
+    if (count == 0) {
+      return 0;
+    }
+    auto it = channelOfPeer.find(peer);
+    return it == channelOfPeer.end() ? 0 : it->second;
+  }
+
+  uint16_t channelOf(const asio::ip::udp::endpoint& peer) const {
+    return count == 0 ? 0 : channelOf(PeerKey::of(peer));
+  }
+
+  /*
+  bind channel to peer and return its entry, a default T with `peer` set on first bind.
+  Return nullptr if the channel number is invalid, or the channel or the peer is already bound
+  elsewhere (RFC 5766 11.2 rejects both with 400).
+  */
+  T* bind(uint16_t channel, const asio::ip::udp::endpoint& peer) {
+    if (!valid(channel)) {
+      return nullptr;
+    }
+    PeerKey key = PeerKey::of(peer);
+    T* bound = find(channel);
+    uint16_t peerChannel = channelOf(key);
+    if (bound != nullptr || peerChannel != 0) {
+      return bound != nullptr && peerChannel == channel ? bound : nullptr;
+    }
+
+    if (!pages) {
+      pages.reset(new std::unique_ptr<Page>[pageCount]);
+    }
+    unsigned i = (unsigned)(channel - minChannel);
+    std::unique_ptr<Page>& page = pages[i >> pageBits];
+    if (!page) {
+      page.reset(new Page());
+    }
+    unsigned bit = i & (pageSize - 1);
+    page->used |= 1ULL << bit;
+    page->count++;
+    T& e = page->entries[bit];
+    e = T();
+    e.peer = peer;
+    channelOfPeer.emplace(key, channel);
+    count++;
+    return &e;
+  }
+
+  // return false if channel was not bound.
+  bool erase(uint16_t channel) {
+    T* e = find(channel);
+    if (e == nullptr) {
+      return false;
+    }
+    channelOfPeer.erase(PeerKey::of(e->peer));
+    unsigned i = (unsigned)(channel - minChannel);
+    std::unique_ptr<Page>& page = pages[i >> pageBits];
+    page->used &= ~(1ULL << (i & (pageSize - 1)));
+    if (--page->count == 0) {
+      page.reset();
+    }
+    if (--count == 0) {
+      clear();
+    }
+    return true;
+  }
+
+  // fn(uint16_t channel, T& entry) for every bound channel, in channel order.
+  template <typename F>
+  void forEach(F&& fn) const {
+    if (!pages) {
+      return;
+    }
+    for (unsigned p = 0; p < pageCount; p++) {
+      Page* page = pages[p].get();
+      if (page == nullptr) {
+        continue;
+      }
+      for (uint64_t used = page->used; used != 0; used &= used - 1) {
+        unsigned bit = (unsigned)seeker::Bits::lowest(used);
+        fn((uint16_t)(minChannel + (p << pageBits) + bit), page->entries[bit]);
+      }
+    }
+  }
+
+  void clear() {
+    pages.reset();
+    std::unordered_map<PeerKey, uint16_t, PeerKeyHash>().swap(channelOfPeer);
+    count = 0;
+  }
+
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+
+  // heap bytes held, reverse map nodes estimated.
+  size_t memoryBytes() const {
+    size_t rst = 0;
+    if (pages) {
+      rst += pageCount * sizeof(std::unique_ptr<Page>);
+      for (unsigned p = 0; p < pageCount; p++) {
+        rst += pages[p] ? sizeof(Page) : 0;
+      }
+    }
+    rst += channelOfPeer.bucket_count() * sizeof(void*) +
+           channelOfPeer.size() * (sizeof(PeerKey) + sizeof(uint16_t) + 2 * sizeof(void*));
+    return rst;
+  }
+};
+
+
+}  // namespace HelloCoturn
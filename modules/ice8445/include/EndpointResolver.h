@@ -0,0 +1,274 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "asio.hpp"
+#include "seeker/loggerApi.h"
+
+
+namespace HelloCoturn {
+
+using std::string;
+
+
+/*
+Asynchronous host name resolution for TURN server endpoints, with a cache.
+
+- Answers are cached per (host, port). getaddrinfo does not give the record TTL, so a
+  positive answer is kept positiveTtlMs and a failure negativeTtlMs.
+- Lookups are coalesced: while a name is being resolved, later requests for it only queue
+  their handler, a thousand sessions towards the same server cost one lookup.
+- AAAA and A are queried in parallel, as RFC 8305 3 asks. A positive AAAA answer completes
+  at once; when the A answer comes first it waits up to resolutionDelayMs for the AAAA one.
+  A family answering after completion is merged into the cached entry for later callers.
+- Endpoints are ordered RFC 8305 4 style, families interleaved with the preferred one first,
+  so trying them in order alternates between IPv6 and IPv4.
+
+The lookups run on asio's resolver thread, which goes through getaddrinfo and so through
+/etc/hosts as well. An IP literal is answered without a lookup. Handlers are always called
+from the io_context, never from within resolve().
+
+Not thread safe, use it from the io_context thread. Must outlive the lookups it started.
+*/
+class EndpointResolver {
+ public:
+  using Endpoints = std::vector<asio::ip::udp::endpoint>;
+  using Handler = std::function<void(const asio::error_code&, const Endpoints&)>;
+
+  struct Options {
+    int64_t positiveTtlMs = 300 * 1000;
+    int64_t negativeTtlMs = 30 * 1000;
+    int64_t resolutionDelayMs = 50;
+    bool preferIpv6 = true;
+    size_t maxEntries = 4096;
+  };
+
+  struct Stats {
+    uint64_t lookups = 0;    // getaddrinfo pairs started
+    uint64_t hits = 0;       // answered from the cache, failures included
+    uint64_t coalesced = 0;  // joined a lookup in flight
+  };
+
+ private:
+  struct Entry {
+    int64_t expireAt = 0;
+    asio::error_code error;
+    Endpoints endpoints;
+
+    bool answered = true;  // false while waiters wait
+    int inFlight = 0;      // family queries not back yet
+    std::vector<Handler> waiters;
+    Endpoints v4;
+    Endpoints v6;
+    asio::error_code v4Error;
+    asio::error_code v6Error;
+    bool v4Done = false;
+    bool v6Done = false;
+    std::unique_ptr<asio::steady_timer> delay;
+  };
+
+  asio::io_context& ioContext;
+  asio::ip::udp::resolver resolver;
+  Options options;
+  Stats stats;
+  std::unordered_map<string, Entry> entries;
+  size_t purgeAt = 64;
+
+
+  static int64_t nowMs() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+  }
+
+  static string keyOf(const string& host, uint16_t port) {
+    return host + "|" + std::to_string(port);
+  }
+
+  Endpoints interleave(const Endpoints& v6, const Endpoints& v4) const {
+    const Endpoints& first = options.preferIpv6 ? v6 : v4;
+    const Endpoints& second = options.preferIpv6 ? v4 : v6;
+    Endpoints rst;
+    rst.reserve(v6.size() + v4.size());
+    for (size_t i = 0; i < std::max(first.size(), second.size()); i++) {
+      if (i < first.size()) {
+        rst.push_back(first[i]);
+      }
+      if (i < second.size()) {
+        rst.push_back(second[i]);
+      }
+    }
+    return rst;
+  }
+
+  static void collect(const asio::ip::udp::resolver::results_type& results, Endpoints& out) {
+    for (auto& r : results) {
+      if (std::find(out.begin(), out.end(), r.endpoint()) == out.end()) {
+        out.push_back(r.endpoint());
+      }
+    }
+  }
+
+  void purge() {
+    if (entries.size() < purgeAt) {
+      return;
+    }
+    int64_t now = nowMs();
+    for (auto it = entries.begin(); it != entries.end();) {
+      const Entry& e = it->second;
+      bool idle = e.answered && e.inFlight == 0 && e.expireAt <= now;
+      it = idle ? entries.erase(it) : std::next(it);
+    }
+    purgeAt = std::max(options.maxEntries, entries.size() * 2);
+  }
+
+  void query(const string& key, const asio::ip::udp& family, const string& host,
+             uint16_t port) {
+    resolver.async_resolve(
+        family, host, std::to_string(port), asio::ip::udp::resolver::numeric_service,
+        [this, key, v6 = family == asio::ip::udp::v6()](
+            const asio::error_code& ec, asio::ip::udp::resolver::results_type results) {
+          if (ec == asio::error::operation_aborted) {
+            return;
+          }
+          auto it = entries.find(key);
+          if (it == entries.end()) {
+            return;
+          }
+          Entry& e = it->second;
+          e.inFlight--;
+          (v6 ? e.v6Done : e.v4Done) = true;
+          (v6 ? e.v6Error : e.v4Error) = ec;
+          if (!ec) {
+            collect(results, v6 ? e.v6 : e.v4);
+          }
+          onFamily(key, e, v6);
+        });
+  }
+
+  void onFamily(const string& key, Entry& e, bool v6) {
+    bool positive = !(v6 ? e.v6 : e.v4).empty();
+    if (e.answered) {
+      // the late family of an answered lookup, only the cache learns about it.
+      if (positive) {
+        e.endpoints = interleave(e.v6, e.v4);
+        e.error = asio::error_code();
+        e.expireAt = nowMs() + options.positiveTtlMs;
+      }
+      return;
+    }
+    bool preferred = v6 == options.preferIpv6;
+    if (e.v4Done && e.v6Done) {
+      answer(e);
+    } else if (positive && preferred) {
+      answer(e);
+    } else if (positive) {
+      // RFC 8305 3: give the preferred family resolutionDelayMs to catch up.
+      if (!e.delay) {
+        e.delay.reset(new asio::steady_timer(ioContext));
+      }
+      e.delay->expires_after(std::chrono::milliseconds(options.resolutionDelayMs));
+      e.delay->async_wait([this, key](const asio::error_code& ec) {
+        auto it = entries.find(key);
+        if (ec == asio::error::operation_aborted || it == entries.end() ||
+            it->second.answered) {
+          return;
+        }
+        answer(it->second);
+      });
+    }
+  }
+
+  void answer(Entry& e) {
+    if (e.delay) {
+      e.delay->cancel();
+    }
+    e.answered = true;
+    e.endpoints = interleave(e.v6, e.v4);
+    if (e.endpoints.empty()) {
+      e.error = e.v4Error ? e.v4Error : e.v6Error;
+      if (!e.error) {
+        e.error = asio::error::host_not_found;
+      }
+      e.expireAt = nowMs() + options.negativeTtlMs;
+    } else {
+      e.error = asio::error_code();
+      e.expireAt = nowMs() + options.positiveTtlMs;
+    }
+    // copies: a handler may resolve again and touch the entry.
+    std::vector<Handler> waiters;
+    waiters.swap(e.waiters);
+    asio::error_code error = e.error;
+    Endpoints endpoints = e.endpoints;
+    for (auto& h : waiters) {
+      h(error, endpoints);
+    }
+  }
+
+
+ public:
+  EndpointResolver(asio::io_context& ioContext_, const Options& options_)
+      : ioContext(ioContext_), resolver(ioContext_), options(options_) {}
+
+  explicit EndpointResolver(asio::io_context& ioContext_)
+      : EndpointResolver(ioContext_, Options()) {}
+
+  EndpointResolver(const EndpointResolver&) = delete;
+  EndpointResolver& operator=(const EndpointResolver&) = delete;
+
+  void resolve(const string& host, uint16_t port, Handler handler) {
+    asio::error_code ec;
+    asio::ip::address literal = asio::ip::make_address(host, ec);
+    if (!ec) {
+      Endpoints endpoints{asio::ip::udp::endpoint(literal, port)};
+      asio::post(ioContext, [handler, endpoints]() { handler(asio::error_code(), endpoints); });
+      return;
+    }
+
+    string key = keyOf(host, port);
+    Entry& e = entries[key];
+    if (!e.answered) {
+      stats.coalesced++;
+      e.waiters.push_back(std::move(handler));
+      return;
+    }
+    if (nowMs() < e.expireAt || e.inFlight > 0) {
+      stats.hits++;
+      asio::error_code error = e.error;
+      Endpoints endpoints = e.endpoints;
+      asio::post(ioContext, [handler, error, endpoints]() { handler(error, endpoints); });
+      return;
+    }
+
+    stats.lookups++;
+    e.answered = false;
+    e.inFlight = 2;
+    e.waiters.push_back(std::move(handler));
+    e.v4.clear();
+    e.v6.clear();
+    e.v4Done = false;
+    e.v6Done = false;
+    query(key, asio::ip::udp::v6(), host, port);
+    query(key, asio::ip::udp::v4(), host, port);
+    purge();
+  }
+
+  // drop every cached answer, lookups in flight still complete.
+  void clear() {
+    for (auto& pair : entries) {
+      pair.second.expireAt = 0;
+    }
+  }
+
+  const Stats& statistics() const { return stats; }
+  size_t size() const { return entries.size(); }
+};
+
+
+}  // namespace HelloCoturn
@@ -1,6 +1,9 @@
+#pragma once
+
 #include <iostream>
 #include <vector>
 #include <unordered_map>
+#include "asio.hpp"
 #include "seeker/common.h"
 #include "seeker/logger.h"
 #include "hmac.h"
@@ -8,8 +11,6 @@
 #include "md5.h"
 #include "sha1.h"
 
-#include <iomanip>
-
 
 /*
 
@@ -96,16 +97,19 @@ class StunMessage {
   StunClass msgClass;
   uint32_t transactionId[3] = {0, 0, 0};
 
-  bool fingerprintEnable;
-  bool messageIntegrityEnable;
+  bool fingerprintEnable = false;
+  bool messageIntegrityEnable = false;
 
   static const uint16_t headerLength = 20;
   static const uint32_t magicCookie = 0x2112A442;
 
-  std::unordered_map<uint16_t, vector<uint8_t>> attributes;
-  std::vector<uint16_t> attributesOrder;
+  // in wire order. A type may repeat, e.g. several XOR-PEER-ADDRESS in CreatePermission.
+  std::vector<std::pair<uint16_t, vector<uint8_t>>> attributes;
 
   std::string password;
+  // key of MESSAGE-INTEGRITY when the message carries no USERNAME/REALM, e.g. a response.
+  std::string integrityUsername;
+  std::string integrityRealm;
 
   // std::string username;
   // std::string realm;
@@ -113,14 +117,11 @@ class StunMessage {
   static void genMessageIntegrity(const uint8_t* data, size_t len, uint8_t out[20],
                                   const std::string& username_, const std::string& password_,
                                   const std::string& realm_) {
-    std::cout << "------ genMessageIntegrity 0 ----------- len=" << len << std::endl;
-
     std::vector<uint8_t> passwordVector;
     passwordVector = ByteArray::SASLprep((uint8_t*)password_.c_str());
     if (passwordVector.empty()) {
-      throw std::exception("password SASLprep failed.");
+      throw std::runtime_error("password SASLprep failed.");
     }
-    std::cout << "------ genMessageIntegrity 1 -----------" << std::endl;
 
 
     // long-term credentials
@@ -132,16 +133,13 @@ class StunMessage {
     keyStr += realm_;
     keyStr += ":";
     keyStr += (char*)passwordVector.data();
-    std::cout << "------ genMessageIntegrity 2 ----------- keyStr:" << keyStr << std::endl;
-    std::cout << "------ genMessageIntegrity 3 -----------" << std::endl;
 
     md5.reset();
     md5.add(keyStr.c_str(), keyStr.size());
     uint8_t key[16];
     md5.getHash(key);
     // out length must be 20 bytes.
-    hmac<SHA1>(data, len, key, 16, out);
-    std::cout << "------ genMessageIntegrity 4 -----------" << std::endl;
+    hmac<class SHA1>(data, len, key, 16, out);
   }
 
 
@@ -166,7 +164,8 @@ class StunMessage {
     return padding;
   }
 
-  void addAttr(StunAttributeType attrType, const uint8_t* data, const size_t len) {
+  void addAttr(StunAttributeType attrType, const uint8_t* data, const size_t len,
+               bool repeatable = false) {
     if (attrType == StunAttributeType::FINGERPRINT ||
         attrType == StunAttributeType::MESSAGE_INTEGRITY) {
       throw std::runtime_error(
@@ -177,28 +176,42 @@ class StunMessage {
 
     uint16_t typeCode = (uint16_t)attrType;
 
-    if (attributes.find(typeCode) == attributes.end()) {
-      std::vector<uint8_t> vec(len);
-      attributesOrder.push_back(typeCode);
-      for (int i = 0; i < len; i++) {
-        vec.at(i) = data[i];
+    if (repeatable || findAttr(typeCode) == nullptr) {
+      std::vector<uint8_t> vec(data, data + len);
+      attributes.emplace_back(typeCode, std::move(vec));
+    }
+  }
+
+  const vector<uint8_t>* findAttr(uint16_t typeCode) const {
+    for (auto& attr : attributes) {
+      if (attr.first == typeCode) {
+        return &attr.second;
       }
-      std::cout << "atrr t=" << std::hex << (int)typeCode << std::dec << " len=" << len
-                << " size=" << vec.size() << std::endl;
-      attributes.emplace(typeCode, std::move(vec));
     }
+    return nullptr;
   }
 
   std::vector<uint8_t> getAttr(StunAttributeType attrType) {
     uint16_t typeCode = (uint16_t)attrType;
-    auto pair = attributes.find(typeCode);
-    if (pair != attributes.end()) {
-      std::vector<uint8_t> value{pair->second};
-      return value;
+    auto value = findAttr(typeCode);
+    if (value != nullptr) {
+      return *value;
     } else {
-      std::vector<uint8_t> value(0);
-      return value;
+      std::vector<uint8_t> empty(0);
+      return empty;
+    }
+  }
+
+  // every value of a repeatable attribute, in wire order.
+  std::vector<std::vector<uint8_t>> getAttrs(StunAttributeType attrType) {
+    uint16_t typeCode = (uint16_t)attrType;
+    std::vector<std::vector<uint8_t>> values;
+    for (auto& attr : attributes) {
+      if (attr.first == typeCode) {
+        values.push_back(attr.second);
+      }
     }
+    return values;
   }
 
   void writeHeader(std::vector<uint8_t>& msgData) {
@@ -231,16 +244,15 @@ class StunMessage {
   }
 
   void writeAttributes(std::vector<uint8_t>& msgData) {
-    std::cout << "------ writeAttributes 0 -----------" << std::endl;
     auto dataBuf = msgData.data();
 
 
     auto bodyBuf = dataBuf + headerLength;
-    std::cout << "------ writeAttributes 1 -----------" << std::endl;
     size_t pos = 0;
 
-    for (auto& t : attributesOrder) {
-      vector<uint8_t> v = attributes.at(t);
+    for (auto& attr : attributes) {
+      uint16_t t = attr.first;
+      const vector<uint8_t>& v = attr.second;
 
       uint16_t len = (uint16_t)v.size();
       uint8_t padding = paddingLength(len);
@@ -252,15 +264,13 @@ class StunMessage {
       ByteArray::writeData(bodyBuf + pos, len, false);
       pos += sizeof(len);
 
-      ByteArray::writeData(bodyBuf + pos, v.data(), len);
+      ByteArray::writeData(bodyBuf + pos, (uint8_t*)v.data(), len);
       pos += len;
 
       for (int i = 0; i < padding; ++i) {
         ByteArray::writeData(bodyBuf + pos, (uint8_t)0x00);
         pos += 1;
       }
-      std::cout << "------ writeAttributes 3 -----------t= " << std::hex << (t) << std::dec
-                << " len=" << len << " pos=" << pos << std::endl;
     }
 
     if (messageIntegrityEnable) {
@@ -269,43 +279,27 @@ class StunMessage {
       ByteArray::writeData(dataBuf + 2, dummyMsgLength, false);
       uint8_t messageIntegrityValue[20];
 
-      std::cout << "------ writeAttributes 3.1 ----------- dummyMsgLength=" << dummyMsgLength
-                << std::endl;
-
       auto vec = getAttr(StunAttributeType::USERNAME);
-      string username = std::string((char*)vec.data(), vec.size());
+      string username = vec.empty() ? integrityUsername
+                                    : std::string((char*)vec.data(), vec.size());
 
       vec = getAttr(StunAttributeType::REALM);
-      string realm = std::string((char*)vec.data(), vec.size());
+      string realm =
+          vec.empty() ? integrityRealm : std::string((char*)vec.data(), vec.size());
 
       genMessageIntegrity(dataBuf, headerLength + pos, messageIntegrityValue, username,
                           password, realm);
 
-      std::cout << std::hex;
-      for (int i = 0; i < 20; i++) {
-        std::cout << std::setw(2) << std::setfill('0') << (int)messageIntegrityValue[i]
-                  << " ";  //
-      }
-
-      std::cout << std::dec << std::endl;
-      std::cout << "------ writeAttributes 3.2 -----------" << std::endl;
-
       uint16_t t = (uint16_t)StunAttributeType::MESSAGE_INTEGRITY;
       uint16_t len = (uint16_t)20;
 
-      std::cout << "------ writeAttributes 3.3.1 ----------- len=" << len << " pos=" << pos
-                << std::endl;
-
       ByteArray::writeData(bodyBuf + pos, t, false);
       pos += sizeof(t);
       ByteArray::writeData(bodyBuf + pos, len, false);
       pos += sizeof(len);
       ByteArray::writeData(bodyBuf + pos, messageIntegrityValue, len);
       pos += len;
-      std::cout << "------ writeAttributes 3.3.2 ----------- len=" << len << " pos=" << pos
-                << std::endl;
     }
-    std::cout << "------ writeAttributes 4 -----------" << std::endl;
 
     if (fingerprintEnable) {
       uint16_t fingerprintAttrLength = 2 + 2 + 4;
@@ -326,11 +320,9 @@ class StunMessage {
       ByteArray::writeData(bodyBuf + pos, fingerprint, len);
       pos += len;
 
-      std::cout << "------ writeAttributes 5 -----------" << std::endl;
-
     } else {
       uint16_t msgLength = pos;
-      ByteArray::writeData(dataBuf + 2, msgLength);
+      ByteArray::writeData(dataBuf + 2, msgLength, false);
     }
   }
 
@@ -357,7 +349,15 @@ class StunMessage {
   static int parse(uint8_t* data, size_t len, StunMessage& emptyMsg, bool hasFingerprint,
                    const std::string& username_ = "", const std::string& password_ = "",
                    const std::string& realm_ = "") {
-    bool checkRst = true;
+    if (len < StunMessage::headerLength) {
+      return -5;
+    }
+    // the length field must not point past the datagram.
+    const uint16_t msgLen = ((uint16_t)data[2]) << 8 | data[3];
+    if (StunMessage::headerLength + (size_t)msgLen > len) {
+      return -5;
+    }
+
     if (hasFingerprint) {
       if (!checkFingerprint(data, len)) {
         return -1;
@@ -379,27 +379,19 @@ class StunMessage {
 
     // message type pass
     const uint16_t msgType = ((uint16_t)data[0]) << 8 | data[1];
-    I_LOG("parse msgType = {}", (int)msgType);
-
 
     uint16_t method = 0x0000;
     method = (method << 5) | ((msgType >> 9) & 0x1f);
     method = (method << 3) | ((msgType >> 5) & 0x07);
     method = (method << 4) | ((msgType >> 0) & 0x0F);
 
-    D_LOG("parse method = {}", method);
-
     emptyMsg.setMethod((StunMethod)method);
 
     uint16_t clz = 0x0000;
     clz = (clz << 1) | ((msgType >> 8) & 0x01);
     clz = (clz << 1) | ((msgType >> 4) & 0x01);
-    D_LOG("parse clz = {}", clz);
     emptyMsg.setClass((StunClass)clz);
 
-
-    uint16_t msgLen = ((uint16_t)data[2]) << 8 & data[3];
-
     uint32_t cookie = ((uint32_t)data[4] << 24) | ((uint32_t)data[5] << 16) |
                       ((uint32_t)data[6] << 8) | data[7];
     if (cookie != StunMessage::magicCookie) {
@@ -416,14 +408,13 @@ class StunMessage {
 
     {  // attributors
       auto bodyBuf = data + StunMessage::headerLength;
-      int pos = 0;
+      size_t pos = 0;
 
-      std::unordered_map<uint16_t, vector<uint8_t>> attrs;
-      std::vector<uint16_t> order;
+      std::vector<std::pair<uint16_t, vector<uint8_t>>> attrs;
 
       uint16_t attrType = 0;
 
-      while (pos + 4 < msgLen) {
+      while (pos + 4 <= msgLen) {
         ByteArray::readData(bodyBuf + pos, attrType, false);
         pos += sizeof(attrType);
 
@@ -440,8 +431,12 @@ class StunMessage {
         uint16_t len = 0;
         ByteArray::readData(bodyBuf + pos, len, false);
         pos += sizeof(len);
+        if (pos + len > msgLen) {
+          return -5;
+        }
 
-        std::vector<uint8_t> data(len);
+        std::vector<uint8_t> data;
+        data.reserve(len);
         ByteArray::readData(bodyBuf + pos, data, len);
         pos += len;
 
@@ -449,18 +444,10 @@ class StunMessage {
         pos += padding;
 
 
-        if (attrs.find(attrType) == attrs.end()) {
-          std::vector<uint8_t> vec(len);
-          order.push_back(attrType);
-          for (int i = 0; i < len; i++) {
-            vec.at(i) = data[i];
-          }
-          attrs.emplace(attrType, std::move(vec));
-        }
+        attrs.emplace_back(attrType, std::move(data));
       }
 
-      emptyMsg.attributes = attrs;
-      emptyMsg.attributesOrder = order;
+      emptyMsg.attributes = std::move(attrs);
     }
 
     return 0;
@@ -474,47 +461,36 @@ class StunMessage {
     uint16_t msgLen;
     ByteArray::readData(data + 2, msgLen, false);
 
-    if (hasFingerprint && msgLen < 20 + 24 + 8) {
-      return false;
-    } else if (!hasFingerprint && msgLen < 20 + 24) {
+    const uint16_t fingerprintAttrLength = hasFingerprint ? 8 : 0;
+    if (msgLen < 24 + fingerprintAttrLength || headerLength + (size_t)msgLen > len) {
       return false;
     }
 
-    uint16_t dummyMsgLen;
-    if (hasFingerprint) {
-      dummyMsgLen = msgLen - 8;
-    } else {
-      dummyMsgLen = msgLen;
-    }
-
-    bool checkRst = true;
+    // MESSAGE-INTEGRITY is computed with the length field covering up to itself, without
+    // FINGERPRINT (RFC 5389 15.4).
+    uint16_t dummyMsgLen = msgLen - fingerprintAttrLength;
+    uint8_t* attr = data + headerLength + dummyMsgLen - 24;
 
-    ByteArray::writeData(data + 2, dummyMsgLen, false);
     uint16_t attrType;
-    ByteArray::readData(data + dummyMsgLen - 24, attrType, false);
+    ByteArray::readData(attr, attrType, false);
     uint16_t attrLen;
-    ByteArray::readData(data + dummyMsgLen - 22, attrLen, false);
-
+    ByteArray::readData(attr + 2, attrLen, false);
     if (attrType != (uint16_t)StunAttributeType::MESSAGE_INTEGRITY || attrLen != 20) {
-      checkRst = false;
-    } else {
-      uint8_t attrValue[20] = {0};
-      ByteArray::readData(data + dummyMsgLen - 20, attrValue, 20);
-
-      uint8_t expectValue[20];
-      genMessageIntegrity(data, dummyMsgLen, expectValue, username_, password_, realm_);
-      for (int i = 0; i < 20; i++) {
-        if (attrValue[i] != expectValue[i]) {
-          checkRst = false;
-          break;
-        }
-      }
+      return false;
     }
 
-    if (msgLen != dummyMsgLen) {
-      ByteArray::writeData(data + 2, msgLen, false);
-    }
+    ByteArray::writeData(data + 2, dummyMsgLen, false);
+    uint8_t expectValue[20];
+    genMessageIntegrity(data, attr - data, expectValue, username_, password_, realm_);
+    ByteArray::writeData(data + 2, msgLen, false);
 
+    bool checkRst = true;
+    for (int i = 0; i < 20; i++) {
+      if (attr[4 + i] != expectValue[i]) {
+        checkRst = false;
+        break;
+      }
+    }
     return checkRst;
   }
 
@@ -522,7 +498,7 @@ class StunMessage {
   static bool checkFingerprint(uint8_t* data, size_t len) {
     uint16_t msgLen;
     ByteArray::readData(data + 2, msgLen, false);
-    if (msgLen < 8) {
+    if (msgLen < 8 || headerLength + (size_t)msgLen > len) {
       return false;
     }
 
@@ -555,8 +531,8 @@ class StunMessage {
 
   void setClass(StunClass clz) { msgClass = clz; }
 
-  StunMethod getMethod() { return msgMethod; }
-  StunClass getClass() { return msgClass; }
+  StunMethod getMethod() const { return msgMethod; }
+  StunClass getClass() const { return msgClass; }
 
   void setFingerprint(bool enable) { fingerprintEnable = enable; }
 
@@ -564,12 +540,23 @@ class StunMessage {
 
   void setPassword(const string& p) { password = p; }
 
+  // sign with this long-term key instead of the USERNAME/REALM attributes of the message.
+  void setIntegrityKey(const string& username_, const string& realm_,
+                       const string& password_) {
+    integrityUsername = username_;
+    integrityRealm = realm_;
+    password = password_;
+    messageIntegrityEnable = true;
+  }
+
   void setTransactionId(uint32_t transId[3]) {
     transactionId[0] = transId[0];
     transactionId[1] = transId[1];
     transactionId[2] = transId[2];
   }
 
+  const uint32_t* getTransactionId() const { return transactionId; }
+
 
 
   /*
@@ -587,6 +574,12 @@ class StunMessage {
     addAttr(attrType, data, len);
   };
 
+  // IANA protocol number, 17 for UDP. Return 0 if REQUESTED-TRANSPORT is absent.
+  uint8_t getAttr_REQUESTED_TRANSPORT() {
+    std::vector<uint8_t> value = getAttr(StunAttributeType::REQUESTED_TRANSPORT);
+    return value.empty() ? 0 : value[0];
+  }
+
   void setAttr_LIFETIME(uint32_t lifeTime) {
     StunAttributeType attrType = StunAttributeType::LIFETIME;
 
@@ -614,7 +607,6 @@ class StunMessage {
   // TODO get attr
 
   void setAttr_NONCE(const uint8_t* nonce, size_t len) {
-    std::cout << "setAttr_NONCE len=" << len << std::endl;
     StunAttributeType attrType = StunAttributeType::NONCE;
     addAttr(attrType, nonce, len);
   };
@@ -624,6 +616,236 @@ class StunMessage {
     addAttr(attrType, (uint8_t*)realm.c_str(), realm.size());
   };
 
+  const string getAttr_NONCE() {
+    std::vector<uint8_t> value = getAttr(StunAttributeType::NONCE);
+    return string((char*)value.data(), value.size());
+  }
+
+  const string getAttr_REALM() {
+    std::vector<uint8_t> value = getAttr(StunAttributeType::REALM);
+    return string((char*)value.data(), value.size());
+  }
+
+  // return false if LIFETIME is absent.
+  bool getAttr_LIFETIME(uint32_t& lifeTime) {
+    std::vector<uint8_t> value = getAttr(StunAttributeType::LIFETIME);
+    if (value.size() != 4) {
+      return false;
+    }
+    ByteArray::readData(value.data(), lifeTime, false);
+    return true;
+  }
+
+  /*
+  RFC 5389: 15.6.  ERROR-CODE
+   0                   1                   2                   3
+   0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |           Reserved, should be 0         |Class|     Number    |
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |      Reason Phrase (variable)                                ..
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  */
+  void setAttr_ERROR_CODE(int code, const string& reason) {
+    std::vector<uint8_t> data(4 + reason.size());
+    data[2] = (uint8_t)((code / 100) & 0x07);
+    data[3] = (uint8_t)(code % 100);
+    std::copy(reason.begin(), reason.end(), data.begin() + 4);
+    addAttr(StunAttributeType::ERROR_CODE, data.data(), data.size());
+  }
+
+  // return error code like 401 or 438, 0 if ERROR-CODE is absent.
+  int getAttr_ERROR_CODE() {
+    std::vector<uint8_t> value = getAttr(StunAttributeType::ERROR_CODE);
+    if (value.size() < 4) {
+      return 0;
+    }
+    return (value[2] & 0x07) * 100 + value[3];
+  }
+
+
+  /*
+  RFC 5389: 15.2.  XOR-MAPPED-ADDRESS
+   0                   1                   2                   3
+   0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |x x x x x x x x|    Family     |         X-Port                |
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |                X-Address (Variable)
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  X-Port is port XOR the most significant 16 bits of the magic cookie, X-Address is address
+  XOR magic cookie (IPv4) or XOR magic cookie + transaction ID (IPv6).
+  XOR-PEER-ADDRESS and XOR-RELAYED-ADDRESS (RFC 5766) use the same encoding.
+  */
+  static size_t encodeXorAddress(const asio::ip::udp::endpoint& ep, const uint32_t transId[3],
+                                 uint8_t out[20]) {
+    uint8_t mask[16];
+    ByteArray::writeData(mask + 0, magicCookie, false);
+    ByteArray::writeData(mask + 4, transId[0], false);
+    ByteArray::writeData(mask + 8, transId[1], false);
+    ByteArray::writeData(mask + 12, transId[2], false);
+
+    uint16_t xport = ep.port() ^ (uint16_t)(magicCookie >> 16);
+    out[0] = 0;
+    ByteArray::writeData(out + 2, xport, false);
+
+    if (ep.address().is_v4()) {
+      out[1] = 0x01;
+      auto bytes = ep.address().to_v4().to_bytes();
+      for (int i = 0; i < 4; i++) {
+        out[4 + i] = bytes[i] ^ mask[i];
+      }
+      return 8;
+    } else {
+      out[1] = 0x02;
+      auto bytes = ep.address().to_v6().to_bytes();
+      for (int i = 0; i < 16; i++) {
+        out[4 + i] = bytes[i] ^ mask[i];
+      }
+      return 20;
+    }
+  }
+
+  // return false on malformed value.
+  static bool decodeXorAddress(const std::vector<uint8_t>& value, const uint32_t transId[3],
+                               asio::ip::udp::endpoint& ep) {
+    return decodeXorAddress(value.data(), value.size(), transId, ep);
+  }
+
+  static bool decodeXorAddress(const uint8_t* value, size_t size, const uint32_t transId[3],
+                               asio::ip::udp::endpoint& ep) {
+    if (size < 8) {
+      return false;
+    }
+    uint8_t mask[16];
+    ByteArray::writeData(mask + 0, magicCookie, false);
+    ByteArray::writeData(mask + 4, transId[0], false);
+    ByteArray::writeData(mask + 8, transId[1], false);
+    ByteArray::writeData(mask + 12, transId[2], false);
+
+    uint16_t port = (uint16_t)(((value[2] << 8) | value[3]) ^ (magicCookie >> 16));
+
+    if (value[1] == 0x01) {
+      asio::ip::address_v4::bytes_type bytes;
+      for (int i = 0; i < 4; i++) {
+        bytes[i] = value[4 + i] ^ mask[i];
+      }
+      ep = asio::ip::udp::endpoint(asio::ip::address_v4(bytes), port);
+      return true;
+    } else if (value[1] == 0x02 && size >= 20) {
+      asio::ip::address_v6::bytes_type bytes;
+      for (int i = 0; i < 16; i++) {
+        bytes[i] = value[4 + i] ^ mask[i];
+      }
+      ep = asio::ip::udp::endpoint(asio::ip::address_v6(bytes), port);
+      return true;
+    }
+    return false;
+  }
+
+  // may be called several times, e.g. CreatePermission for a batch of peers.
+  void setAttr_XOR_PEER_ADDRESS(const asio::ip::udp::endpoint& peer) {
+    uint8_t data[20];
+    size_t len = encodeXorAddress(peer, transactionId, data);
+    addAttr(StunAttributeType::XOR_PEER_ADDRESS, data, len, true);
+  }
+
+  void setAttr_XOR_RELAYED_ADDRESS(const asio::ip::udp::endpoint& relayed) {
+    uint8_t data[20];
+    size_t len = encodeXorAddress(relayed, transactionId, data);
+    addAttr(StunAttributeType::XOR_RELAYED_ADDRESS, data, len);
+  }
+
+  void setAttr_XOR_MAPPED_ADDRESS(const asio::ip::udp::endpoint& mapped) {
+    uint8_t data[20];
+    size_t len = encodeXorAddress(mapped, transactionId, data);
+    addAttr(StunAttributeType::XOR_MAPPED_ADDRESS, data, len);
+  }
+
+  std::vector<asio::ip::udp::endpoint> getAttr_XOR_PEER_ADDRESS() {
+    std::vector<asio::ip::udp::endpoint> peers;
+    for (auto& value : getAttrs(StunAttributeType::XOR_PEER_ADDRESS)) {
+      asio::ip::udp::endpoint ep;
+      if (decodeXorAddress(value, transactionId, ep)) {
+        peers.push_back(ep);
+      }
+    }
+    return peers;
+  }
+
+  bool getAttr_XOR_RELAYED_ADDRESS(asio::ip::udp::endpoint& relayed) {
+    return decodeXorAddress(getAttr(StunAttributeType::XOR_RELAYED_ADDRESS), transactionId,
+                            relayed);
+  }
+
+  bool getAttr_XOR_MAPPED_ADDRESS(asio::ip::udp::endpoint& mapped) {
+    return decodeXorAddress(getAttr(StunAttributeType::XOR_MAPPED_ADDRESS), transactionId,
+                            mapped);
+  }
+
+  /*
+  RFC 5766: 14.1.  CHANNEL-NUMBER
+   0                   1                   2                   3
+   0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |        Channel Number         |         RFFU = 0              |
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  */
+  void setAttr_CHANNEL_NUMBER(uint16_t channel) {
+    uint8_t data[] = {(uint8_t)(channel >> 8), (uint8_t)(channel & 0xFF), 0, 0};
+    addAttr(StunAttributeType::CHANNEL_NUMBER, data, 4);
+  }
+
+  // return 0 if CHANNEL-NUMBER is absent.
+  uint16_t getAttr_CHANNEL_NUMBER() {
+    std::vector<uint8_t> value = getAttr(StunAttributeType::CHANNEL_NUMBER);
+    if (value.size() < 2) {
+      return 0;
+    }
+    return (uint16_t)((value[0] << 8) | value[1]);
+  }
+
+  /*
+  RFC 5766: 14.6.  EVEN-PORT
+   0                   1                   2                   3
+   0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |R|    RFFU   |
+  +-+-+-+-+-+-+-+-+
+  R: also reserve the next higher port.
+  */
+  void setAttr_EVEN_PORT(bool reserveNext) {
+    uint8_t data[] = {(uint8_t)(reserveNext ? 0x80 : 0)};
+    addAttr(StunAttributeType::EVEN_PORT, data, 1);
+  }
+
+  // return false if EVEN-PORT is absent.
+  bool getAttr_EVEN_PORT(bool& reserveNext) {
+    std::vector<uint8_t> value = getAttr(StunAttributeType::EVEN_PORT);
+    if (value.empty()) {
+      return false;
+    }
+    reserveNext = (value[0] & 0x80) != 0;
+    return true;
+  }
+
+  // RFC 5766: 14.9.  RESERVATION-TOKEN, 8 opaque bytes.
+  void setAttr_RESERVATION_TOKEN(uint64_t token) {
+    uint8_t data[8];
+    ByteArray::writeData(data, token, false);
+    addAttr(StunAttributeType::RESERVATION_TOKEN, data, 8);
+  }
+
+  // return false if RESERVATION-TOKEN is absent or malformed.
+  bool getAttr_RESERVATION_TOKEN(uint64_t& token) {
+    std::vector<uint8_t> value = getAttr(StunAttributeType::RESERVATION_TOKEN);
+    if (value.size() != 8) {
+      return false;
+    }
+    ByteArray::readData(value.data(), token, false);
+    return true;
+  }
+
 
   std::vector<uint8_t> binary() {
     std::vector<uint8_t> msgData((size_t)headerLength + calcMsgLength());
@@ -0,0 +1,342 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "asio.hpp"
+
+
+namespace HelloCoturn {
+
+
+// peer transport address as a hash key, IPv4 stored as v4-mapped IPv6.
+struct PeerKey {
+  std::array<uint8_t, 16> address{};
+  uint16_t port = 0;
+  uint8_t transport = 0;  // IP protocol of a client 5-tuple (6 TCP, 17 UDP), 0 for peers
+
+  static PeerKey of(const asio::ip::udp::endpoint& ep, bool withPort = true) {
+    PeerKey key;
+    const asio::ip::address& addr = ep.address();
+    if (addr.is_v4()) {
+      key.address = asio::ip::make_address_v6(asio::ip::v4_mapped, addr.to_v4()).to_bytes();
+    } else {
+      key.address = addr.to_v6().to_bytes();
+    }
+    key.port = withPort ? ep.port() : 0;
+    return key;
+  }
+
+  bool operator==(const PeerKey& other) const {
+    return port == other.port && transport == other.transport && address == other.address;
+  }
+};
+
+struct PeerKeyHash {
+  size_t operator()(const PeerKey& key) const {
+    // FNV-1a
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (uint8_t b : key.address) {
+      h = (h ^ b) * 0x100000001b3ULL;
+    }
+    h = (h ^ (key.port & 0xFF)) * 0x100000001b3ULL;
+    h = (h ^ (key.port >> 8)) * 0x100000001b3ULL;
+    h = (h ^ key.transport) * 0x100000001b3ULL;
+    return (size_t)h;
+  }
+};
+
+
+
+/*
+Client side view of the permissions (RFC 5766 8.) and channel bindings (RFC 5766 11.) of one
+allocation.
+
+Permissions are per peer IP, they last 300 s. Channel bindings are per peer transport address,
+they last 600 s and a successful ChannelBind also refreshes the permission of that IP.
+
+Renewal policy:
+- a new peer is due immediately.
+- a granted entry is due `renewMarginMs` before it expires, but only if it carried traffic
+  (touch()) since it was last granted. Idle entries are left to expire and are then dropped.
+- all due permissions go into one CreatePermission, up to maxPeersPerRequest peers. Once a
+  request goes out, active permissions that would come due within the next `renewMarginMs`
+  ride along, so peers added a few ms apart keep sharing one renewal instead of drifting.
+- a failed request is retried after retryDelayMs, at most maxRetries times in a row. An entry
+  that runs out of retries, or gets a final error (400, 403, 437), is dropped and handed back
+  to the caller by onPermissionResult() / onChannelResult().
+
+The cache only keeps state, sending and timers are up to the owner (AllocationManager).
+*/
+class PermissionCache {
+ public:
+  static constexpr int64_t permissionLifetimeMs = 300 * 1000;
+  static constexpr int64_t channelLifetimeMs = 600 * 1000;
+  static constexpr uint16_t minChannel = 0x4000;
+  static constexpr uint16_t maxChannel = 0x7FFF;
+
+  struct Options {
+    int64_t renewMarginMs = 60 * 1000;
+    int64_t retryDelayMs = 5 * 1000;
+    uint16_t maxRetries = 3;
+    size_t maxPeersPerRequest = 32;
+  };
+
+ private:
+  struct Entry {
+    asio::ip::udp::endpoint peer;
+    int64_t expireAt = 0;  // 0: never granted
+    int64_t grantedAt = 0;
+    int64_t lastActivity = 0;
+    int64_t retryAt = 0;    // after a failed request
+    uint16_t failures = 0;  // in a row
+    bool pending = false;
+  };
+
+  Options options;
+  std::unordered_map<PeerKey, Entry, PeerKeyHash> permissions;
+  std::unordered_map<uint16_t, Entry> channels;
+  std::unordered_map<PeerKey, uint16_t, PeerKeyHash> channelOfPeer;
+  uint16_t nextChannel = minChannel;
+
+
+  // due at `now`, or by `horizon` for an entry that is renewed early.
+  bool due(const Entry& e, int64_t now, int64_t horizon) const {
+    if (e.pending || now < e.retryAt) {
+      return false;
+    }
+    if (e.expireAt == 0) {
+      return true;
+    }
+    return horizon >= e.expireAt - options.renewMarginMs && e.lastActivity > e.grantedAt;
+  }
+
+  // an expired entry that nobody used since its grant is not worth renewing.
+  static bool stale(const Entry& e, int64_t now) {
+    return !e.pending && e.expireAt != 0 && now >= e.expireAt &&
+           e.lastActivity <= e.grantedAt;
+  }
+
+  int64_t dueAt(const Entry& e) const {
+    if (e.pending) {
+      return INT64_MAX;
+    }
+    if (e.expireAt == 0) {
+      return e.retryAt;
+    }
+    if (e.lastActivity > e.grantedAt) {
+      return std::max(e.retryAt, e.expireAt - options.renewMarginMs);
+    }
+    return e.expireAt;  // for cleanup, or for renewal if traffic shows up meanwhile.
+  }
+
+  static void grant(Entry& e, int64_t now, int64_t lifetimeMs) {
+    e.pending = false;
+    e.retryAt = 0;
+    e.failures = 0;
+    e.grantedAt = now;
+    e.expireAt = now + lifetimeMs;
+  }
+
+  // retrying cannot help: bad request, forbidden peer, allocation gone.
+  static bool finalError(int errorCode) {
+    return errorCode == 400 || errorCode == 403 || errorCode == 437;
+  }
+
+  // after a failed request, true if the entry is to be dropped.
+  bool fail(Entry& e, int errorCode, int64_t now) const {
+    e.pending = false;
+    e.failures++;
+    e.retryAt = now + options.retryDelayMs;
+    return finalError(errorCode) || e.failures > options.maxRetries;
+  }
+
+  uint16_t allocChannel() {
+    for (int i = 0; i <= maxChannel - minChannel; i++) {
+      uint16_t ch = nextChannel;
+      nextChannel = nextChannel == maxChannel ? minChannel : (uint16_t)(nextChannel + 1);
+      if (channels.find(ch) == channels.end()) {
+        return ch;
+      }
+    }
+    return 0;
+  }
+
+
+ public:
+  PermissionCache() = default;
+  explicit PermissionCache(const Options& options_) : options(options_) {}
+
+  // we want to talk to this peer, a permission will be requested if there is none.
+  void addPeer(const asio::ip::udp::endpoint& peer, int64_t now) {
+    Entry& e = permissions[PeerKey::of(peer, false)];
+    if (e.expireAt == 0 && !e.pending) {
+      e.peer = peer;
+    }
+    e.lastActivity = now;
+  }
+
+  // channel number for peer, binding it if needed. 0 if all channel numbers are in use.
+  uint16_t bindChannel(const asio::ip::udp::endpoint& peer, int64_t now) {
+    PeerKey key = PeerKey::of(peer);
+    auto it = channelOfPeer.find(key);
+    if (it != channelOfPeer.end()) {
+      channels[it->second].lastActivity = now;
+      return it->second;
+    }
+    uint16_t ch = allocChannel();
+    if (ch == 0) {
+      return 0;
+    }
+    Entry& e = channels[ch];
+    e.peer = peer;
+    e.lastActivity = now;
+    channelOfPeer.emplace(key, ch);
+    return ch;
+  }
+
+  // traffic to or from peer, keeps its permission and channel alive.
+  // return true if an idle entry became active, its renewal time moved earlier.
+  bool touch(const asio::ip::udp::endpoint& peer, int64_t now) {
+    bool activated = false;
+    auto p = permissions.find(PeerKey::of(peer, false));
+    if (p != permissions.end()) {
+      activated |= p->second.lastActivity <= p->second.grantedAt;
+      p->second.lastActivity = now;
+    }
+    auto c = channelOfPeer.find(PeerKey::of(peer));
+    if (c != channelOfPeer.end()) {
+      Entry& e = channels[c->second];
+      activated |= e.lastActivity <= e.grantedAt;
+      e.lastActivity = now;
+    }
+    return activated;
+  }
+
+  bool permitted(const asio::ip::udp::endpoint& peer, int64_t now) const {
+    auto it = permissions.find(PeerKey::of(peer, false));
+    return it != permissions.end() && now < it->second.expireAt;
+  }
+
+  // bound channel number, 0 if the peer has no live binding.
+  uint16_t channelOf(const asio::ip::udp::endpoint& peer, int64_t now) const {
+    auto it = channelOfPeer.find(PeerKey::of(peer));
+    if (it == channelOfPeer.end()) {
+      return 0;
+    }
+    auto& e = channels.at(it->second);
+    return now < e.expireAt ? it->second : 0;
+  }
+
+  // peers for the next CreatePermission, marked pending.
+  void collectPermissions(int64_t now, std::vector<asio::ip::udp::endpoint>& out) {
+    size_t first = out.size();
+    for (auto it = permissions.begin(); it != permissions.end();) {
+      Entry& e = it->second;
+      if (stale(e, now)) {
+        it = permissions.erase(it);
+        continue;
+      }
+      if (out.size() < options.maxPeersPerRequest && due(e, now, now)) {
+        e.pending = true;
+        out.push_back(e.peer);
+      }
+      ++it;
+    }
+    if (out.size() == first) {
+      return;
+    }
+    // a request goes out anyway, renew what would come due within the margin with it.
+    int64_t horizon = now + options.renewMarginMs;
+    for (auto& pair : permissions) {
+      Entry& e = pair.second;
+      if (out.size() < options.maxPeersPerRequest && due(e, now, horizon)) {
+        e.pending = true;
+        out.push_back(e.peer);
+      }
+    }
+  }
+
+  /*
+  outcome of a CreatePermission for peers, errorCode 0 on success. Peers given up on are
+  removed and appended to dropped.
+  */
+  void onPermissionResult(const std::vector<asio::ip::udp::endpoint>& peers, int errorCode,
+                          int64_t now, std::vector<asio::ip::udp::endpoint>& dropped) {
+    for (auto& peer : peers) {
+      auto it = permissions.find(PeerKey::of(peer, false));
+      if (it == permissions.end()) {
+        continue;
+      }
+      if (errorCode == 0) {
+        grant(it->second, now, permissionLifetimeMs);
+      } else if (fail(it->second, errorCode, now)) {
+        dropped.push_back(it->second.peer);
+        permissions.erase(it);
+      }
+    }
+  }
+
+  // channels for the next ChannelBind requests (one request each), marked pending.
+  void collectChannels(int64_t now,
+                       std::vector<std::pair<uint16_t, asio::ip::udp::endpoint>>& out) {
+    for (auto it = channels.begin(); it != channels.end();) {
+      Entry& e = it->second;
+      if (stale(e, now)) {
+        channelOfPeer.erase(PeerKey::of(e.peer));
+        it = channels.erase(it);
+        continue;
+      }
+      if (due(e, now, now)) {
+        e.pending = true;
+        out.emplace_back(it->first, e.peer);
+      }
+      ++it;
+    }
+  }
+
+  // outcome of a ChannelBind, errorCode 0 on success. Return true if the channel was given up.
+  bool onChannelResult(uint16_t channel, int errorCode, int64_t now) {
+    auto it = channels.find(channel);
+    if (it == channels.end()) {
+      return false;
+    }
+    if (errorCode != 0) {
+      if (!fail(it->second, errorCode, now)) {
+        return false;
+      }
+      channelOfPeer.erase(PeerKey::of(it->second.peer));
+      channels.erase(it);
+      return true;
+    }
+    grant(it->second, now, channelLifetimeMs);
+
+    // ChannelBind installs or refreshes the permission too.
+    Entry& p = permissions[PeerKey::of(it->second.peer, false)];
+    p.peer = it->second.peer;
+    p.lastActivity = std::max(p.lastActivity, it->second.lastActivity);
+    grant(p, now, permissionLifetimeMs);
+    return false;
+  }
+
+  // earliest time something needs renewal or cleanup, INT64_MAX if nothing.
+  int64_t nextDueAt() const {
+    int64_t at = INT64_MAX;
+    for (auto& pair : permissions) {
+      at = std::min(at, dueAt(pair.second));
+    }
+    for (auto& pair : channels) {
+      at = std::min(at, dueAt(pair.second));
+    }
+    return at;
+  }
+
+  size_t permissionCount() const { return permissions.size(); }
+  size_t channelCount() const { return channels.size(); }
+};
+
+
+}  // namespace HelloCoturn
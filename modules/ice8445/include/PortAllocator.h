@@ -0,0 +1,308 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include "seeker/common.h"
+
+
+namespace HelloCoturn {
+
+
+/*
+Relay port pool of a TURN server (RFC 5766 6.2), with EVEN-PORT and RESERVATION-TOKEN.
+
+Free ports are kept in three hierarchical bitmaps over the range, one bit per port:
+
+  any    the port is free.
+  even   the port is even and free.
+  pair   the port is even and both it and port + 1 are free.
+
+Each bitmap has three levels, 64 ports per leaf word, a summary bit per leaf word and a top
+word over the summaries, which covers the 65536 ports. Finding the next set bit from a
+position is at most three count-trailing-zeros, whatever the range and however full it is,
+so any free port, an even port or an even/odd pair all come in constant time.
+
+Allocations go round the range from a cursor starting at a random port: a released port is
+handed out again only after the rest of the range, and the ports are not predictable from
+the outside.
+
+With a pair, the odd port is held under a random 64-bit RESERVATION-TOKEN until a later
+Allocate redeems it or it expires (reservationLifetimeMs).
+*/
+class PortAllocator {
+ public:
+  static constexpr uint16_t defaultMinPort = 49152;
+  static constexpr uint16_t defaultMaxPort = 65535;
+  static constexpr int64_t reservationLifetimeMs = 30 * 1000;
+
+  // a port owned by somebody, returned to the pool on destruction.
+  class Lease {
+    PortAllocator* pool = nullptr;
+    uint16_t port_ = 0;
+
+   public:
+    Lease() = default;
+    Lease(PortAllocator* pool_, uint16_t port) : pool(pool_), port_(port) {}
+    Lease(Lease&& other) noexcept : pool(other.pool), port_(other.port_) {
+      other.pool = nullptr;
+    }
+    Lease& operator=(Lease&& other) noexcept {
+      if (this != &other) {
+        reset();
+        pool = other.pool;
+        port_ = other.port_;
+        other.pool = nullptr;
+      }
+      return *this;
+    }
+    Lease(const Lease&) = delete;
+    Lease& operator=(const Lease&) = delete;
+    ~Lease() { reset(); }
+
+    void reset() {
+      if (pool != nullptr) {
+        pool->release(port_);
+        pool = nullptr;
+      }
+    }
+
+    uint16_t port() const { return pool != nullptr ? port_ : 0; }
+  };
+
+ private:
+  static constexpr int npos = -1;
+
+  class Bitmap {
+    uint64_t top = 0;
+    uint64_t mid[16] = {};
+    uint64_t leaf[1024] = {};
+
+    static int ctz(uint64_t v) { return seeker::Bits::lowest(v); }
+
+    // first set bit of leaf word w, which must be non zero.
+    int inLeaf(int w) const { return (w << 6) + ctz(leaf[w]); }
+
+    // first set bit below mid word m, which must be non zero.
+    int inMid(int m) const { return inLeaf((m << 6) + ctz(mid[m])); }
+
+   public:
+    void set(int i) {
+      int w = i >> 6;
+      leaf[w] |= 1ULL << (i & 63);
+      mid[w >> 6] |= 1ULL << (w & 63);
+      top |= 1ULL << (w >> 6);
+    }
+
+    void clear(int i) {
+      int w = i >> 6;
+      leaf[w] &= ~(1ULL << (i & 63));
+      if (leaf[w] == 0) {
+        mid[w >> 6] &= ~(1ULL << (w & 63));
+        if (mid[w >> 6] == 0) {
+          top &= ~(1ULL << (w >> 6));
+        }
+      }
+    }
+
+    bool test(int i) const { return (leaf[i >> 6] >> (i & 63)) & 1; }
+
+    // first set bit at or after i, npos if none.
+    int findFrom(int i) const {
+      int w = i >> 6;
+      uint64_t bits = leaf[w] & (~0ULL << (i & 63));
+      if (bits != 0) {
+        return (w << 6) + ctz(bits);
+      }
+      w++;
+      int m = w >> 6;
+      if (m < 16 && (w & 63) != 0) {
+        bits = mid[m] & (~0ULL << (w & 63));
+        if (bits != 0) {
+          return inLeaf((m << 6) + ctz(bits));
+        }
+        m++;
+      }
+      bits = m < 16 ? top & (~0ULL << m) : 0;
+      return bits != 0 ? inMid(ctz(bits)) : npos;
+    }
+
+    // first set bit at or after i, wrapping around to 0.
+    int findNext(int i) const {
+      int rst = findFrom(i);
+      return rst != npos || i == 0 ? rst : findFrom(0);
+    }
+  };
+
+  struct Reservation {
+    uint16_t port;
+    int64_t expireAt;
+  };
+
+  const uint16_t minPort;
+  const uint16_t maxPort;
+  Bitmap any;
+  Bitmap even;
+  Bitmap pair;
+  int cursor;
+  size_t freeCount;
+
+  std::mt19937_64 random;
+  std::unordered_map<uint64_t, Reservation> reservations;
+  std::deque<std::pair<int64_t, uint64_t>> reservationOrder;  // expireAt, token
+
+
+  int index(uint16_t port) const { return port - minPort; }
+
+  // recompute the pair bit of the even port at or below `port`.
+  void updatePair(uint16_t port) {
+    uint16_t base = port & ~1;
+    if (base < minPort || base >= maxPort) {
+      return;
+    }
+    if (any.test(index(base)) && any.test(index(base + 1))) {
+      pair.set(index(base));
+    } else {
+      pair.clear(index(base));
+    }
+  }
+
+  void markUsed(uint16_t port) {
+    any.clear(index(port));
+    if ((port & 1) == 0) {
+      even.clear(index(port));
+    }
+    updatePair(port);
+    freeCount--;
+  }
+
+  void markFree(uint16_t port) {
+    any.set(index(port));
+    if ((port & 1) == 0) {
+      even.set(index(port));
+    }
+    updatePair(port);
+    freeCount++;
+  }
+
+  // take the first port of `bits` from the cursor on, 0 if none.
+  uint16_t take(const Bitmap& bits) {
+    int i = bits.findNext(cursor);
+    if (i == npos) {
+      return 0;
+    }
+    uint16_t port = (uint16_t)(minPort + i);
+    markUsed(port);
+    cursor = i + 1 > maxPort - minPort ? 0 : i + 1;
+    return port;
+  }
+
+
+ public:
+  PortAllocator(uint16_t minPort_, uint16_t maxPort_, uint64_t seed)
+      : minPort(minPort_), maxPort(maxPort_), random(seed) {
+    if (minPort == 0 || minPort > maxPort) {
+      throw std::runtime_error("invalid relay port range.");
+    }
+    for (uint32_t p = minPort; p <= maxPort; p++) {
+      any.set(index((uint16_t)p));
+      if ((p & 1) == 0) {
+        even.set(index((uint16_t)p));
+        if (p < maxPort) {
+          pair.set(index((uint16_t)p));
+        }
+      }
+    }
+    freeCount = (size_t)maxPort - minPort + 1;
+    cursor = (int)(random() % freeCount);
+  }
+
+  PortAllocator(uint16_t minPort_, uint16_t maxPort_)
+      : PortAllocator(minPort_, maxPort_, std::random_device()()) {}
+
+  PortAllocator() : PortAllocator(defaultMinPort, defaultMaxPort) {}
+
+  PortAllocator(const PortAllocator&) = delete;
+  PortAllocator& operator=(const PortAllocator&) = delete;
+
+  // any free port, 0 if the range is exhausted.
+  uint16_t allocate() { return take(any); }
+
+  // an even free port (EVEN-PORT without R), 0 if none.
+  uint16_t allocateEven() { return take(even); }
+
+  /*
+  an even port whose odd neighbour is free too (EVEN-PORT with R). The odd port is reserved
+  under the returned token until redeem() or reservationLifetimeMs. Return 0 if no pair is
+  free.
+  */
+  uint16_t allocatePair(uint64_t& token, int64_t now) {
+    uint16_t port = take(pair);
+    if (port == 0) {
+      return 0;
+    }
+    markUsed(port + 1);
+    do {
+      token = random();
+    } while (token == 0 || reservations.count(token) != 0);
+    int64_t expireAt = now + reservationLifetimeMs;
+    reservations.emplace(token, Reservation{(uint16_t)(port + 1), expireAt});
+    reservationOrder.emplace_back(expireAt, token);
+    return port;
+  }
+
+  // reserved port of the token, now owned by the caller. 0 if unknown or expired.
+  uint16_t redeem(uint64_t token, int64_t now) {
+    auto it = reservations.find(token);
+    if (it == reservations.end()) {
+      return 0;
+    }
+    Reservation r = it->second;
+    reservations.erase(it);
+    if (now >= r.expireAt) {
+      release(r.port);
+      return 0;
+    }
+    return r.port;
+  }
+
+  // claim a specific port, e.g. one configured outside the pool. false if already in use.
+  bool claim(uint16_t port) {
+    if (port < minPort || port > maxPort || !any.test(index(port))) {
+      return false;
+    }
+    markUsed(port);
+    return true;
+  }
+
+  void release(uint16_t port) {
+    if (port < minPort || port > maxPort || any.test(index(port))) {
+      return;
+    }
+    markFree(port);
+  }
+
+  // return the ports of expired reservations to the pool.
+  void expire(int64_t now) {
+    // the lifetime is fixed, so reservationOrder is sorted by expiry.
+    while (!reservationOrder.empty() && reservationOrder.front().first <= now) {
+      auto it = reservations.find(reservationOrder.front().second);
+      if (it != reservations.end() && it->second.expireAt <= now) {
+        release(it->second.port);
+        reservations.erase(it);
+      }
+      reservationOrder.pop_front();
+    }
+  }
+
+  size_t available() const { return freeCount; }
+  size_t reservationCount() const { return reservations.size(); }
+  uint16_t lowest() const { return minPort; }
+  uint16_t highest() const { return maxPort; }
+};
+
+
+}  // namespace HelloCoturn
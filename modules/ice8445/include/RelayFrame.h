@@ -0,0 +1,244 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include "asio.hpp"
+#include "seeker/common.h"
+#include "crc32.h"
+#include "MessageBuilder.h"
+
+
+namespace HelloCoturn {
+
+
+/*
+One relayed packet as three pieces: a prefix built here, the caller's payload referenced in
+place, and a short suffix (padding, FINGERPRINT). buffers() hands them to asio as a buffer
+sequence, which ends in a single sendmsg() with three iovecs, so the payload is never copied
+in user space. The payload must stay alive until the frame is sent.
+
+RFC 5766 11.4.  ChannelData
+   0                   1                   2                   3
+   0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |         Channel Number        |            Length             |
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  /                       Application Data                        /
+  +-------------------------------+-------------------------------+
+
+RFC 5766 10.1.  Send indication, 10.3.  Data indication
+  STUN header | XOR-PEER-ADDRESS | DATA header | payload | padding [| FINGERPRINT]
+
+The parse functions go the other way: they locate the payload inside a received datagram and
+return a pointer into it, without building a StunMessage.
+*/
+class RelayFrame {
+ public:
+  static constexpr size_t maxPayload = 0xFFFF - 64;
+
+ private:
+  static constexpr uint16_t headerLength = 20;
+  // STUN header + XOR-PEER-ADDRESS (IPv6) + DATA attribute header.
+  static constexpr size_t maxPrefix = headerLength + 4 + 20 + 4;
+  // padding + FINGERPRINT.
+  static constexpr size_t maxSuffix = 3 + 8;
+
+  uint8_t prefix[maxPrefix];
+  uint8_t suffix[maxSuffix];
+  size_t prefixLen = 0;
+  size_t suffixLen = 0;
+  const uint8_t* payload = nullptr;
+  size_t payloadSize = 0;
+
+  static size_t padding(size_t len) { return (4 - (len & 3)) & 3; }
+
+  static void checkPayload(size_t size) {
+    if (size > maxPayload) {
+      throw std::runtime_error("relayed payload too large.");
+    }
+  }
+
+  static RelayFrame indication(uint16_t msgType, const uint32_t transId[3],
+                               const asio::ip::udp::endpoint& peer, const uint8_t* data,
+                               size_t size, bool fingerprint);
+
+
+ public:
+  RelayFrame() = default;
+
+  /*
+  ChannelData message. Over UDP the padding is optional and left out, over TCP/TLS set
+  `padded` so the next message starts on a 4 byte boundary.
+  */
+  static RelayFrame channelData(uint16_t channel, const uint8_t* data, size_t size,
+                                bool padded = false) {
+    checkPayload(size);
+    RelayFrame f;
+    seeker::ByteArray::writeData(f.prefix + 0, channel, false);
+    seeker::ByteArray::writeData(f.prefix + 2, (uint16_t)size, false);
+    f.prefixLen = 4;
+    f.payload = data;
+    f.payloadSize = size;
+    if (padded) {
+      f.suffixLen = padding(size);
+      std::memset(f.suffix, 0, f.suffixLen);
+    }
+    return f;
+  }
+
+  /*
+  Send indication carrying `data` to `peer`. With `fingerprint` the CRC is computed across
+  the three pieces, the payload is read once but still not copied.
+  */
+  static RelayFrame sendIndication(const uint32_t transId[3],
+                                   const asio::ip::udp::endpoint& peer, const uint8_t* data,
+                                   size_t size, bool fingerprint = false) {
+    return indication(0x0016, transId, peer, data, size, fingerprint);
+  }
+
+  // Data indication, server to client: `data` was received from `peer`.
+  static RelayFrame dataIndication(const uint32_t transId[3],
+                                   const asio::ip::udp::endpoint& peer, const uint8_t* data,
+                                   size_t size, bool fingerprint = false) {
+    return indication(0x0017, transId, peer, data, size, fingerprint);
+  }
+
+  // true if the datagram is ChannelData (first two bits 01), not a STUN message.
+  static bool isChannelData(const uint8_t* data, size_t size) {
+    return size >= 4 && (data[0] & 0xC0) == 0x40;
+  }
+
+  // return false if the ChannelData is truncated.
+  static bool parseChannelData(const uint8_t* data, size_t size, uint16_t& channel,
+                               const uint8_t*& payloadOut, size_t& payloadSizeOut) {
+    if (!isChannelData(data, size)) {
+      return false;
+    }
+    channel = (uint16_t)((data[0] << 8) | data[1]);
+    payloadSizeOut = (size_t)((data[2] << 8) | data[3]);
+    if (4 + payloadSizeOut > size) {
+      return false;
+    }
+    payloadOut = data + 4;
+    return true;
+  }
+
+  /*
+  XOR-PEER-ADDRESS and DATA of a Send or Data indication, found by walking the attributes in
+  place. Return false if either is missing or the message is malformed. FINGERPRINT is not
+  checked here.
+  */
+  static bool parseIndication(const uint8_t* data, size_t size, asio::ip::udp::endpoint& peer,
+                              const uint8_t*& payloadOut, size_t& payloadSizeOut) {
+    if (size < headerLength || (data[0] & 0xC0) != 0) {
+      return false;
+    }
+    size_t msgLen = (size_t)((data[2] << 8) | data[3]);
+    if (headerLength + msgLen > size) {
+      return false;
+    }
+    uint32_t transId[3];
+    for (int i = 0; i < 3; i++) {
+      seeker::ByteArray::readData((uint8_t*)data + 8 + 4 * i, transId[i], false);
+    }
+
+    bool hasPeer = false;
+    bool hasData = false;
+    size_t pos = headerLength;
+    const size_t end = headerLength + msgLen;
+    while (pos + 4 <= end && !(hasPeer && hasData)) {
+      uint16_t type = (uint16_t)((data[pos] << 8) | data[pos + 1]);
+      size_t len = (size_t)((data[pos + 2] << 8) | data[pos + 3]);
+      const uint8_t* value = data + pos + 4;
+      if (pos + 4 + len > end) {
+        return false;
+      }
+      if (type == (uint16_t)StunAttributeType::XOR_PEER_ADDRESS && !hasPeer) {
+        hasPeer = StunMessage::decodeXorAddress(value, len, transId, peer);
+      } else if (type == (uint16_t)StunAttributeType::DATA && !hasData) {
+        payloadOut = value;
+        payloadSizeOut = len;
+        hasData = true;
+      }
+      pos += 4 + len + padding(len);
+    }
+    return hasPeer && hasData;
+  }
+
+  // prefix, payload, suffix. Empty pieces are zero length buffers.
+  std::array<asio::const_buffer, 3> buffers() const {
+    return {asio::const_buffer(prefix, prefixLen), asio::const_buffer(payload, payloadSize),
+            asio::const_buffer(suffix, suffixLen)};
+  }
+
+  size_t size() const { return prefixLen + payloadSize + suffixLen; }
+
+  const uint8_t* prefixData() const { return prefix; }
+  size_t prefixSize() const { return prefixLen; }
+};
+
+
+inline RelayFrame RelayFrame::indication(uint16_t msgType, const uint32_t transId[3],
+                                         const asio::ip::udp::endpoint& peer,
+                                         const uint8_t* data, size_t size, bool fingerprint) {
+  checkPayload(size);
+  RelayFrame f;
+  uint8_t* p = f.prefix;
+
+  // STUN header, length filled in below.
+  seeker::ByteArray::writeData(p + 0, msgType, false);
+  seeker::ByteArray::writeData(p + 4, (uint32_t)MAGIC_COOKIE, false);
+  seeker::ByteArray::writeData(p + 8, transId[0], false);
+  seeker::ByteArray::writeData(p + 12, transId[1], false);
+  seeker::ByteArray::writeData(p + 16, transId[2], false);
+  size_t pos = headerLength;
+
+  uint8_t xorAddress[20];
+  uint16_t addrLen = (uint16_t)StunMessage::encodeXorAddress(peer, transId, xorAddress);
+  seeker::ByteArray::writeData(p + pos, (uint16_t)StunAttributeType::XOR_PEER_ADDRESS,
+                               false);
+  seeker::ByteArray::writeData(p + pos + 2, addrLen, false);
+  std::memcpy(p + pos + 4, xorAddress, addrLen);
+  pos += 4 + addrLen;
+
+  seeker::ByteArray::writeData(p + pos, (uint16_t)StunAttributeType::DATA, false);
+  seeker::ByteArray::writeData(p + pos + 2, (uint16_t)size, false);
+  pos += 4;
+  f.prefixLen = pos;
+  f.payload = data;
+  f.payloadSize = size;
+
+  f.suffixLen = padding(size);
+  std::memset(f.suffix, 0, f.suffixLen);
+
+  uint16_t msgLen = (uint16_t)(pos - headerLength + size + f.suffixLen);
+  if (fingerprint) {
+    msgLen += 8;
+  }
+  seeker::ByteArray::writeData(p + 2, msgLen, false);
+
+  if (fingerprint) {
+    // RFC 5389 15.5: CRC-32 of everything before the attribute, XOR 0x5354554e.
+    CRC32 crc;
+    crc.add(f.prefix, f.prefixLen);
+    crc.add(f.payload, f.payloadSize);
+    crc.add(f.suffix, f.suffixLen);
+    uint8_t value[4];
+    crc.getHash(value);
+    static const uint8_t fingerprintCookie[4] = {0x53, 0x54, 0x55, 0x4e};
+
+    uint8_t* s = f.suffix + f.suffixLen;
+    seeker::ByteArray::writeData(s, (uint16_t)StunAttributeType::FINGERPRINT, false);
+    seeker::ByteArray::writeData(s + 2, (uint16_t)4, false);
+    for (int i = 0; i < 4; i++) {
+      s[4 + i] = value[i] ^ fingerprintCookie[i];
+    }
+    f.suffixLen += 8;
+  }
+  return f;
+}
+
+
+}  // namespace HelloCoturn
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "hmac.h"
+#include "sha1.h"
+
+
+namespace HelloCoturn {
+
+using std::string;
+
+
+/*
+Time-limited TURN credentials ("TURN REST API", draft-uberti-behave-turn-rest, as coturn's
+use-auth-secret):
+
+  username = expiry ":" userid      expiry in UNIX seconds, ":" userid optional
+  password = base64(HMAC-SHA1(shared secret, username))
+
+A web service that knows the shared secret hands such pairs to its clients, the TURN server
+derives the password from the username alone: no user database, no I/O, and an expired
+username is rejected by comparing a number.
+
+Several secrets can be active at once so they can be rotated without cutting anybody off:
+add the new one, let the web service switch, remove the old one once its usernames have
+expired. A username is accepted if any active secret produced its password, candidates()
+gives one password per secret and the caller keeps the one MESSAGE-INTEGRITY agrees with.
+*/
+class RestCredentials {
+  std::vector<string> secrets;
+
+  static string base64(const uint8_t* data, size_t len) {
+    static const char table[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    string rst;
+    rst.reserve((len + 2) / 3 * 4);
+    for (size_t i = 0; i < len; i += 3) {
+      uint32_t v = (uint32_t)data[i] << 16;
+      if (i + 1 < len) {
+        v |= (uint32_t)data[i + 1] << 8;
+      }
+      if (i + 2 < len) {
+        v |= data[i + 2];
+      }
+      rst += table[(v >> 18) & 0x3F];
+      rst += table[(v >> 12) & 0x3F];
+      rst += i + 1 < len ? table[(v >> 6) & 0x3F] : '=';
+      rst += i + 2 < len ? table[v & 0x3F] : '=';
+    }
+    return rst;
+  }
+
+
+ public:
+  RestCredentials() = default;
+  explicit RestCredentials(const std::vector<string>& secrets_) {
+    for (auto& s : secrets_) {
+      addSecret(s);
+    }
+  }
+
+  // password of username under secret.
+  static string password(const string& username, const string& secret) {
+    uint8_t mac[SHA1::HashBytes];
+    hmac<class SHA1>(username.data(), username.size(), secret.data(), secret.size(), mac);
+    return base64(mac, sizeof(mac));
+  }
+
+  // username valid until expiry (UNIX seconds), userid may be empty.
+  static string username(int64_t expiry, const string& userid) {
+    return userid.empty() ? std::to_string(expiry) : std::to_string(expiry) + ":" + userid;
+  }
+
+  /*
+  expiry of a REST username, -1 if it does not start with a decimal timestamp. Both
+  "expiry:userid" and a bare "expiry" are accepted.
+  */
+  static int64_t expiryOf(const string& username) {
+    int64_t expiry = 0;
+    size_t i = 0;
+    for (; i < username.size() && username[i] != ':'; i++) {
+      char c = username[i];
+      if (c < '0' || c > '9' || i >= 18) {
+        return -1;
+      }
+      expiry = expiry * 10 + (c - '0');
+    }
+    return i == 0 ? -1 : expiry;
+  }
+
+  void addSecret(const string& secret) {
+    if (secret.empty() || std::find(secrets.begin(), secrets.end(), secret) != secrets.end()) {
+      return;
+    }
+    secrets.push_back(secret);
+  }
+
+  void removeSecret(const string& secret) {
+    secrets.erase(std::remove(secrets.begin(), secrets.end(), secret), secrets.end());
+  }
+
+  /*
+  passwords username may have been issued with, newest secret first. Empty if the username
+  is not a REST username or has expired at nowSeconds (UNIX time).
+  */
+  std::vector<string> candidates(const string& username, int64_t nowSeconds) const {
+    std::vector<string> rst;
+    int64_t expiry = expiryOf(username);
+    if (expiry < 0 || nowSeconds >= expiry) {
+      return rst;
+    }
+    for (auto it = secrets.rbegin(); it != secrets.rend(); ++it) {
+      rst.push_back(password(username, *it));
+    }
+    return rst;
+  }
+
+  bool enabled() const { return !secrets.empty(); }
+  size_t secretCount() const { return secrets.size(); }
+};
+
+
+}  // namespace HelloCoturn
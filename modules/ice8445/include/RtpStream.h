@@ -0,0 +1,171 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include "seeker/common.h"
+
+
+namespace HelloCoturn {
+
+
+/*
+Synthetic RTP (RFC 3550) for relay benchmarks.
+
+RtpSource writes packets of a fixed payload size: the 12 byte RTP header, then the send time
+(steady clock, nanoseconds, 8 bytes big endian) and filler. Packets sent for the same ptime
+share the RTP timestamp, like the packets of one video frame.
+
+RtpReceiverStats is the receiver side of RFC 3550 for one SSRC: extended sequence numbers
+(A.1, without the probation), expected and lost packets (A.3), interarrival jitter (A.8, in
+timestamp units, arrival times converted to the media clock), plus the one-way delay from
+the embedded send time, meaningful when sender and receiver share the clock (same host).
+*/
+struct RtpSource {
+  static constexpr size_t headerBytes = 12;
+  static constexpr size_t minPayload = 8;  // the send time
+
+  uint32_t ssrc = 0;
+  uint8_t payloadType = 96;
+  uint16_t sequence = 0;
+  uint32_t timestamp = 0;
+
+  static int64_t nowNs() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+  }
+
+  // one packet at out (headerBytes + payload bytes), stamped with sendNs. Returns its size.
+  size_t write(uint8_t* out, size_t payload, int64_t sendNs) {
+    payload = std::max(payload, minPayload);
+    out[0] = 0x80;  // V=2
+    out[1] = payloadType & 0x7F;
+    seeker::ByteArray::writeData(out + 2, sequence++, false);
+    seeker::ByteArray::writeData(out + 4, timestamp, false);
+    seeker::ByteArray::writeData(out + 8, ssrc, false);
+    seeker::ByteArray::writeData(out + headerBytes, (uint64_t)sendNs, false);
+    std::memset(out + headerBytes + minPayload, 0, payload - minPayload);
+    return headerBytes + payload;
+  }
+
+  // next ptime: clockRate * ptime later.
+  void advance(uint32_t ticks) { timestamp += ticks; }
+};
+
+
+class RtpReceiverStats {
+  static constexpr uint32_t seqMod = 1u << 16;
+  static constexpr uint16_t maxDropout = 3000;
+  static constexpr uint16_t maxMisorder = 100;
+
+  uint32_t clockRate;
+  bool started = false;
+  uint16_t maxSeq = 0;
+  uint32_t cycles = 0;
+  uint32_t baseSeq = 0;
+  uint64_t receivedPackets = 0;
+  uint64_t receivedBytes = 0;
+
+  double jitterTicks = 0;
+  int64_t firstArrivalNs = 0;
+  bool hasTransit = false;
+  int64_t lastTransit = 0;
+
+  int64_t delaySumNs = 0;
+  int64_t delayMaxNs = 0;
+  int64_t delayMinNs = INT64_MAX;
+
+  // RFC 3550 A.1 update_seq, the source is taken as valid from its first packet.
+  void updateSeq(uint16_t seq) {
+    uint16_t delta = (uint16_t)(seq - maxSeq);
+    if (delta < maxDropout) {
+      if (seq < maxSeq) {
+        cycles += seqMod;
+      }
+      maxSeq = seq;
+    } else if (delta <= seqMod - maxMisorder) {
+      // a large jump, restart from it
+      baseSeq = seq;
+      maxSeq = seq;
+      cycles = 0;
+      receivedPackets = 0;
+    }
+    // else a duplicate or reordered packet
+  }
+
+ public:
+  explicit RtpReceiverStats(uint32_t clockRate_ = 90000) : clockRate(clockRate_) {}
+
+  // false if data is no RTP packet of RtpSource.
+  bool onPacket(uint8_t* data, size_t size, int64_t arrivalNs) {
+    if (size < RtpSource::headerBytes + RtpSource::minPayload || (data[0] & 0xC0) != 0x80) {
+      return false;
+    }
+    uint16_t seq;
+    uint32_t timestamp;
+    uint64_t sendNs;
+    seeker::ByteArray::readData(data + 2, seq, false);
+    seeker::ByteArray::readData(data + 4, timestamp, false);
+    seeker::ByteArray::readData(data + RtpSource::headerBytes, sendNs, false);
+
+    if (!started) {
+      started = true;
+      baseSeq = seq;
+      maxSeq = seq;
+    } else {
+      updateSeq(seq);
+    }
+    receivedPackets++;
+    receivedBytes += size;
+
+    // A.8: transit in timestamp units, J += (|D| - J) / 16
+    if (!hasTransit) {
+      firstArrivalNs = arrivalNs;
+    }
+    // from the first arrival: the raw clock in ns times the rate would lose ticks in a double
+    int64_t arrival = (int64_t)((double)(arrivalNs - firstArrivalNs) * clockRate / 1e9);
+    int64_t transit = arrival - (int64_t)timestamp;
+    if (hasTransit) {
+      int64_t d = transit - lastTransit;
+      // timestamps wrap at 32 bits
+      d = (int64_t)(int32_t)(uint32_t)d;
+      jitterTicks += ((double)(d < 0 ? -d : d) - jitterTicks) / 16.0;
+    }
+    hasTransit = true;
+    lastTransit = transit;
+
+    int64_t delay = arrivalNs - (int64_t)sendNs;
+    delaySumNs += delay;
+    delayMaxNs = std::max(delayMaxNs, delay);
+    delayMinNs = std::min(delayMinNs, delay);
+    return true;
+  }
+
+  uint64_t received() const { return receivedPackets; }
+  uint64_t bytes() const { return receivedBytes; }
+
+  uint64_t expected() const {
+    return started ? (uint64_t)cycles + maxSeq - baseSeq + 1 : 0;
+  }
+
+  // negative with duplicates, as in RFC 3550.
+  int64_t lost() const { return (int64_t)expected() - (int64_t)receivedPackets; }
+
+  double lossRate() const {
+    uint64_t e = expected();
+    return e == 0 ? 0.0 : std::max<int64_t>(lost(), 0) / (double)e;
+  }
+
+  double jitterMs() const { return jitterTicks * 1000.0 / clockRate; }
+
+  double meanDelayMs() const {
+    return receivedPackets == 0 ? 0.0 : delaySumNs / 1e6 / receivedPackets;
+  }
+
+  double maxDelayMs() const { return delayMaxNs / 1e6; }
+  double minDelayMs() const { return receivedPackets == 0 ? 0.0 : delayMinNs / 1e6; }
+};
+
+
+}  // namespace HelloCoturn
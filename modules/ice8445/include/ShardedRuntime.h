@@ -0,0 +1,325 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "asio.hpp"
+#include "seeker/loggerApi.h"
+#include "seeker/ringBuffer.h"
+#include "BatchedUdpSocket.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#define HELLO_COTURN_SHARD_AFFINITY 1
+#endif
+
+
+namespace HelloCoturn {
+
+
+/*
+Shared-nothing runtime: one io_context per core, each run by one thread pinned to its CPU.
+
+A shard owns its io_context, its UDP sockets and a State object. Only the shard's own thread
+touches them, so the packet path (socket -> handler -> State -> socket) takes no lock and
+shares no cache line with other cores.
+
+UDP sockets are spread with SO_REUSEPORT: every shard binds its own socket on the same
+address, the kernel hashes each 4-tuple to one of them, so a given client always lands on the
+same shard. Without SO_REUSEPORT (non Linux builds) only shard 0 gets a socket.
+
+Work crossing shards goes through post(), into the target shard's inbox, a seeker::MpscRing.
+Only the first task of a burst wakes the shard with asio::post() (one lock inside asio), the
+shard then runs everything queued meanwhile in one go. Tasks posted from one thread run in
+order. A full inbox spills to asio's own queue until the spilled tasks have run.
+Still meant for control traffic and hand-offs (configuration, statistics, shutdown), not per
+packet.
+*/
+template <typename State>
+class ShardedRuntime {
+ public:
+  struct Shard;
+
+ private:
+  struct Task {
+    virtual ~Task() = default;
+    virtual void run(Shard& shard) = 0;
+  };
+
+  template <typename F>
+  struct TaskOf : Task {
+    F fn;
+    explicit TaskOf(F&& fn_) : fn(std::move(fn_)) {}
+    void run(Shard& shard) override { fn(shard); }
+  };
+
+  static constexpr size_t inboxCapacity = 1024;
+  static constexpr size_t drainBatch = 64;
+
+ public:
+  struct alignas(64) Shard {
+    size_t index = 0;
+    int cpu = -1;  // -1 if not pinned
+    asio::io_context ioContext{1};
+    std::vector<std::unique_ptr<BatchedUdpSocket>> sockets;
+    State state{};
+
+   private:
+    friend class ShardedRuntime;
+    seeker::MpscRing<std::unique_ptr<Task>> inbox{inboxCapacity};
+    std::atomic<bool> drainScheduled{false};
+    std::atomic<size_t> spilled{0};  // tasks that went through asio instead of the inbox
+  };
+
+ private:
+  using WorkGuard = asio::executor_work_guard<asio::io_context::executor_type>;
+
+  std::vector<std::unique_ptr<Shard>> shards;
+  std::vector<WorkGuard> guards;
+  std::vector<std::thread> threads;
+  std::vector<int> cpus;
+  bool pin;
+  std::atomic<bool> running{false};
+
+  static Shard*& currentShard() {
+    static thread_local Shard* shard = nullptr;
+    return shard;
+  }
+
+  // CPUs this process may run on, in order.
+  static std::vector<int> allowedCpus() {
+    std::vector<int> rst;
+#ifdef HELLO_COTURN_SHARD_AFFINITY
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+      for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &set)) {
+          rst.push_back(cpu);
+        }
+      }
+    }
+#endif
+    if (rst.empty()) {
+      unsigned n = std::max(1u, std::thread::hardware_concurrency());
+      for (unsigned i = 0; i < n; i++) {
+        rst.push_back((int)i);
+      }
+    }
+    return rst;
+  }
+
+  static bool pinThread(int cpu) {
+#ifdef HELLO_COTURN_SHARD_AFFINITY
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+  }
+
+  void runShard(Shard& shard) {
+    currentShard() = &shard;
+    if (pin && !pinThread(shard.cpu)) {
+      W_LOG("shard {} could not be pinned to cpu {}", shard.index, shard.cpu);
+      shard.cpu = -1;
+    }
+    try {
+      shard.ioContext.run();
+    } catch (std::exception& e) {
+      E_LOG("shard {} stopped by exception: {}", shard.index, e.what());
+    }
+    currentShard() = nullptr;
+  }
+
+  void scheduleDrain(Shard& s) {
+    if (!s.drainScheduled.exchange(true, std::memory_order_acq_rel)) {
+      asio::post(s.ioContext, [this, &s]() { drain(s); });
+    }
+  }
+
+  // shard thread. Run up to drainBatch tasks from the inbox, return how many.
+  static size_t runInbox(Shard& s) {
+    std::unique_ptr<Task> batch[drainBatch];
+    size_t n = s.inbox.popBatch(batch, drainBatch);
+    for (size_t i = 0; i < n; i++) {
+      batch[i]->run(s);
+      batch[i].reset();
+    }
+    return n;
+  }
+
+  // clearing the flag first makes a task pushed after the pop schedule another drain.
+  void drain(Shard& s) {
+    s.drainScheduled.exchange(false, std::memory_order_acq_rel);
+    if (runInbox(s) == drainBatch) {
+      scheduleDrain(s);  // more may be queued, let the sockets have a turn first
+    }
+  }
+
+  static asio::ip::udp::socket openReusePort(asio::io_context& ioContext,
+                                             const asio::ip::udp::endpoint& local) {
+    asio::ip::udp::socket sock(ioContext);
+    sock.open(local.protocol());
+    sock.set_option(asio::socket_base::reuse_address(true));
+#ifdef SO_REUSEPORT
+    using reusePort = asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+    sock.set_option(reusePort(true));
+#endif
+    sock.bind(local);
+    return sock;
+  }
+
+
+ public:
+  // shardCount 0: one shard per CPU available to the process.
+  explicit ShardedRuntime(size_t shardCount = 0, bool pinToCpu = true)
+      : cpus(allowedCpus()), pin(pinToCpu) {
+    if (shardCount == 0) {
+      shardCount = cpus.size();
+    }
+    for (size_t i = 0; i < shardCount; i++) {
+      std::unique_ptr<Shard> shard(new Shard());
+      shard->index = i;
+      shard->cpu = cpus[i % cpus.size()];
+      guards.emplace_back(asio::make_work_guard(shard->ioContext));
+      shards.push_back(std::move(shard));
+    }
+  }
+
+  ShardedRuntime(const ShardedRuntime&) = delete;
+  ShardedRuntime& operator=(const ShardedRuntime&) = delete;
+
+  ~ShardedRuntime() {
+    stop();
+    join();
+  }
+
+  size_t size() const { return shards.size(); }
+
+  Shard& shard(size_t index) { return *shards.at(index); }
+
+  // shard of the calling thread, nullptr outside of the runtime threads.
+  static Shard* current() { return currentShard(); }
+
+  // map a key (client address hash, allocation id...) to a shard, for work that does not
+  // arrive through a REUSEPORT socket.
+  size_t shardOf(uint64_t hash) const { return (size_t)(hash % shards.size()); }
+
+  /*
+  open one UDP socket per shard bound on `local`, each on its shard's io_context, for owners
+  that wrap the socket themselves (TurnServer). With port 0 the first shard picks a port and
+  the others join it. Without SO_REUSEPORT only shard 0 gets a socket.
+  */
+  std::vector<asio::ip::udp::socket> openUdp(asio::ip::udp::endpoint local) {
+#ifndef SO_REUSEPORT
+    W_LOG("SO_REUSEPORT not available, only shard 0 gets a UDP socket");
+    size_t count = 1;
+#else
+    size_t count = shards.size();
+#endif
+    std::vector<asio::ip::udp::socket> rst;
+    for (size_t i = 0; i < count; i++) {
+      rst.push_back(openReusePort(shards[i]->ioContext, local));
+      if (i == 0) {
+        local = rst[0].local_endpoint();
+      }
+    }
+    return rst;
+  }
+
+  /*
+  bind one BatchedUdpSocket per shard on `local`, see openUdp(). Return the bound endpoint.
+  Call before start(), or from each shard's own thread.
+  */
+  asio::ip::udp::endpoint bindUdp(asio::ip::udp::endpoint local, size_t batch = 64,
+                                  size_t bufferSize = 2048) {
+    auto sockets = openUdp(local);
+    local = sockets[0].local_endpoint();
+    for (size_t i = 0; i < sockets.size(); i++) {
+      Shard& s = *shards[i];
+      s.sockets.emplace_back(
+          new BatchedUdpSocket(s.ioContext, std::move(sockets[i]), batch, bufferSize));
+    }
+    return local;
+  }
+
+  // run fn(Shard&) on the given shard's thread, from any thread.
+  template <typename F>
+  void post(size_t index, F&& fn) {
+    Shard& s = *shards.at(index);
+    using Fn = typename std::decay<F>::type;
+    std::unique_ptr<Task> task(new TaskOf<Fn>(Fn(std::forward<F>(fn))));
+    // while spilled tasks are queued in asio, later ones follow them there to keep the order.
+    if (s.spilled.load(std::memory_order_acquire) == 0 && s.inbox.tryPush(std::move(task))) {
+      scheduleDrain(s);
+      return;
+    }
+    s.spilled.fetch_add(1, std::memory_order_acq_rel);
+    asio::post(s.ioContext, [&s, task = std::move(task)]() {
+      // the inbox may still hold tasks posted before this one by the same thread, maybe
+      // behind a cell another producer has claimed but not filled yet: wait for that one.
+      while (s.inbox.size() > 0) {
+        if (runInbox(s) == 0) {
+          std::this_thread::yield();
+        }
+      }
+      task->run(s);
+      s.spilled.fetch_sub(1, std::memory_order_acq_rel);
+    });
+  }
+
+  // run fn(Shard&) on every shard, each gets its own copy of fn.
+  template <typename F>
+  void postAll(const F& fn) {
+    for (size_t i = 0; i < shards.size(); i++) {
+      post(i, F(fn));
+    }
+  }
+
+  void start() {
+    if (running.exchange(true)) {
+      throw std::runtime_error("ShardedRuntime already started.");
+    }
+    for (auto& s : shards) {
+      Shard* shard = s.get();
+      threads.emplace_back([this, shard]() { runShard(*shard); });
+    }
+    I_LOG("ShardedRuntime started, shards={} pinned={}", shards.size(), pin);
+  }
+
+  // stop every shard, handlers still queued are dropped.
+  void stop() {
+    for (auto& g : guards) {
+      g.reset();
+    }
+    for (auto& s : shards) {
+      s->ioContext.stop();
+    }
+  }
+
+  void join() {
+    for (auto& t : threads) {
+      if (t.joinable()) {
+        t.join();
+      }
+    }
+    threads.clear();
+    running = false;
+  }
+};
+
+
+}  // namespace HelloCoturn
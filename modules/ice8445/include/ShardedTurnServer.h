@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include "asio.hpp"
+#include "seeker/loggerApi.h"
+#include "ShardedRuntime.h"
+#include "TurnServer.h"
+
+
+namespace HelloCoturn {
+
+
+/*
+TurnServer over a ShardedRuntime: every shard runs its own TurnServer on its own SO_REUSEPORT
+socket of the listening address. The kernel keeps a client on one socket, so its requests,
+its allocation and its relayed socket all stay on one core, and shards share nothing on the
+packet path.
+
+What the Options size for one server is split between the shards:
+- [minPort, maxPort] is cut into one slice per shard, relayed ports never collide.
+- maxAllocations is divided between them.
+- userLimit buckets live in one UserRateLimits shared by all shards (locked, control path).
+- with counters, shard i writes counter shard counterShard + i.
+TCP, if enabled, is accepted by shard 0 only.
+*/
+class ShardedTurnServer {
+  using Runtime = ShardedRuntime<std::unique_ptr<TurnServer>>;
+
+  Runtime runtime;
+  asio::ip::udp::endpoint local;
+  bool running = false;
+
+  static size_t shardsFor(size_t shardCount) {
+#ifndef SO_REUSEPORT
+    if (shardCount != 1) {
+      W_LOG("SO_REUSEPORT not available, TurnServer runs on one shard");
+    }
+    return 1;
+#else
+    return shardCount;
+#endif
+  }
+
+
+ public:
+  // shardCount 0: one shard per CPU available to the process.
+  ShardedTurnServer(const asio::ip::udp::endpoint& listen, TurnServer::Options options,
+                    size_t shardCount = 0, bool pinToCpu = true)
+      : runtime(shardsFor(shardCount), pinToCpu) {
+    size_t n = runtime.size();
+    size_t ports = (size_t)options.maxPort - options.minPort + 1;
+    size_t span = (ports / n) & ~(size_t)1;  // even, EVEN-PORT pairs stay in one slice
+    if (options.maxPort < options.minPort || span < 2) {
+      throw std::runtime_error("relay port range too small for the shard count.");
+    }
+    if (!options.userLimits && options.userLimit.bytesPerSecond > 0) {
+      options.userLimits = std::make_shared<UserRateLimits>(options.userLimit);
+    }
+
+    auto sockets = runtime.openUdp(listen);
+    local = sockets[0].local_endpoint();
+    uint16_t minPort = options.minPort;
+    uint16_t maxPort = options.maxPort;
+    size_t maxAllocations = options.maxAllocations;
+    size_t counterShard = options.counterShard;
+    for (size_t i = 0; i < n; i++) {
+      TurnServer::Options o = options;
+      o.minPort = (uint16_t)(minPort + i * span);
+      o.maxPort = i + 1 == n ? maxPort : (uint16_t)(o.minPort + span - 1);
+      o.maxAllocations = (maxAllocations + n - 1) / n;
+      o.counterShard = counterShard + i;
+      o.tcp = options.tcp && i == 0;
+      Runtime::Shard& s = runtime.shard(i);
+      s.state.reset(new TurnServer(s.ioContext, std::move(sockets[i]), o));
+    }
+  }
+
+  ShardedTurnServer(const ShardedTurnServer&) = delete;
+  ShardedTurnServer& operator=(const ShardedTurnServer&) = delete;
+
+  ~ShardedTurnServer() { stop(); }
+
+  void start() {
+    for (size_t i = 0; i < runtime.size(); i++) {
+      runtime.shard(i).state->start();
+    }
+    runtime.start();
+    running = true;
+  }
+
+  // stop every server on its own thread, then the shards.
+  void stop() {
+    if (!running) {
+      return;
+    }
+    forEach([](TurnServer& server) { server.stop(); });
+    runtime.stop();
+    runtime.join();
+    running = false;
+  }
+
+  /*
+  run fn(TurnServer&) for every shard on that shard's thread and wait for it, one shard after
+  the other, so fn may add up statistics without a lock. Not from a shard thread.
+  */
+  template <typename F>
+  void forEach(F fn) {
+    for (size_t i = 0; i < runtime.size(); i++) {
+      if (!running) {
+        fn(*runtime.shard(i).state);
+        continue;
+      }
+      std::promise<void> done;
+      runtime.post(i, [&fn, &done](Runtime::Shard& s) {
+        fn(*s.state);
+        done.set_value();
+      });
+      done.get_future().wait();
+    }
+  }
+
+  size_t size() const { return runtime.size(); }
+
+  asio::ip::udp::endpoint localEndpoint() const { return local; }
+};
+
+
+}  // namespace HelloCoturn
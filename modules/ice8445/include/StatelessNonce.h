@@ -0,0 +1,190 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <string>
+#include "asio.hpp"
+#include "hmac.h"
+#include "sha1.h"
+#include "PermissionCache.h"
+
+
+namespace HelloCoturn {
+
+using std::string;
+
+
+/*
+NONCE values for the long-term credential mechanism (RFC 5389 10.2) that need no state.
+
+A nonce carries its own expiry and a MAC binding it to the client:
+
+  nonce = hex(key id, 1 byte) hex(expiry, 4 bytes, seconds) hex(mac, macBytes)
+  mac   = truncated HMAC-SHA1(secret[key id], key id | expiry | client address | port)
+
+so the server checks a nonce with one HMAC and a comparison, no table of issued nonces and no
+lock around it. A nonce past its expiry is stale (438), and so is one whose MAC does not
+match: the client simply retries with the fresh nonce of the 438.
+
+The secret rotates every `rotationMs`; the previous secret is kept for one more period so the
+nonces issued just before a rotation stay valid until their own expiry, which is why the
+rotation period is never shorter than the nonce lifetime.
+
+Times are milliseconds of the caller's clock, the same clock for generate() and check().
+*/
+class StatelessNonce {
+ public:
+  struct Options {
+    int64_t lifetimeMs = 600 * 1000;
+    int64_t rotationMs = 3600 * 1000;
+    size_t macBytes = 10;  // 80 bits, at most SHA1::HashBytes
+  };
+
+  enum class Result { valid, stale };
+
+ private:
+  static constexpr size_t secretBytes = 20;
+  static constexpr size_t headerBytes = 1 + 4;
+
+  struct Secret {
+    uint8_t id = 0;
+    uint8_t key[secretBytes] = {};
+  };
+
+  Options options;
+  Secret current;
+  Secret previous;
+  bool hasPrevious = false;
+  int64_t nextRotation;
+  std::random_device random;
+
+
+  void renew(Secret& s) {
+    for (size_t i = 0; i < secretBytes; i += 4) {
+      uint32_t r = random();
+      std::memcpy(s.key + i, &r, std::min<size_t>(4, secretBytes - i));
+    }
+  }
+
+  static void mac(const Secret& s, const uint8_t header[headerBytes],
+                  const asio::ip::udp::endpoint& client, uint8_t out[SHA1::HashBytes]) {
+    PeerKey key = PeerKey::of(client);
+    uint8_t data[headerBytes + 16 + 2];
+    std::memcpy(data, header, headerBytes);
+    std::memcpy(data + headerBytes, key.address.data(), 16);
+    data[headerBytes + 16] = (uint8_t)(key.port >> 8);
+    data[headerBytes + 17] = (uint8_t)(key.port & 0xFF);
+    hmac<class SHA1>(data, sizeof(data), s.key, secretBytes, out);
+  }
+
+  static int hexValue(char c) {
+    if (c >= '0' && c <= '9') {
+      return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+      return c - 'a' + 10;
+    }
+    return -1;
+  }
+
+  static void toHex(const uint8_t* data, size_t len, string& out) {
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < len; i++) {
+      out += digits[data[i] >> 4];
+      out += digits[data[i] & 0xF];
+    }
+  }
+
+  static bool fromHex(const string& text, uint8_t* out, size_t len) {
+    if (text.size() != len * 2) {
+      return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+      int hi = hexValue(text[2 * i]);
+      int lo = hexValue(text[2 * i + 1]);
+      if (hi < 0 || lo < 0) {
+        return false;
+      }
+      out[i] = (uint8_t)((hi << 4) | lo);
+    }
+    return true;
+  }
+
+
+ public:
+  StatelessNonce(const Options& options_, int64_t now) : options(options_) {
+    if (options.macBytes == 0 || options.macBytes > SHA1::HashBytes) {
+      options.macBytes = SHA1::HashBytes;
+    }
+    if (options.rotationMs < options.lifetimeMs) {
+      options.rotationMs = options.lifetimeMs;
+    }
+    current.id = (uint8_t)random();
+    renew(current);
+    nextRotation = now + options.rotationMs;
+  }
+
+  explicit StatelessNonce(int64_t now) : StatelessNonce(Options(), now) {}
+
+  StatelessNonce(const StatelessNonce&) = delete;
+  StatelessNonce& operator=(const StatelessNonce&) = delete;
+
+  // a fresh nonce for client, valid for lifetimeMs.
+  string generate(const asio::ip::udp::endpoint& client, int64_t now) const {
+    uint32_t expiry = (uint32_t)((now + options.lifetimeMs) / 1000);
+    uint8_t buf[headerBytes + SHA1::HashBytes];
+    buf[0] = current.id;
+    buf[1] = (uint8_t)(expiry >> 24);
+    buf[2] = (uint8_t)(expiry >> 16);
+    buf[3] = (uint8_t)(expiry >> 8);
+    buf[4] = (uint8_t)expiry;
+    mac(current, buf, client, buf + headerBytes);
+    string rst;
+    rst.reserve((headerBytes + options.macBytes) * 2);
+    toHex(buf, headerBytes + options.macBytes, rst);
+    return rst;
+  }
+
+  Result check(const string& nonce, const asio::ip::udp::endpoint& client, int64_t now) const {
+    uint8_t buf[headerBytes + SHA1::HashBytes];
+    if (!fromHex(nonce, buf, headerBytes + options.macBytes)) {
+      return Result::stale;
+    }
+    const Secret* s = buf[0] == current.id                   ? &current
+                      : hasPrevious && buf[0] == previous.id ? &previous
+                                                             : nullptr;
+    if (s == nullptr) {
+      return Result::stale;
+    }
+    uint32_t expiry = ((uint32_t)buf[1] << 24) | ((uint32_t)buf[2] << 16) |
+                      ((uint32_t)buf[3] << 8) | buf[4];
+    if (now / 1000 >= (int64_t)expiry) {
+      return Result::stale;
+    }
+    uint8_t expected[SHA1::HashBytes];
+    mac(*s, buf, client, expected);
+    uint8_t diff = 0;  // constant time
+    for (size_t i = 0; i < options.macBytes; i++) {
+      diff |= (uint8_t)(expected[i] ^ buf[headerBytes + i]);
+    }
+    return diff == 0 ? Result::valid : Result::stale;
+  }
+
+  // rotate the secret if its period is over. Return true if it rotated.
+  bool rotate(int64_t now) {
+    if (now < nextRotation) {
+      return false;
+    }
+    previous = current;
+    hasPrevious = true;
+    current.id = (uint8_t)(previous.id + 1);
+    renew(current);
+    nextRotation = now + options.rotationMs;
+    return true;
+  }
+};
+
+
+}  // namespace HelloCoturn
@@ -0,0 +1,394 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "asio.hpp"
+#include "seeker/loggerApi.h"
+
+#ifdef HELLOCOTURN_WITH_TLS
+#include "TlsContext.h"
+#endif
+
+
+namespace HelloCoturn {
+
+
+/*
+TURN over TCP (RFC 5766 2.1): a byte stream carrying STUN messages and ChannelData, used by
+TurnClient and TurnServer for the client-server leg. The relayed leg stays UDP.
+
+Framing is length aware, no scanning: a STUN message is 20 bytes of header plus the length
+field, ChannelData 4 bytes plus its length padded to 4 (over a stream it MUST be padded,
+RFC 5766 11.5). Frames are handed out in place from the read buffer, which grows only when
+a frame does not fit.
+
+Writes are coalesced: frames sent while an async_write is in flight are appended to a
+staging buffer, and the whole staging buffer goes out with the next async_write, so a burst
+of small frames costs one write system call. Nagle is disabled, a lone response is not held
+back waiting for an ACK.
+
+With HELLOCOTURN_WITH_TLS, connectTls() runs the same framing over TLS (turns:, RFC 5766
+2.1): the handshake follows the TCP connect and frames queued meanwhile wait for it. The
+TCP connect and the handshake are timed separately, connectMs() and handshakeMs(). close()
+does not send close_notify, a TURN connection carries no data worth a truncation check.
+
+Owned through shared_ptr, pending asio handlers keep the connection alive. close() drops the
+handlers, the close handler is only called for a connection closed by the peer or an error.
+*/
+class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
+ public:
+  // one frame, valid until the handler returns.
+  using FrameHandler = std::function<void(uint8_t* data, size_t size)>;
+  using CloseHandler = std::function<void(const asio::error_code&)>;
+
+  static constexpr size_t maxFrame = 4 + 65535 + 3;
+
+  struct Options {
+    size_t initialReadBuffer = 4096;
+    size_t maxQueuedBytes = 1 << 20;  // frames beyond are dropped, counted in dropped()
+  };
+
+ private:
+  asio::ip::tcp::socket sock;
+  Options options;
+  FrameHandler frameHandler;
+  CloseHandler closeHandler;
+
+  std::vector<uint8_t> in;
+  size_t inSize = 0;
+
+  std::vector<uint8_t> staging;  // frames waiting for the write in flight
+  std::vector<uint8_t> writing;  // the write in flight
+  bool connected = false;
+  bool open = true;
+  uint64_t droppedFrames = 0;
+  int64_t connectUs = -1;
+  int64_t handshakeUs = -1;
+  bool resumedSession = false;
+
+#ifdef HELLOCOTURN_WITH_TLS
+  std::unique_ptr<TlsContext::Stream> tls;
+  string tlsKey;  // host:port, the session cache key
+#endif
+
+  static int64_t nowUs() {
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+  }
+
+  bool usesTls() const {
+#ifdef HELLOCOTURN_WITH_TLS
+    return tls != nullptr;
+#else
+    return false;
+#endif
+  }
+
+  template <typename Handler>
+  void readSome(Handler&& handler) {
+    auto buffer = asio::buffer(in.data() + inSize, in.size() - inSize);
+#ifdef HELLOCOTURN_WITH_TLS
+    if (tls) {
+      tls->async_read_some(buffer, std::forward<Handler>(handler));
+      return;
+    }
+#endif
+    sock.async_read_some(buffer, std::forward<Handler>(handler));
+  }
+
+  template <typename Handler>
+  void writeAll(Handler&& handler) {
+#ifdef HELLOCOTURN_WITH_TLS
+    if (tls) {
+      asio::async_write(*tls, asio::buffer(writing), std::forward<Handler>(handler));
+      return;
+    }
+#endif
+    asio::async_write(sock, asio::buffer(writing), std::forward<Handler>(handler));
+  }
+
+
+  void onClosed(const asio::error_code& ec) {
+    if (!open) {
+      return;
+    }
+    open = false;
+    asio::error_code ignored;
+    sock.close(ignored);
+    CloseHandler h = std::move(closeHandler);
+    frameHandler = nullptr;
+    if (h) {
+      h(ec);
+    }
+  }
+
+  void read() {
+    if (in.size() - inSize < 1024 && in.size() < 2 * maxFrame) {
+      in.resize(std::min(in.size() * 2, 2 * maxFrame));
+    }
+    auto self = shared_from_this();
+    readSome([this, self](const asio::error_code& ec, size_t n) {
+      if (!open) {
+        return;
+      }
+      if (ec) {
+        onClosed(ec);
+        return;
+      }
+      inSize += n;
+      if (deliver()) {
+        read();
+      }
+    });
+  }
+
+  // hand out every complete frame, keep the partial one. false if the stream is broken.
+  bool deliver() {
+    size_t pos = 0;
+    while (open) {
+      size_t len = frameLength(in.data() + pos, inSize - pos);
+      if (len == SIZE_MAX) {
+        W_LOG("TcpConnection: bad frame, closing.");
+        onClosed(asio::error::invalid_argument);
+        return false;
+      }
+      if (len == 0) {
+        break;
+      }
+      // a copy: the handler may replace or drop the handlers while it runs.
+      FrameHandler h = frameHandler;
+      if (h) {
+        h(in.data() + pos, len);
+      }
+      pos += len;
+    }
+    if (!open) {
+      return false;
+    }
+    if (pos > 0) {
+      std::memmove(in.data(), in.data() + pos, inSize - pos);
+      inSize -= pos;
+    }
+    return true;
+  }
+
+  void flush() {
+    if (!connected || !open || !writing.empty() || staging.empty()) {
+      return;
+    }
+    writing.swap(staging);
+    auto self = shared_from_this();
+    writeAll([this, self](const asio::error_code& ec, size_t) {
+      if (!open) {
+        return;
+      }
+      if (ec) {
+        onClosed(ec);
+        return;
+      }
+      writing.clear();
+      flush();
+    });
+  }
+
+  bool admit(size_t size) {
+    if (!open || staging.size() + size > options.maxQueuedBytes) {
+      droppedFrames++;
+      return false;
+    }
+    return true;
+  }
+
+  void started() {
+    connected = true;
+    // sendGather() tries a direct write first, it must not block. Async ops are unaffected.
+    asio::error_code ignored;
+    sock.non_blocking(true, ignored);
+    read();
+    flush();
+  }
+
+  void connectThen(const asio::ip::tcp::endpoint& to, std::function<void()> next) {
+    auto self = shared_from_this();
+    int64_t begin = nowUs();
+    sock.async_connect(to, [this, self, begin, next](const asio::error_code& ec) {
+      if (!open) {
+        return;
+      }
+      if (ec) {
+        onClosed(ec);
+        return;
+      }
+      connectUs = nowUs() - begin;
+      asio::error_code ignored;
+      sock.set_option(asio::ip::tcp::no_delay(true), ignored);
+      next();
+    });
+  }
+
+
+ public:
+  // client side, connect() next.
+  TcpConnection(asio::io_context& ioContext, const Options& options_)
+      : sock(ioContext), options(options_), in(options_.initialReadBuffer) {}
+
+  // server side, an accepted socket.
+  TcpConnection(asio::ip::tcp::socket&& socket, const Options& options_)
+      : sock(std::move(socket)), options(options_), in(options_.initialReadBuffer) {}
+
+  TcpConnection(const TcpConnection&) = delete;
+  TcpConnection& operator=(const TcpConnection&) = delete;
+
+  /*
+  length of the frame at data: 0 if more bytes are needed, SIZE_MAX if data is neither a
+  STUN message nor ChannelData.
+  */
+  static size_t frameLength(const uint8_t* data, size_t available) {
+    if (available < 4) {
+      return 0;
+    }
+    size_t len = (size_t)((data[2] << 8) | data[3]);
+    size_t total;
+    if ((data[0] & 0xC0) == 0x40) {
+      total = 4 + len + ((4 - (len & 3)) & 3);
+    } else if ((data[0] & 0xC0) == 0 && (len & 3) == 0) {
+      total = 20 + len;
+    } else {
+      return SIZE_MAX;
+    }
+    return total <= available ? total : 0;
+  }
+
+  void setHandlers(FrameHandler onFrame, CloseHandler onClose) {
+    frameHandler = std::move(onFrame);
+    closeHandler = std::move(onClose);
+  }
+
+  // start reading an accepted connection.
+  void start() {
+    asio::error_code ec;
+    sock.set_option(asio::ip::tcp::no_delay(true), ec);
+    started();
+  }
+
+  // frames sent before the connection is up are queued.
+  void connect(const asio::ip::tcp::endpoint& to) {
+    connectThen(to, [this]() { started(); });
+  }
+
+#ifdef HELLOCOTURN_WITH_TLS
+  /*
+  connect, then a TLS handshake offering the session cached for serverName (or the address
+  when empty) and port. Frames sent meanwhile are queued until the handshake is done.
+  */
+  void connectTls(const asio::ip::tcp::endpoint& to, TlsContext& context,
+                  const string& serverName) {
+    tls.reset(new TlsContext::Stream(sock, context.context()));
+    tlsKey = (serverName.empty() ? to.address().to_string() : serverName) + ":" +
+             std::to_string(to.port());
+    context.prepare(*tls, &tlsKey, serverName, to.address());
+    auto self = shared_from_this();
+    connectThen(to, [this, self, &context]() {
+      int64_t begin = nowUs();
+      tls->async_handshake(asio::ssl::stream_base::client,
+                           [this, self, &context, begin](const asio::error_code& ec) {
+                             if (!open) {
+                               return;
+                             }
+                             if (ec) {
+                               W_LOG("TcpConnection: TLS handshake with {} failed: {}",
+                                     tlsKey, ec.message());
+                               context.forget(tlsKey);
+                               onClosed(ec);
+                               return;
+                             }
+                             handshakeUs = nowUs() - begin;
+                             resumedSession = context.handshakeDone(*tls);
+                             started();
+                           });
+    });
+  }
+#endif
+
+  // queue one STUN message, which is a multiple of 4 bytes already.
+  void send(const uint8_t* data, size_t size) {
+    if (!admit(size)) {
+      return;
+    }
+    staging.insert(staging.end(), data, data + size);
+    flush();
+  }
+
+  /*
+  send a frame given as a buffer sequence (RelayFrame::buffers()), padded to 4 bytes. On a
+  plain TCP connection with nothing queued, an aligned frame is written straight from the
+  caller's buffers; only what the socket does not take (or any frame behind a queued one,
+  or over TLS) is copied into the staging buffer.
+  */
+  template <typename ConstBufferSequence>
+  void sendGather(const ConstBufferSequence& buffers) {
+    size_t size = asio::buffer_size(buffers);
+    size_t padded = size + ((4 - (size & 3)) & 3);
+    if (!admit(padded)) {
+      return;
+    }
+    size_t sent = 0;
+    if (connected && writing.empty() && staging.empty() && padded == size && !usesTls()) {
+      // an error leaves sent at 0, the async write below reports it: closing here would
+      // call the close handler in the middle of the caller's relay loop.
+      asio::error_code ec;
+      sent = sock.write_some(buffers, ec);
+      if (sent == size) {
+        return;
+      }
+    }
+    size_t at = staging.size();
+    staging.resize(at + padded - sent);
+    uint8_t* out = staging.data() + at;
+    auto end = asio::buffer_sequence_end(buffers);
+    for (auto it = asio::buffer_sequence_begin(buffers); it != end; ++it) {
+      asio::const_buffer b = *it;
+      if (sent >= b.size()) {
+        sent -= b.size();
+        continue;
+      }
+      b += sent;
+      sent = 0;
+      std::memcpy(out, b.data(), b.size());
+      out += b.size();
+    }
+    std::memset(out, 0, staging.data() + staging.size() - out);
+    flush();
+  }
+
+  // close without calling the close handler.
+  void close() {
+    closeHandler = nullptr;
+    onClosed(asio::error_code());
+  }
+
+  bool isOpen() const { return open; }
+  bool isConnected() const { return open && connected; }
+  size_t queuedBytes() const { return staging.size() + writing.size(); }
+  uint64_t dropped() const { return droppedFrames; }
+  // TCP connect of a client connection, -1 before it is done or for an accepted one.
+  double connectMs() const { return connectUs < 0 ? -1 : connectUs / 1000.0; }
+  // TLS handshake, -1 without TLS or before it is done.
+  double handshakeMs() const { return handshakeUs < 0 ? -1 : handshakeUs / 1000.0; }
+  bool resumed() const { return resumedSession; }
+  asio::ip::tcp::socket& socket() { return sock; }
+
+  asio::ip::tcp::endpoint remoteEndpoint() const {
+    asio::error_code ec;
+    return sock.remote_endpoint(ec);
+  }
+};
+
+
+}  // namespace HelloCoturn
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "asio.hpp"
+#include "asio/ssl.hpp"
+#include "seeker/loggerApi.h"
+
+#ifndef CA_CERT_FILE
+#define CA_CERT_FILE "./resources/ca-bundle.crt"
+#endif
+
+
+namespace HelloCoturn {
+
+using std::string;
+
+
+/*
+Client side TLS for TURN over TLS (RFC 5766 2.1), shared by the whole process.
+
+One asio::ssl::context: the CA bundle is parsed once, by the first call to global(), and
+every connection verifies against the same in-memory store instead of reading the file per
+handshake.
+
+Sessions are cached per server. OpenSSL hands every new session (with TLS 1.3, every ticket
+the server sends after the handshake) to onNewSession, which keeps the latest one for the
+server of the connection; the next handshake to that server offers it and, when the server
+accepts, skips the certificate exchange and verification. A TLS 1.3 ticket is meant for one
+use, the resumed handshake brings a fresh one.
+
+Thread safe, connections of several io_context threads may share it.
+*/
+class TlsContext {
+ public:
+  using Stream = asio::ssl::stream<asio::ip::tcp::socket&>;
+
+  struct Options {
+    string caFile = CA_CERT_FILE;
+    bool verifyPeer = true;
+    size_t maxCachedSessions = 1024;
+  };
+
+  struct Stats {
+    uint64_t handshakes = 0;
+    uint64_t resumed = 0;
+  };
+
+ private:
+  Options options;
+  asio::ssl::context ctx;
+
+  std::mutex mutex;
+  std::unordered_map<string, SSL_SESSION*> sessions;
+  Stats stats;
+
+
+  // ex_data slots of our own, asio keeps its verify and password callbacks in the app data.
+  static int contextSlot() {
+    static int slot = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    return slot;
+  }
+
+  static int keySlot() {
+    static int slot = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    return slot;
+  }
+
+  /*
+  new session of a connection, its key was set by prepare(). A copy is kept: OpenSSL marks
+  the session of a connection freed without close_notify as not resumable, and a TURN
+  connection is simply closed.
+  */
+  static int onNewSession(SSL* ssl, SSL_SESSION* session) {
+    auto* self =
+        static_cast<TlsContext*>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), contextSlot()));
+    auto* key = static_cast<const string*>(SSL_get_ex_data(ssl, keySlot()));
+    if (self == nullptr || key == nullptr || !SSL_SESSION_is_resumable(session)) {
+      return 0;
+    }
+    std::lock_guard<std::mutex> lock(self->mutex);
+    auto it = self->sessions.find(*key);
+    if (it != self->sessions.end()) {
+      SSL_SESSION_free(it->second);
+      it->second = SSL_SESSION_dup(session);
+    } else if (self->sessions.size() < self->options.maxCachedSessions) {
+      self->sessions.emplace(*key, SSL_SESSION_dup(session));
+    }
+    return 0;
+  }
+
+  explicit TlsContext(const Options& options_)
+      : options(options_), ctx(asio::ssl::context::tls_client) {
+    ctx.set_options(asio::ssl::context::default_workarounds | asio::ssl::context::no_sslv2 |
+                    asio::ssl::context::no_sslv3);
+    if (options.verifyPeer) {
+      ctx.load_verify_file(options.caFile);
+      ctx.set_verify_mode(asio::ssl::verify_peer);
+    } else {
+      ctx.set_verify_mode(asio::ssl::verify_none);
+    }
+    SSL_CTX* native = ctx.native_handle();
+    SSL_CTX_set_ex_data(native, contextSlot(), this);
+    SSL_CTX_set_session_cache_mode(native,
+                                   SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(native, &TlsContext::onNewSession);
+    I_LOG("TlsContext ready, verify={} ca={}", options.verifyPeer, options.caFile);
+  }
+
+
+ public:
+  TlsContext(const TlsContext&) = delete;
+  TlsContext& operator=(const TlsContext&) = delete;
+
+  ~TlsContext() { clear(); }
+
+  /*
+  the context of the process, created by the first call with its options; the options of
+  later calls are ignored. Throws asio::system_error when the CA bundle cannot be read.
+  */
+  static TlsContext& global(const Options& options) {
+    static TlsContext instance(options);
+    return instance;
+  }
+
+  static TlsContext& global() { return global(Options()); }
+
+  asio::ssl::context& context() { return ctx; }
+
+  /*
+  set up a stream before its handshake with the server known as key (host:port, must live
+  as long as the stream) at address: SNI for serverName when it is not empty, a certificate
+  check against serverName, or against address (an IP subjectAltName) without a name, and
+  the cached session of that server if any.
+  */
+  void prepare(Stream& stream, const string* key, const string& serverName,
+               const asio::ip::address& address) {
+    SSL* ssl = stream.native_handle();
+    SSL_set_ex_data(ssl, keySlot(), const_cast<string*>(key));
+    if (!serverName.empty()) {
+      SSL_set_tlsext_host_name(ssl, serverName.c_str());
+    }
+    if (options.verifyPeer) {
+      string host = serverName.empty() ? address.to_string() : serverName;
+      stream.set_verify_callback(asio::ssl::host_name_verification(host));
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = sessions.find(*key);
+    if (it != sessions.end()) {
+      SSL_set_session(ssl, it->second);
+    }
+  }
+
+  // count a finished handshake, true if it resumed a cached session.
+  bool handshakeDone(Stream& stream) {
+    bool resumed = SSL_session_reused(stream.native_handle()) == 1;
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.handshakes++;
+    stats.resumed += resumed ? 1 : 0;
+    return resumed;
+  }
+
+  // drop the session of a server, after a failed handshake for instance.
+  void forget(const string& key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = sessions.find(key);
+    if (it != sessions.end()) {
+      SSL_SESSION_free(it->second);
+      sessions.erase(it);
+    }
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& pair : sessions) {
+      SSL_SESSION_free(pair.second);
+    }
+    sessions.clear();
+  }
+
+  size_t cachedSessions() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return sessions.size();
+  }
+
+  Stats statistics() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+  }
+};
+
+
+}  // namespace HelloCoturn
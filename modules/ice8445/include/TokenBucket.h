@@ -0,0 +1,201 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+
+namespace HelloCoturn {
+
+using std::string;
+
+
+// bandwidth cap, 0 bytesPerSecond: unlimited. burstBytes 0: one second worth of rate.
+struct RateLimit {
+  uint64_t bytesPerSecond = 0;
+  uint64_t burstBytes = 0;
+};
+
+
+/*
+Token bucket kept as a single 64-bit word, the time at which the bucket would be full again
+(the "theoretical arrival time" of GCRA, which is the same policy as a token bucket of
+depth burstBytes filled at bytesPerSecond).
+
+Taking n bytes at time t:
+
+  tat' = max(tat, t) + n / rate
+  pass if tat' - t <= burst / rate, then store tat'
+
+There is no refill step and no timer, the refill is implied by t moving on, so the caller
+passes the coarse clock it already has (TurnServer reads it once per batch). take() commits
+with one compare-and-swap and can be shared between threads; takeLocal() is the same
+arithmetic with a plain store, for a bucket only its own shard touches.
+
+A packet larger than the burst never passes.
+*/
+class TokenBucket {
+  std::atomic<int64_t> tat{0};  // ns
+  int64_t bytesPerSecond = 0;
+  int64_t toleranceNs = 0;
+
+  std::atomic<uint64_t> passedBytes{0};
+  std::atomic<uint64_t> droppedPackets{0};
+  std::atomic<uint64_t> droppedBytes{0};
+
+  int64_t costNs(size_t bytes) const {
+    return (int64_t)((double)bytes * 1e9 / (double)bytesPerSecond);
+  }
+
+  void drop(size_t bytes) {
+    droppedPackets.fetch_add(1, std::memory_order_relaxed);
+    droppedBytes.fetch_add(bytes, std::memory_order_relaxed);
+  }
+
+  void pass(size_t bytes) { passedBytes.fetch_add(bytes, std::memory_order_relaxed); }
+
+
+ public:
+  TokenBucket() = default;
+  explicit TokenBucket(const RateLimit& limit) { configure(limit); }
+
+  TokenBucket(const TokenBucket&) = delete;
+  TokenBucket& operator=(const TokenBucket&) = delete;
+
+  // not synchronized with take(), set it before the bucket is shared.
+  void configure(const RateLimit& limit) {
+    bytesPerSecond = (int64_t)limit.bytesPerSecond;
+    if (bytesPerSecond > 0) {
+      uint64_t burst = limit.burstBytes > 0 ? limit.burstBytes : limit.bytesPerSecond;
+      toleranceNs = costNs(burst);
+    }
+  }
+
+  bool unlimited() const { return bytesPerSecond == 0; }
+
+  // take bytes at nowMs, false (and counted as dropped) if the bucket is short.
+  bool take(size_t bytes, int64_t nowMs) {
+    if (unlimited()) {
+      pass(bytes);
+      return true;
+    }
+    const int64_t now = nowMs * 1000000;
+    const int64_t cost = costNs(bytes);
+    int64_t current = tat.load(std::memory_order_relaxed);
+    for (;;) {
+      int64_t next = std::max(current, now) + cost;
+      if (next - now > toleranceNs) {
+        drop(bytes);
+        return false;
+      }
+      if (tat.compare_exchange_weak(current, next, std::memory_order_relaxed)) {
+        pass(bytes);
+        return true;
+      }
+    }
+  }
+
+  // take() for a bucket only the calling thread updates.
+  bool takeLocal(size_t bytes, int64_t nowMs) {
+    if (unlimited()) {
+      passedBytes.store(passedBytes.load(std::memory_order_relaxed) + bytes,
+                        std::memory_order_relaxed);
+      return true;
+    }
+    const int64_t now = nowMs * 1000000;
+    int64_t next = std::max(tat.load(std::memory_order_relaxed), now) + costNs(bytes);
+    if (next - now > toleranceNs) {
+      droppedPackets.store(droppedPackets.load(std::memory_order_relaxed) + 1,
+                           std::memory_order_relaxed);
+      droppedBytes.store(droppedBytes.load(std::memory_order_relaxed) + bytes,
+                         std::memory_order_relaxed);
+      return false;
+    }
+    tat.store(next, std::memory_order_relaxed);
+    passedBytes.store(passedBytes.load(std::memory_order_relaxed) + bytes,
+                      std::memory_order_relaxed);
+    return true;
+  }
+
+  // give back bytes taken for a packet that was dropped further on.
+  void refund(size_t bytes) {
+    if (!unlimited()) {
+      tat.fetch_sub(costNs(bytes), std::memory_order_relaxed);
+    }
+    passedBytes.fetch_sub(bytes, std::memory_order_relaxed);
+  }
+
+  uint64_t passed() const { return passedBytes.load(std::memory_order_relaxed); }
+  uint64_t dropped() const { return droppedPackets.load(std::memory_order_relaxed); }
+  uint64_t droppedVolume() const { return droppedBytes.load(std::memory_order_relaxed); }
+};
+
+
+/*
+user -> allocation limits: a packet of an allocation passes if its own bucket (shard local)
+and then its user's bucket (shared by all the user's allocations, possibly across shards,
+hence take() with CAS) both have room. When the user's bucket is short the bytes go back to
+the allocation's.
+*/
+inline bool takeHierarchical(TokenBucket& allocation, TokenBucket* user, size_t bytes,
+                             int64_t nowMs) {
+  if (!allocation.takeLocal(bytes, nowMs)) {
+    return false;
+  }
+  if (user != nullptr && !user->take(bytes, nowMs)) {
+    allocation.refund(bytes);
+    return false;
+  }
+  return true;
+}
+
+
+/*
+User buckets shared by the allocations of a user, handed out at allocation time. Entries are
+weak, a user's bucket goes away with its last allocation. One instance may be shared by the
+TurnServers of several shards, bucketOf() is locked and meant for the control path only.
+*/
+class UserRateLimits {
+  std::mutex mutex;
+  RateLimit limit;
+  std::unordered_map<string, std::weak_ptr<TokenBucket>> buckets;
+  size_t purgeAt = 64;
+
+ public:
+  explicit UserRateLimits(const RateLimit& limit_) : limit(limit_) {}
+
+  UserRateLimits(const UserRateLimits&) = delete;
+  UserRateLimits& operator=(const UserRateLimits&) = delete;
+
+  // bucket of user, created on first use. nullptr if users are not limited.
+  std::shared_ptr<TokenBucket> bucketOf(const string& user) {
+    if (limit.bytesPerSecond == 0) {
+      return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<TokenBucket> rst = buckets[user].lock();
+    if (!rst) {
+      rst = std::make_shared<TokenBucket>(limit);
+      buckets[user] = rst;
+    }
+    if (buckets.size() >= purgeAt) {
+      for (auto it = buckets.begin(); it != buckets.end();) {
+        it = it->second.expired() ? buckets.erase(it) : std::next(it);
+      }
+      purgeAt = std::max<size_t>(64, buckets.size() * 2);
+    }
+    return rst;
+  }
+
+  size_t size() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return buckets.size();
+  }
+};
+
+
+}  // namespace HelloCoturn
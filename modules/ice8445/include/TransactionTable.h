@@ -0,0 +1,264 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include "seeker/common.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HELLO_COTURN_TRANS_TABLE_SSE2 1
+#endif
+
+
+/*
+Outstanding STUN transactions, keyed by the 96-bit transaction ID.
+
+Layout:
+  ctrl  [capacity + GroupWidth]  1 byte per slot: 0x80 = empty, otherwise 7-bit fingerprint.
+                                 The first GroupWidth bytes are mirrored at the end, so a
+                                 group load never has to wrap.
+  slots [capacity]               key + timeout metadata + value, stored inline.
+
+Linear probing, scanned GroupWidth slots at a time with one SIMD compare. Deletion shifts
+later entries of the same probe run backward (Knuth, Algorithm R), so no tombstone ever
+lengthens a probe and the table never needs a rehash.
+
+All memory is allocated once in the constructor, capacity never changes.
+*/
+
+namespace HelloCoturn {
+
+
+struct TransactionKey {
+  uint32_t id[3];
+
+  TransactionKey() : id{0, 0, 0} {}
+  TransactionKey(const uint32_t transId[3]) : id{transId[0], transId[1], transId[2]} {}
+
+  bool operator==(const TransactionKey& other) const {
+    return id[0] == other.id[0] && id[1] == other.id[1] && id[2] == other.id[2];
+  }
+  bool operator!=(const TransactionKey& other) const { return !(*this == other); }
+};
+
+
+
+template <typename V>
+class TransactionTable {
+ public:
+  struct Slot {
+    TransactionKey key;
+    // timeout metadata, owned by the caller (retransmission / expiry logic).
+    uint16_t attempts = 0;
+    uint16_t rtoMs = 0;
+    int64_t deadline = 0;
+    V value{};
+  };
+
+  static constexpr size_t GroupWidth = 16;
+
+ private:
+  static constexpr uint8_t ctrlEmpty = 0x80;
+
+  size_t capacity;
+  size_t mask;
+  size_t maxSize;
+  size_t count = 0;
+
+  std::unique_ptr<uint8_t[]> ctrl;
+  std::unique_ptr<Slot[]> slots;
+
+
+  static uint64_t hashKey(const TransactionKey& key) {
+    // transaction ids are random, a cheap multiplicative mix is enough.
+    uint64_t h = ((uint64_t)key.id[0] << 32) | key.id[1];
+    h ^= (uint64_t)key.id[2] * 0x9E3779B97F4A7C15ULL;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 31;
+    return h;
+  }
+
+  static uint8_t fingerprint(uint64_t h) { return (uint8_t)(h >> 57); }
+
+  size_t homeIndex(uint64_t h) const { return (size_t)h & mask; }
+
+  void setCtrl(size_t i, uint8_t v) {
+    ctrl[i] = v;
+    if (i < GroupWidth) {
+      ctrl[capacity + i] = v;
+    }
+  }
+
+  // bit i set if ctrl[pos + i] == v.
+  uint32_t matchByte(size_t pos, uint8_t v) const {
+#ifdef HELLO_COTURN_TRANS_TABLE_SSE2
+    __m128i group = _mm_loadu_si128((const __m128i*)(ctrl.get() + pos));
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)v)));
+#else
+    uint32_t bits = 0;
+    const uint8_t* g = ctrl.get() + pos;
+    for (size_t i = 0; i < GroupWidth; i++) {
+      bits |= (uint32_t)(g[i] == v) << i;
+    }
+    return bits;
+#endif
+  }
+
+  static unsigned lowestBit(uint32_t bits) { return (unsigned)seeker::Bits::lowest(bits); }
+
+  // slot index of key, or capacity if not present.
+  size_t findIndex(const TransactionKey& key) const {
+    uint64_t h = hashKey(key);
+    uint8_t fp = fingerprint(h);
+    size_t pos = homeIndex(h);
+
+    for (size_t probed = 0; probed < capacity; probed += GroupWidth) {
+      uint32_t candidates = matchByte(pos, fp);
+      uint32_t empties = matchByte(pos, ctrlEmpty);
+      if (empties) {
+        // a probe run ends at the first empty slot.
+        candidates &= (empties & (0u - empties)) - 1;
+      }
+      while (candidates) {
+        size_t i = (pos + lowestBit(candidates)) & mask;
+        if (slots[i].key == key) {
+          return i;
+        }
+        candidates &= candidates - 1;
+      }
+      if (empties) {
+        return capacity;
+      }
+      pos = (pos + GroupWidth) & mask;
+    }
+    return capacity;
+  }
+
+  // first empty slot at or after home, table must not be full.
+  size_t findEmpty(size_t pos) const {
+    for (;;) {
+      uint32_t empties = matchByte(pos, ctrlEmpty);
+      if (empties) {
+        return (pos + lowestBit(empties)) & mask;
+      }
+      pos = (pos + GroupWidth) & mask;
+    }
+  }
+
+  void eraseIndex(size_t i) {
+    size_t j = i;
+    for (;;) {
+      j = (j + 1) & mask;
+      if (ctrl[j] == ctrlEmpty) {
+        break;
+      }
+      size_t home = homeIndex(hashKey(slots[j].key));
+      // slot j may fill the hole at i only if its home is not in the cyclic range (i, j].
+      bool homeInRange = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+      if (!homeInRange) {
+        slots[i] = std::move(slots[j]);
+        setCtrl(i, ctrl[j]);
+        i = j;
+      }
+    }
+    slots[i] = Slot{};
+    setCtrl(i, ctrlEmpty);
+    count--;
+  }
+
+
+ public:
+  // maxOutstanding: the most transactions that will ever be in flight at once. Load factor is
+  // kept at or below 7/8 of it.
+  explicit TransactionTable(size_t maxOutstanding) {
+    size_t want = maxOutstanding + maxOutstanding / 7 + 1;
+    capacity = GroupWidth;
+    while (capacity < want) {
+      capacity <<= 1;
+    }
+    mask = capacity - 1;
+    maxSize = maxOutstanding;
+
+    ctrl.reset(new uint8_t[capacity + GroupWidth]);
+    std::memset(ctrl.get(), ctrlEmpty, capacity + GroupWidth);
+    slots.reset(new Slot[capacity]);
+  }
+
+  TransactionTable(const TransactionTable&) = delete;
+  TransactionTable& operator=(const TransactionTable&) = delete;
+
+
+  // return nullptr if key already exists or table is full.
+  Slot* insert(const TransactionKey& key, V value, int64_t deadline = 0) {
+    if (count >= maxSize || findIndex(key) != capacity) {
+      return nullptr;
+    }
+    uint64_t h = hashKey(key);
+    size_t i = findEmpty(homeIndex(h));
+    setCtrl(i, fingerprint(h));
+
+    Slot& s = slots[i];
+    s.key = key;
+    s.attempts = 0;
+    s.rtoMs = 0;
+    s.deadline = deadline;
+    s.value = std::move(value);
+    count++;
+    return &s;
+  }
+
+  Slot* find(const TransactionKey& key) {
+    size_t i = findIndex(key);
+    return i == capacity ? nullptr : &slots[i];
+  }
+
+  const Slot* find(const TransactionKey& key) const {
+    size_t i = findIndex(key);
+    return i == capacity ? nullptr : &slots[i];
+  }
+
+  bool erase(const TransactionKey& key) {
+    size_t i = findIndex(key);
+    if (i == capacity) {
+      return false;
+    }
+    eraseIndex(i);
+    return true;
+  }
+
+  // look up and remove in one probe, typical for a matching response.
+  bool take(const TransactionKey& key, Slot& out) {
+    size_t i = findIndex(key);
+    if (i == capacity) {
+      return false;
+    }
+    out = std::move(slots[i]);
+    eraseIndex(i);
+    return true;
+  }
+
+  // visit every live slot. Do not insert or erase from within fn.
+  template <typename F>
+  void forEach(F&& fn) {
+    for (size_t i = 0; i < capacity; i++) {
+      if (ctrl[i] != ctrlEmpty) {
+        fn(slots[i]);
+      }
+    }
+  }
+
+  size_t size() const { return count; }
+  size_t maxOutstanding() const { return maxSize; }
+  size_t slotCapacity() const { return capacity; }
+
+  size_t memoryBytes() const {
+    return sizeof(*this) + capacity + GroupWidth + capacity * sizeof(Slot);
+  }
+};
+
+
+
+}  // namespace HelloCoturn
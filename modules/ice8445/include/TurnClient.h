@@ -0,0 +1,802 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "asio.hpp"
+#include "seeker/loggerApi.h"
+#include "seeker/random.h"
+#include "seeker/timingWheel.h"
+#include "AllocationManager.h"
+#include "MessageBuilder.h"
+#include "TcpConnection.h"
+
+
+namespace HelloCoturn {
+
+using std::string;
+
+
+/*
+Client side TURN flows (Allocate, CreatePermission, ChannelBind, Refresh) as asio
+asynchronous operations, so a session setup reads as straight-line code instead of a chain
+of callbacks.
+
+Every operation takes a completion token and completes with a typed result:
+
+  allocate(token)                        void(AllocateResult)
+  createPermission(peers, token)         void(int errorCode)
+  bindChannel(channel, peer, token)      void(int errorCode)
+  refresh(lifetime, token)               void(int errorCode)
+  setup(peers, token)                    void(SetupResult)
+
+errorCode is 0 on success, the STUN error code of the response, or 408 after the last
+retransmission (RFC 5389 7.2.1, RTO doubling from retransmitMs, maxAttempts sends). The 401
+challenge of the first request and 438 (Stale Nonce) are answered inside the operation with
+the REALM / NONCE of the error response.
+
+With a plain callback the handler is invoked inline on the io_context thread. Written as an
+asio::coroutine (asio/yield.hpp, stackless, C++11) the whole flow is one small function object
+that is moved from one operation to the next:
+
+  reenter (this) {
+    yield session->allocate(std::move(*this));
+    yield session->createPermission({peer}, std::move(*this));
+    yield session->bindChannel(0x4000, peer, std::move(*this));
+  }
+
+and where asio has co_await (ASIO_HAS_CO_AWAIT, C++20 coroutines) asio::use_awaitable is a
+token like any other: `AllocateResult r = co_await session->allocate(asio::use_awaitable);`.
+
+Handlers are not allocated per hop: sessions, with their socket and inline storage for the
+pending handler, come from a pool and are recycled by close(). All sessions share one
+receive buffer (readiness is awaited with async_wait, the datagram read without blocking)
+and one timing wheel for retransmissions.
+
+setup() is the pipelined session setup: Allocate, and as soon as its success response is in,
+one CreatePermission for all peers plus a ChannelBind per peer, all sent back to back with
+the NONCE the Allocate just used. Each request is its own transaction with its own
+retransmissions, responses are matched by transaction id in whatever order they come, so the
+setup costs two round trips (three with the 401 challenge) instead of one per request.
+SetupResult tells when the first permission or channel was in place, the earliest a packet
+could be relayed.
+
+With Options::transport tcp every session talks to the server over its own TcpConnection
+(the relayed leg stays UDP, REQUESTED-TRANSPORT is still UDP). Requests are not retransmitted
+on a stream, a transaction times out after tcpTimeoutMs (RFC 5389 7.2.2), and a lost
+connection fails the pending operation with 408 at once. Connections are reused: closing a
+session that holds no allocation, never allocated or released with refresh(0), parks its
+connection and the next open() takes it instead of doing a new handshake. An allocation
+made over TCP lives as long as its connection, so closing a session that still holds one
+closes the connection.
+
+Transport tls (built with HELLOCOTURN_WITH_TLS) is the same over TLS. Every connection uses
+the process-wide TlsContext::global(), created with its defaults unless the application
+created it first, and offers the TLS session cached for the server, so only the first
+connection to a server does a full handshake. serverName is sent as SNI and checked against
+the certificate, without one the certificate must carry the server's IP address. The TCP
+connect and TLS handshake of a session's new connection are in SetupResult next to setupMs,
+which includes them.
+
+One operation at a time per session, though an operation may run several transactions. Not
+thread safe, use one TurnClient per io_context thread.
+*/
+class TurnClient {
+ public:
+  enum class Transport : uint8_t { udp, tcp, tls };
+
+  struct Options {
+    string username;  // empty: no long-term credentials
+    string password;
+    uint32_t lifetime = 600;  // requested by allocate(), seconds
+    uint32_t retransmitMs = 500;
+    uint16_t maxAttempts = 7;
+    uint16_t maxNonceRetries = 3;
+    size_t maxSessions = 100000;
+    Transport transport = Transport::udp;
+    string serverName;  // tls: SNI and certificate host name, empty: check the IP address
+    uint32_t tcpTimeoutMs = 39500;
+    size_t maxIdleConnections = 1024;
+    TcpConnection::Options tcpConnection;
+  };
+
+  struct AllocateResult {
+    int errorCode = 0;
+    asio::ip::udp::endpoint relayed;
+    asio::ip::udp::endpoint mapped;
+    uint32_t lifetime = 0;
+  };
+
+  // times in milliseconds since setup() was called.
+  struct SetupResult {
+    int errorCode = 0;  // of the first failed request, 0 if all succeeded
+    AllocateResult allocation;
+    bool permitted = false;          // CreatePermission succeeded
+    std::vector<uint16_t> channels;  // channel of peers[i], 0 if its ChannelBind failed
+    int64_t allocatedMs = 0;
+    int64_t firstRelayMs = -1;  // first permission or channel in place, -1 if none
+    int64_t setupMs = 0;        // last response
+    // new connection of a tcp / tls session, -1 for a reused one or udp
+    double connectMs = -1;
+    double handshakeMs = -1;
+    bool resumed = false;  // the TLS handshake resumed a cached session
+  };
+
+  static constexpr uint16_t firstChannel = 0x4000;
+  static constexpr size_t maxSetupPeers = 0x7FFF - firstChannel + 1;
+
+  class Session;
+
+ private:
+  static constexpr size_t inlineHandlerBytes = 128;
+  static constexpr size_t receiveBufferBytes = 2048;
+
+  // pending completion handler, type erased, living in its session's handler storage.
+  class Completion {
+   public:
+    virtual ~Completion() = default;
+    // destroys *this before the handler runs, the handler may start the next operation.
+    virtual void complete(Session& s, int errorCode, StunMessage* response) = 0;
+  };
+
+  static void resultOf(Session&, int errorCode, StunMessage* response, AllocateResult& out) {
+    out.errorCode = errorCode;
+    if (errorCode == 0 && response != nullptr) {
+      response->getAttr_XOR_RELAYED_ADDRESS(out.relayed);
+      response->getAttr_XOR_MAPPED_ADDRESS(out.mapped);
+      response->getAttr_LIFETIME(out.lifetime);
+    }
+  }
+
+  static void resultOf(Session&, int errorCode, StunMessage*, int& out) { out = errorCode; }
+
+  static void resultOf(Session& s, int, StunMessage*, SetupResult& out) {
+    out = std::move(s.setupResult);
+  }
+
+  template <typename Handler, typename Result>
+  class CompletionOf : public Completion {
+    Handler handler;
+
+   public:
+    explicit CompletionOf(Handler&& handler_) : handler(std::move(handler_)) {}
+
+    void complete(Session& s, int errorCode, StunMessage* response) override {
+      Result result{};
+      resultOf(s, errorCode, response, result);
+      Handler h(std::move(handler));
+      s.releaseCompletion();
+      h(std::move(result));
+    }
+  };
+
+  // the request of a transaction, rebuilt with a new NONCE when challenged.
+  struct Request {
+    StunMethod method = StunMethod::Allocate;
+    uint32_t lifetime = 0;                        // Allocate, Refresh
+    std::vector<asio::ip::udp::endpoint> peers;  // CreatePermission, ChannelBind
+    uint16_t channel = 0;                         // ChannelBind
+  };
+
+  struct Transaction {
+    Request request;
+    std::vector<uint8_t> message;
+    uint32_t transId[3] = {0};
+    uint32_t serial = 0;  // matched against timer events, 0 once answered
+    bool signedRequest = false;
+    uint16_t attempts = 0;
+    uint16_t nonceRetries = 0;
+    uint32_t rtoMs = 0;
+    seeker::TimingWheel<uint64_t>::TimerId timer = 0;
+  };
+
+  enum class Operation : uint8_t { single, setup };
+
+ public:
+  class Session {
+    friend class TurnClient;
+
+    TurnClient& client;
+    uint32_t index;
+    asio::ip::udp::socket socket;
+    std::shared_ptr<TcpConnection> tcp;
+    bool freshConnection = false;
+    bool allocated = false;  // holds an allocation on the server, as far as we know
+    TurnCredentials credentials;
+
+    // of the pending operation, kept across operations for their capacity.
+    Operation operation = Operation::single;
+    std::vector<Transaction> transactions;
+    size_t outstanding = 0;
+    uint32_t nextSerial = 0;
+    int64_t startedAt = 0;
+    std::vector<asio::ip::udp::endpoint> setupPeers;
+    SetupResult setupResult;
+
+    bool waiting = false;
+    bool inUse = false;
+
+    Completion* pending = nullptr;
+    alignas(std::max_align_t) unsigned char handlerStorage[inlineHandlerBytes];
+
+
+    Session(TurnClient& client_, uint32_t index_)
+        : client(client_), index(index_), socket(client_.ioContext) {}
+
+    template <typename Result, typename Handler>
+    void begin(Handler&& handler, Operation op) {
+      if (pending != nullptr) {
+        throw std::runtime_error("TurnClient session has an operation in progress.");
+      }
+      using C = CompletionOf<typename std::decay<Handler>::type, Result>;
+      if constexpr (sizeof(C) <= inlineHandlerBytes &&
+                    alignof(C) <= alignof(std::max_align_t)) {
+        pending = new (handlerStorage) C(std::move(handler));
+      } else {
+        pending = new C(std::move(handler));
+      }
+      operation = op;
+      transactions.clear();
+      outstanding = 0;
+      startedAt = nowMs();
+    }
+
+    template <typename Result, typename Handler>
+    void start(Handler&& handler, Request r) {
+      begin<Result>(std::move(handler), Operation::single);
+      client.startTransaction(*this, add(std::move(r)));
+    }
+
+    size_t add(Request r) {
+      transactions.emplace_back();
+      transactions.back().request = std::move(r);
+      outstanding++;
+      return transactions.size() - 1;
+    }
+
+    void releaseCompletion() {
+      if (pending == nullptr) {
+        return;
+      }
+      if ((void*)pending == (void*)handlerStorage) {
+        pending->~Completion();
+      } else {
+        delete pending;
+      }
+      pending = nullptr;
+    }
+
+   public:
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+    ~Session() { releaseCompletion(); }
+
+    template <typename CompletionToken>
+    auto allocate(CompletionToken&& token) {
+      return asio::async_initiate<CompletionToken, void(AllocateResult)>(
+          [this](auto handler) {
+            Request r;
+            r.method = StunMethod::Allocate;
+            r.lifetime = client.options.lifetime;
+            start<AllocateResult>(std::move(handler), std::move(r));
+          },
+          token);
+    }
+
+    template <typename CompletionToken>
+    auto createPermission(std::vector<asio::ip::udp::endpoint> peers,
+                          CompletionToken&& token) {
+      return asio::async_initiate<CompletionToken, void(int)>(
+          [this](auto handler, std::vector<asio::ip::udp::endpoint> peers_) {
+            Request r;
+            r.method = StunMethod::CreatePermission;
+            r.peers = std::move(peers_);
+            start<int>(std::move(handler), std::move(r));
+          },
+          token, std::move(peers));
+    }
+
+    template <typename CompletionToken>
+    auto bindChannel(uint16_t channel, const asio::ip::udp::endpoint& peer,
+                     CompletionToken&& token) {
+      return asio::async_initiate<CompletionToken, void(int)>(
+          [this, channel, peer](auto handler) {
+            Request r;
+            r.method = StunMethod::ChannelBind;
+            r.channel = channel;
+            r.peers.push_back(peer);
+            start<int>(std::move(handler), std::move(r));
+          },
+          token);
+    }
+
+    /*
+    Allocate, then CreatePermission for all peers and ChannelBind of channel
+    firstChannel + i to peers[i], concurrently. Completes once every response is in.
+    */
+    template <typename CompletionToken>
+    auto setup(std::vector<asio::ip::udp::endpoint> peers, CompletionToken&& token) {
+      return asio::async_initiate<CompletionToken, void(SetupResult)>(
+          [this](auto handler, std::vector<asio::ip::udp::endpoint> peers_) {
+            if (peers_.size() > maxSetupPeers) {
+              throw std::runtime_error("too many peers for one TurnClient setup.");
+            }
+            begin<SetupResult>(std::move(handler), Operation::setup);
+            setupPeers = std::move(peers_);
+            setupResult = SetupResult{};
+            Request r;
+            r.method = StunMethod::Allocate;
+            r.lifetime = client.options.lifetime;
+            client.startTransaction(*this, add(std::move(r)));
+          },
+          token, std::move(peers));
+    }
+
+    // lifetime 0 deletes the allocation.
+    template <typename CompletionToken>
+    auto refresh(uint32_t lifetime, CompletionToken&& token) {
+      return asio::async_initiate<CompletionToken, void(int)>(
+          [this, lifetime](auto handler) {
+            Request r;
+            r.method = StunMethod::Refresh;
+            r.lifetime = lifetime;
+            start<int>(std::move(handler), std::move(r));
+          },
+          token);
+    }
+
+    // the socket of the session, connected to the server. Data is sent on it directly.
+    asio::ip::udp::socket& udpSocket() { return socket; }
+    // the connection of a TCP session, null over UDP or once it is lost.
+    TcpConnection* tcpConnection() { return tcp.get(); }
+    bool busy() const { return pending != nullptr; }
+  };
+
+
+ private:
+  asio::io_context& ioContext;
+  asio::ip::udp::endpoint server;
+  Options options;
+
+  std::vector<std::unique_ptr<Session>> sessions;
+  std::vector<uint32_t> freeSessions;
+  size_t openCount = 0;
+  std::vector<std::shared_ptr<TcpConnection>> idleConnections;
+  uint64_t reusedConnections = 0;
+
+  seeker::AsioTimingWheel<uint64_t> timers;
+  seeker::RandomIntGenerator transIdGenerator{INT_MIN, INT_MAX};
+  uint8_t receiveBuffer[receiveBufferBytes];
+
+
+  static int64_t nowMs() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+  }
+
+  std::vector<uint8_t> buildRequest(Session& s, Transaction& t) {
+    StunMessage message{};
+    for (int i = 0; i < 3; i++) {
+      t.transId[i] = (uint32_t)transIdGenerator();
+    }
+    message.setTransactionId(t.transId);
+    message.setMethod(t.request.method);
+    message.setClass(StunClass::request);
+
+    const Request& r = t.request;
+    if (r.method == StunMethod::Allocate) {
+      message.setAttr_REQUESTED_TRANSPORT();
+      message.setAttr_LIFETIME(r.lifetime);
+    } else if (r.method == StunMethod::Refresh) {
+      message.setAttr_LIFETIME(r.lifetime);
+    } else if (r.method == StunMethod::ChannelBind) {
+      message.setAttr_CHANNEL_NUMBER(r.channel);
+    }
+    for (auto& peer : r.peers) {
+      message.setAttr_XOR_PEER_ADDRESS(peer);
+    }
+
+    // the first request goes unsigned until the server has told us REALM and NONCE.
+    const TurnCredentials& c = s.credentials;
+    t.signedRequest = !c.username.empty() && !c.nonce.empty();
+    if (t.signedRequest) {
+      message.setAttr_USERNAME(c.username);
+      message.setPassword(c.password);
+      message.setAttr_REALM(c.realm);
+      message.setAttr_NONCE((const uint8_t*)c.nonce.c_str(), c.nonce.size());
+      message.setMessageIntegrity(true);
+    }
+
+    message.setFingerprint(true);
+    return message.binary();
+  }
+
+  void transmit(Session& s, Transaction& t) {
+    if (options.transport != Transport::udp) {
+      // reliable: one send and a single timeout, right away if the connection is gone.
+      t.attempts = options.maxAttempts;
+      if (s.tcp) {
+        s.tcp->send(t.message.data(), t.message.size());
+      } else {
+        t.rtoMs = 0;
+      }
+      t.timer = timers.schedule(std::chrono::milliseconds(t.rtoMs),
+                                ((uint64_t)s.index << 32) | t.serial);
+      return;
+    }
+    asio::error_code ec;
+    s.socket.send(asio::buffer(t.message), 0, ec);
+    if (ec) {
+      W_LOG("TurnClient session {} send error: {}", s.index, ec.message());
+    }
+    t.timer = timers.schedule(std::chrono::milliseconds(t.rtoMs),
+                              ((uint64_t)s.index << 32) | t.serial);
+    awaitResponse(s);
+  }
+
+  void startTransaction(Session& s, size_t i) {
+    Transaction& t = s.transactions[i];
+    timers.cancel(t.timer);
+    t.message = buildRequest(s, t);
+    if (++s.nextSerial == 0) {
+      s.nextSerial = 1;
+    }
+    t.serial = s.nextSerial;
+    t.attempts = 1;
+    bool stream = options.transport != Transport::udp;
+    t.rtoMs = stream ? options.tcpTimeoutMs : options.retransmitMs;
+    transmit(s, t);
+  }
+
+  // CreatePermission and ChannelBinds of a setup, all at once after the Allocate.
+  void pipeline(Session& s) {
+    s.transactions.reserve(s.transactions.size() + 1 + s.setupPeers.size());
+    s.setupResult.channels.assign(s.setupPeers.size(), 0);
+    if (s.setupPeers.empty()) {
+      return;
+    }
+    size_t first = s.transactions.size();
+    Request permission;
+    permission.method = StunMethod::CreatePermission;
+    permission.peers = s.setupPeers;
+    s.add(std::move(permission));
+    for (size_t i = 0; i < s.setupPeers.size(); i++) {
+      Request bind;
+      bind.method = StunMethod::ChannelBind;
+      bind.channel = (uint16_t)(firstChannel + i);
+      bind.peers.push_back(s.setupPeers[i]);
+      s.add(std::move(bind));
+    }
+    for (size_t i = first; i < s.transactions.size(); i++) {
+      startTransaction(s, i);
+    }
+  }
+
+  void onSetupStep(Session& s, StunMethod method, uint16_t channel, int errorCode,
+                   StunMessage* response) {
+    SetupResult& rst = s.setupResult;
+    int64_t elapsed = nowMs() - s.startedAt;
+    if (method == StunMethod::Allocate) {
+      resultOf(s, errorCode, response, rst.allocation);
+      rst.allocatedMs = elapsed;
+      if (errorCode == 0) {
+        pipeline(s);
+      }
+    } else if (errorCode == 0) {
+      if (rst.firstRelayMs < 0) {
+        rst.firstRelayMs = elapsed;
+      }
+      if (method == StunMethod::CreatePermission) {
+        rst.permitted = true;
+      } else {
+        rst.channels[channel - firstChannel] = channel;
+      }
+    }
+    if (errorCode != 0 && rst.errorCode == 0) {
+      rst.errorCode = errorCode;
+    }
+    if (s.outstanding == 0) {
+      rst.setupMs = elapsed;
+      if (s.tcp && s.freshConnection) {
+        rst.connectMs = s.tcp->connectMs();
+        rst.handshakeMs = s.tcp->handshakeMs();
+        rst.resumed = s.tcp->resumed();
+      }
+      s.pending->complete(s, rst.errorCode, nullptr);
+    }
+  }
+
+  // transaction i is answered, or timed out with 408.
+  void finish(Session& s, size_t i, int errorCode, StunMessage* response) {
+    Transaction& t = s.transactions[i];
+    timers.cancel(t.timer);
+    t.timer = 0;
+    t.serial = 0;
+    s.outstanding--;
+    if (errorCode == 0 && t.request.method == StunMethod::Allocate) {
+      s.allocated = true;
+    } else if (errorCode == 0 && t.request.method == StunMethod::Refresh) {
+      s.allocated = t.request.lifetime != 0;
+    }
+    if (s.operation == Operation::setup) {
+      onSetupStep(s, t.request.method, t.request.channel, errorCode, response);
+    } else {
+      s.pending->complete(s, errorCode, response);
+    }
+  }
+
+  void onTimers(std::vector<uint64_t>& expired) {
+    for (uint64_t event : expired) {
+      Session& s = *sessions[(uint32_t)(event >> 32)];
+      if (s.pending == nullptr) {
+        continue;
+      }
+      for (size_t i = 0; i < s.transactions.size(); i++) {
+        Transaction& t = s.transactions[i];
+        if (t.serial != (uint32_t)event) {
+          continue;
+        }
+        if (t.attempts < options.maxAttempts) {
+          t.attempts++;
+          t.rtoMs *= 2;
+          transmit(s, t);
+        } else {
+          W_LOG("TurnClient session {}: method={} timeout after {} attempts", s.index,
+                (int)t.request.method, t.attempts);
+          finish(s, i, 408, nullptr);
+        }
+        break;
+      }
+    }
+  }
+
+  // the server deleted the allocation with the connection, fail what is outstanding.
+  void onConnectionLost(Session& s, const asio::error_code& ec) {
+    D_LOG("TurnClient session {} connection lost: {}", s.index, ec.message());
+    s.tcp.reset();
+    s.allocated = false;
+    for (size_t i = 0; s.inUse && s.pending != nullptr && i < s.transactions.size(); i++) {
+      if (s.transactions[i].serial != 0) {
+        finish(s, i, 408, nullptr);
+      }
+    }
+  }
+
+  void connect(Session& s) {
+    s.freshConnection = false;
+    while (!idleConnections.empty()) {
+      std::shared_ptr<TcpConnection> c = std::move(idleConnections.back());
+      idleConnections.pop_back();
+      if (c->isOpen()) {
+        s.tcp = std::move(c);
+        reusedConnections++;
+        break;
+      }
+    }
+    if (!s.tcp) {
+      s.tcp = std::make_shared<TcpConnection>(ioContext, options.tcpConnection);
+      s.freshConnection = true;
+      asio::ip::tcp::endpoint to(server.address(), server.port());
+#ifdef HELLOCOTURN_WITH_TLS
+      if (options.transport == Transport::tls) {
+        s.tcp->connectTls(to, TlsContext::global(), options.serverName);
+      } else {
+        s.tcp->connect(to);
+      }
+#else
+      s.tcp->connect(to);
+#endif
+    }
+    s.tcp->setHandlers([this, &s](uint8_t* data, size_t size) { onDatagram(s, data, size); },
+                       [this, &s](const asio::error_code& ec) { onConnectionLost(s, ec); });
+  }
+
+  // park the connection of a session without allocation for the next open().
+  void disconnect(Session& s) {
+    std::shared_ptr<TcpConnection> c = std::move(s.tcp);
+    if (!c) {
+      return;
+    }
+    if (!s.allocated && c->isOpen() && idleConnections.size() < options.maxIdleConnections) {
+      c->setHandlers(nullptr, nullptr);
+      idleConnections.push_back(std::move(c));
+    } else {
+      c->close();
+    }
+  }
+
+  void awaitResponse(Session& s) {
+    if (s.waiting) {
+      return;
+    }
+    s.waiting = true;
+    s.socket.async_wait(asio::ip::udp::socket::wait_read,
+                        [this, &s](const asio::error_code& ec) {
+                          if (ec == asio::error::operation_aborted) {
+                            return;  // closed, s may already be open again
+                          }
+                          s.waiting = false;
+                          onReadable(s);
+                        });
+  }
+
+  void onReadable(Session& s) {
+    for (;;) {
+      asio::error_code ec;
+      size_t n = s.socket.receive(asio::buffer(receiveBuffer), 0, ec);
+      if (ec) {
+        if (ec != asio::error::would_block && ec != asio::error::try_again) {
+          D_LOG("TurnClient session {} receive error: {}", s.index, ec.message());
+        }
+        break;
+      }
+      onDatagram(s, receiveBuffer, n);
+      if (!s.inUse) {
+        return;  // closed by a handler
+      }
+    }
+    if (s.pending != nullptr) {
+      awaitResponse(s);
+    }
+  }
+
+  void onDatagram(Session& s, uint8_t* data, size_t len) {
+    if (s.pending == nullptr) {
+      return;  // late retransmission answers, or data for an application reading elsewhere
+    }
+    StunMessage msg;
+    if (StunMessage::parse(data, len, msg, true) != 0) {
+      return;
+    }
+    size_t i = 0;
+    for (; i < s.transactions.size(); i++) {
+      const Transaction& t = s.transactions[i];
+      if (t.serial != 0 && std::equal(t.transId, t.transId + 3, msg.getTransactionId())) {
+        break;
+      }
+    }
+    if (i == s.transactions.size() || msg.getMethod() != s.transactions[i].request.method) {
+      return;
+    }
+
+    Transaction& t = s.transactions[i];
+    const TurnCredentials& c = s.credentials;
+    if (msg.getClass() == StunClass::successResponse) {
+      if (t.signedRequest && StunMessage::parse(data, len, msg, true, c.username, c.password,
+                                                c.realm) != 0) {
+        W_LOG("TurnClient session {}: response with bad MESSAGE-INTEGRITY dropped.", s.index);
+        return;
+      }
+      finish(s, i, 0, &msg);
+      return;
+    }
+    if (msg.getClass() != StunClass::errorResponse) {
+      return;
+    }
+
+    int code = msg.getAttr_ERROR_CODE();
+    string nonce = msg.getAttr_NONCE();
+    bool challenge = (code == 401 && !t.signedRequest) || code == 438;
+    if (challenge && !c.username.empty() && !nonce.empty() &&
+        t.nonceRetries < options.maxNonceRetries) {
+      t.nonceRetries++;
+      s.credentials.nonce = nonce;
+      string realm = msg.getAttr_REALM();
+      if (!realm.empty()) {
+        s.credentials.realm = realm;
+      }
+      startTransaction(s, i);
+      return;
+    }
+    finish(s, i, code, &msg);
+  }
+
+
+ public:
+  TurnClient(asio::io_context& ioContext_, const asio::ip::udp::endpoint& server_,
+             const Options& options_)
+      : ioContext(ioContext_),
+        server(server_),
+        options(options_),
+        timers(ioContext_, std::chrono::milliseconds(10),
+               [this](std::vector<uint64_t>& expired) { onTimers(expired); }) {
+#ifndef HELLOCOTURN_WITH_TLS
+    if (options.transport == Transport::tls) {
+      throw std::runtime_error("TurnClient: built without TLS support.");
+    }
+#endif
+  }
+
+  TurnClient(asio::io_context& ioContext_, const asio::ip::udp::endpoint& server_)
+      : TurnClient(ioContext_, server_, Options()) {}
+
+  TurnClient(const TurnClient&) = delete;
+  TurnClient& operator=(const TurnClient&) = delete;
+
+  // the handlers of a connection refer to its session, they must not outlive the client.
+  ~TurnClient() {
+    closeIdleConnections();
+    for (auto& s : sessions) {
+      if (s->tcp) {
+        s->tcp->close();
+      }
+    }
+  }
+
+  // a session with a fresh socket connected to the server, or a parked TCP connection.
+  Session& open() {
+    uint32_t index;
+    if (!freeSessions.empty()) {
+      index = freeSessions.back();
+      freeSessions.pop_back();
+    } else {
+      if (sessions.size() >= options.maxSessions) {
+        throw std::runtime_error("too many TurnClient sessions.");
+      }
+      index = (uint32_t)sessions.size();
+      sessions.emplace_back(new Session(*this, index));
+    }
+    Session& s = *sessions[index];
+    s.allocated = false;
+    if (options.transport != Transport::udp) {
+      connect(s);
+    } else {
+      s.socket.open(server.protocol());
+      s.socket.non_blocking(true);
+      s.socket.connect(server);
+    }
+    s.credentials = TurnCredentials{options.username, options.password, "", ""};
+    s.waiting = false;
+    s.inUse = true;
+    openCount++;
+    return s;
+  }
+
+  /*
+  close the socket and give the session back to the pool. A pending operation is abandoned:
+  its handler is destroyed without being called. Does not release the allocation on the
+  server, refresh(0) first for that; over TCP that also lets the connection be reused.
+  */
+  void close(Session& s) {
+    if (!s.inUse) {
+      return;
+    }
+    for (auto& t : s.transactions) {
+      timers.cancel(t.timer);
+    }
+    s.transactions.clear();
+    s.outstanding = 0;
+    s.releaseCompletion();
+    asio::error_code ec;
+    s.socket.close(ec);
+    disconnect(s);
+    s.inUse = false;
+    openCount--;
+    freeSessions.push_back(s.index);
+  }
+
+  size_t sessionCount() const { return openCount; }
+  /*
+  close the parked TCP connections. Their pending reads keep the io_context busy, call this
+  once no session will be opened any more for run() to return.
+  */
+  void closeIdleConnections() {
+    for (auto& c : idleConnections) {
+      c->close();
+    }
+    idleConnections.clear();
+  }
+
+  size_t idleConnectionCount() const { return idleConnections.size(); }
+  // open() calls served by a parked TCP connection.
+  uint64_t connectionsReused() const { return reusedConnections; }
+  const asio::ip::udp::endpoint& serverEndpoint() const { return server; }
+};
+
+
+}  // namespace HelloCoturn
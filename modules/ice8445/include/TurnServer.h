@@ -0,0 +1,974 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "asio.hpp"
+#include "seeker/loggerApi.h"
+#include "seeker/shardedCounter.h"
+#include "AllocationTable.h"
+#include "BatchedUdpSocket.h"
+#include "ChannelTable.h"
+#include "MessageBuilder.h"
+#include "PermissionCache.h"
+#include "PortAllocator.h"
+#include "RelayFrame.h"
+#include "RestCredentials.h"
+#include "StatelessNonce.h"
+#include "TcpConnection.h"
+#include "TokenBucket.h"
+
+
+namespace HelloCoturn {
+
+using std::string;
+
+
+/*
+In-process TURN server over UDP (RFC 5766): Allocate, Refresh, CreatePermission,
+ChannelBind, Send indication and ChannelData. Meant as a local stand-in for tests and
+benchmarks, it runs on one io_context; for more cores ShardedTurnServer starts one per
+ShardedRuntime shard on a SO_REUSEPORT listening socket, a client then always lands on the
+same shard.
+
+With Options::tcp clients may also reach it over TCP on the same address and port
+(TcpConnection). Requests and ChannelData arriving on a connection go through the same
+handlers as datagrams, answers and relayed data go back on the connection. The relayed leg
+stays UDP, and an allocation made over TCP is deleted when its connection closes.
+Allocations are keyed by the client 5-tuple, so a TCP and a UDP client on the same address
+and port are told apart; an allocation made over TCP only answers on its own connection.
+
+Control path: requests are decoded with StunMessage, answered with a signed and
+fingerprinted StunMessage. Long-term credentials are checked when Options::users or
+Options::restSecrets is set (static users first, then REST usernames, whose password is
+computed from the username), with per-client StatelessNonce nonces: checking one is an
+HMAC, there is no nonce table.
+Relayed ports come from a PortAllocator over [minPort, maxPort], EVEN-PORT and
+RESERVATION-TOKEN are honoured.
+
+Bandwidth, both directions together, can be capped per allocation (Options::allocationLimit)
+and per user (Options::userLimit) with TokenBuckets checked on the relay path. With
+Options::counters relayed packets and bytes are also accounted per allocation and per user
+in one shard of a seeker::ShardedCounters, exported by its own reader thread.
+
+Relay path, built for packet rate:
+- the listening socket and every relayed socket are BatchedUdpSockets, a wakeup reads up to
+  a batch of datagrams with recvmmsg() and the answers leave together with sendmmsg()/GSO.
+- ChannelData and Send indications are decoded in place (RelayFrame), no StunMessage, no
+  allocation per packet. The payload of a client datagram is sent to the peer from the
+  receive buffer, the relayed socket only copies what is still queued at the end of the
+  batch. A peer datagram is framed as ChannelData or Data indication straight into the send
+  ring of the listening socket: that copy is kept, it lets the datagrams of all allocations
+  to their clients share sendmmsg() calls.
+- the clock is read once per batch, the allocation of the previous datagram is reused when
+  the next one comes from the same client.
+- allocations live in an AllocationTable: a packet touches the allocation's 64-byte Record
+  and its PeerTable, never the cold state. Expiry is swept once per second as a SIMD scan of
+  the expiry array, never on the packet path.
+
+Memory per allocation with the default Options: 96 bytes of table, the Allocation and
+PeerTable (a few hundred bytes plus one node per permission / channel), and the relayed
+socket, whose buffers dominate: (relayBatch + 4 * relayBatch) * 2048 bytes, 40 KB for
+relayBatch 4. memoryBytes() reports the actual total.
+*/
+class TurnServer {
+ public:
+  struct Options {
+    // address the relayed sockets bind to and advertise, default the listening address.
+    asio::ip::address relayAddress;
+    string realm = "hellocoturn";
+    // username -> password. Empty: no authentication.
+    std::unordered_map<string, string> users;
+    // shared secrets of time-limited REST credentials, see RestCredentials.
+    std::vector<string> restSecrets;
+    StatelessNonce::Options nonce;
+    uint32_t defaultLifetime = 600;
+    uint32_t maxLifetime = 3600;
+    size_t maxAllocations = 100000;
+    // relayed port range (RFC 5766 6.2 recommends 49152 - 65535).
+    uint16_t minPort = PortAllocator::defaultMinPort;
+    uint16_t maxPort = PortAllocator::defaultMaxPort;
+    size_t batch = 64;
+    // relayed sockets carry one allocation's traffic, a small batch keeps them small.
+    size_t relayBatch = 4;
+    bool gro = false;
+    // bandwidth caps, unlimited by default.
+    RateLimit allocationLimit;
+    RateLimit userLimit;
+    // user buckets shared with other servers (shards), created from userLimit if null.
+    std::shared_ptr<UserRateLimits> userLimits;
+    // traffic accounting, this server writes shard counterShard of counters.
+    std::shared_ptr<seeker::ShardedCounters> counters;
+    size_t counterShard = 0;
+    // also listen for TURN over TCP.
+    bool tcp = false;
+    TcpConnection::Options tcpConnection;
+  };
+
+  struct Stats {
+    uint64_t requests = 0;
+    uint64_t errorResponses = 0;
+    uint64_t allocationsCreated = 0;
+    uint64_t allocationsExpired = 0;
+    uint64_t toPeerPackets = 0;
+    uint64_t toClientPackets = 0;
+    uint64_t dropped = 0;  // no allocation, permission or channel
+    uint64_t rateLimited = 0;
+  };
+
+ private:
+  static constexpr int64_t permissionLifetimeMs = 300 * 1000;
+  static constexpr int64_t channelLifetimeMs = 600 * 1000;
+  static constexpr uint32_t permissionPurgeRounds = 30;
+  // ports of the range may be taken by other processes, try a few before giving up.
+  static constexpr int maxBindAttempts = 8;
+
+  struct Channel {
+    asio::ip::udp::endpoint peer;
+    int64_t expireAt = 0;
+  };
+
+  // counter ids of an allocation, released with it.
+  struct Accounting {
+    std::shared_ptr<seeker::ShardedCounters> counters;
+    uint32_t allocation = 0;
+    uint32_t user = 0;
+
+    ~Accounting() {
+      if (counters) {
+        counters->release(allocation);
+        counters->release(user);
+      }
+    }
+  };
+
+  // per-peer state of one allocation, everything the relay path needs besides the Record.
+  struct PeerTable {
+    asio::ip::udp::endpoint client;
+    TcpConnection* tcp = nullptr;  // the client's connection, null over UDP
+    std::unordered_map<PeerKey, int64_t, PeerKeyHash> permissions;  // peer IP -> expiry
+    ChannelTable<Channel> channels;
+    TokenBucket limit;
+    std::shared_ptr<TokenBucket> userLimit;
+    Accounting accounting;
+
+    bool admit(size_t bytes, int64_t now) {
+      return takeHierarchical(limit, userLimit.get(), bytes, now);
+    }
+
+    bool permitted(const asio::ip::udp::endpoint& peer, int64_t now) const {
+      auto it = permissions.find(PeerKey::of(peer, false));
+      return it != permissions.end() && now < it->second;
+    }
+  };
+
+  // cold part of an allocation, only the control path reads it.
+  struct Allocation {
+    PortAllocator::Lease port;  // released after the relayed socket is closed
+    uint64_t reservationToken = 0;
+    asio::ip::udp::endpoint relayed;
+    std::unique_ptr<BatchedUdpSocket> relay;
+    uint32_t allocateTransId[3] = {0, 0, 0};
+    string username;
+    PeerTable peers;
+  };
+
+  using Table = AllocationTable<Allocation, PeerTable>;
+  using Record = Table::Record;
+
+  // credentials a request was authenticated with, used to sign its response.
+  struct Auth {
+    string username;
+    string password;
+  };
+
+  asio::io_context& ioContext;
+  Options options;
+  std::unique_ptr<BatchedUdpSocket> listener;
+  std::unique_ptr<asio::ip::tcp::acceptor> acceptor;
+  std::unordered_map<TcpConnection*, std::shared_ptr<TcpConnection>> connections;
+  TcpConnection* replyConnection = nullptr;  // connection of the frame being handled
+  asio::steady_timer sweepTimer;
+  StatelessNonce nonces;
+  RestCredentials rest;
+  std::mt19937_64 random;
+
+  PortAllocator ports;
+  Table allocations;
+  seeker::ShardedCounters::Shard* counterShard = nullptr;
+  Record* lastAllocation = nullptr;
+  asio::ip::udp::endpoint lastClient;
+  TcpConnection* lastConnection = nullptr;
+  // relayed sockets holding payloads of the batch being handled, see relayToPeer().
+  std::vector<BatchedUdpSocket*> unsettled;
+  uint32_t sweepRound = 0;
+
+  int64_t now = 0;
+  Stats stats;
+
+
+  static int64_t clockMs() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+  }
+
+  // the 5-tuple key: a TCP client and a UDP client may share an address and port.
+  static PeerKey clientKey(const asio::ip::udp::endpoint& client, const TcpConnection* via) {
+    PeerKey key = PeerKey::of(client);
+    key.transport = via != nullptr ? 6 : 17;
+    return key;
+  }
+
+  // allocation of a client reached over via (nullptr: UDP). An allocation made over TCP is
+  // only found on its own connection.
+  Record* findAllocation(const asio::ip::udp::endpoint& client, TcpConnection* via) {
+    if (lastAllocation != nullptr && lastClient == client && lastConnection == via) {
+      return lastAllocation;
+    }
+    Record* a = allocations.find(clientKey(client, via));
+    if (a != nullptr && a->channels->tcp != via) {
+      return nullptr;
+    }
+    lastAllocation = a;
+    lastClient = client;
+    lastConnection = via;
+    return lastAllocation;
+  }
+
+  void eraseAllocation(Record& a) {
+    settleRelays();
+    lastAllocation = nullptr;
+    allocations.erase(a);
+  }
+
+
+  // ---------------------------------------------------------------- relay path
+
+  void account(PeerTable& peers, size_t bytes) {
+    if (counterShard != nullptr) {
+      counterShard->add(peers.accounting.allocation, bytes);
+      counterShard->add(peers.accounting.user, bytes);
+    }
+  }
+
+  // queue payload, which points into a receive buffer, to the peer without copying it.
+  void relayToPeer(BatchedUdpSocket& relay, const uint8_t* payload, size_t size,
+                   const asio::ip::udp::endpoint& peer) {
+    if (!relay.holdsReferences()) {
+      unsettled.push_back(&relay);
+    }
+    relay.sendRef(payload, size, peer);
+  }
+
+  // before the receive buffers are reused: payloads still queued are copied.
+  void settleRelays() {
+    for (BatchedUdpSocket* relay : unsettled) {
+      relay->settle();
+    }
+    unsettled.clear();
+  }
+
+  void onClientDatagrams(BatchedUdpSocket::Datagram* batch, size_t count) {
+    now = clockMs();
+    if (counterShard != nullptr) {
+      counterShard->begin();
+    }
+    for (size_t i = 0; i < count; i++) {
+      BatchedUdpSocket::Datagram& d = batch[i];
+      if (RelayFrame::isChannelData(d.data, d.size)) {
+        onChannelData(d);
+      } else if (d.size >= 20 && d.data[0] == 0x00 && d.data[1] == 0x16) {
+        onSendIndication(d);
+      } else {
+        onStunMessage(d);
+      }
+    }
+    settleRelays();
+    if (counterShard != nullptr) {
+      counterShard->end();
+    }
+  }
+
+  void onChannelData(BatchedUdpSocket::Datagram& d) {
+    uint16_t channel = 0;
+    const uint8_t* payload = nullptr;
+    size_t size = 0;
+    if (!RelayFrame::parseChannelData(d.data, d.size, channel, payload, size)) {
+      stats.dropped++;
+      return;
+    }
+    Record* a = findAllocation(d.endpoint, replyConnection);
+    if (a == nullptr) {
+      stats.dropped++;
+      return;
+    }
+    PeerTable& peers = *a->channels;
+    const Channel* c = peers.channels.find(channel);
+    if (c == nullptr || now >= c->expireAt || !peers.permitted(c->peer, now)) {
+      stats.dropped++;
+      return;
+    }
+    if (!peers.admit(size, now)) {
+      stats.rateLimited++;
+      return;
+    }
+    relayToPeer(*a->relay, payload, size, c->peer);
+    a->toPeerBytes += size;
+    account(peers, size);
+    stats.toPeerPackets++;
+  }
+
+  void onSendIndication(BatchedUdpSocket::Datagram& d) {
+    asio::ip::udp::endpoint peer;
+    const uint8_t* payload = nullptr;
+    size_t size = 0;
+    Record* a = findAllocation(d.endpoint, replyConnection);
+    if (a == nullptr || !RelayFrame::parseIndication(d.data, d.size, peer, payload, size) ||
+        !a->channels->permitted(peer, now)) {
+      stats.dropped++;
+      return;
+    }
+    if (!a->channels->admit(size, now)) {
+      stats.rateLimited++;
+      return;
+    }
+    relayToPeer(*a->relay, payload, size, peer);
+    a->toPeerBytes += size;
+    account(*a->channels, size);
+    stats.toPeerPackets++;
+  }
+
+  void onPeerDatagrams(Record& a, BatchedUdpSocket::Datagram* batch, size_t count) {
+    now = clockMs();
+    PeerTable& peers = *a.channels;
+    if (counterShard != nullptr) {
+      counterShard->begin();
+    }
+    for (size_t i = 0; i < count; i++) {
+      BatchedUdpSocket::Datagram& d = batch[i];
+      if (!peers.permitted(d.endpoint, now)) {
+        stats.dropped++;
+        continue;
+      }
+      if (!peers.admit(d.size, now)) {
+        stats.rateLimited++;
+        continue;
+      }
+      uint16_t ch = peers.channels.channelOf(d.endpoint);
+      RelayFrame frame;
+      if (ch != 0 && now < peers.channels.find(ch)->expireAt) {
+        frame = RelayFrame::channelData(ch, d.data, d.size, peers.tcp != nullptr);
+      } else {
+        uint32_t transId[3];
+        randomTransactionId(transId);
+        frame = RelayFrame::dataIndication(transId, d.endpoint, d.data, d.size);
+      }
+      if (peers.tcp != nullptr) {
+        peers.tcp->sendGather(frame.buffers());
+      } else {
+        listener->queueGather(frame.buffers(), peers.client);
+      }
+      a.toClientBytes += d.size;
+      account(peers, d.size);
+      stats.toClientPackets++;
+    }
+    if (counterShard != nullptr) {
+      counterShard->end();
+    }
+  }
+
+  // ---------------------------------------------------------------- TCP
+
+  void accept() {
+    acceptor->async_accept([this](const asio::error_code& ec, asio::ip::tcp::socket socket) {
+      if (ec == asio::error::operation_aborted) {
+        return;
+      }
+      if (ec) {
+        W_LOG("TurnServer accept error: {}", ec.message());
+      } else {
+        onAccepted(std::move(socket));
+      }
+      accept();
+    });
+  }
+
+  void onAccepted(asio::ip::tcp::socket&& socket) {
+    auto c = std::make_shared<TcpConnection>(std::move(socket), options.tcpConnection);
+    TcpConnection* raw = c.get();
+    asio::ip::tcp::endpoint remote = c->remoteEndpoint();
+    asio::ip::udp::endpoint client(remote.address(), remote.port());
+    c->setHandlers(
+        [this, raw, client](uint8_t* data, size_t size) {
+          BatchedUdpSocket::Datagram d{data, size, client};
+          replyConnection = raw;
+          onClientDatagrams(&d, 1);
+          replyConnection = nullptr;
+        },
+        [this, raw, client](const asio::error_code&) { onClosed(raw, client); });
+    connections.emplace(raw, std::move(c));
+    raw->start();
+  }
+
+  void onClosed(TcpConnection* c, const asio::ip::udp::endpoint& client) {
+    Record* a = findAllocation(client, c);
+    if (a != nullptr) {
+      eraseAllocation(*a);
+    }
+    connections.erase(c);
+  }
+
+  void randomTransactionId(uint32_t transId[3]) {
+    uint64_t r1 = random();
+    uint64_t r2 = random();
+    transId[0] = (uint32_t)r1;
+    transId[1] = (uint32_t)(r1 >> 32);
+    transId[2] = (uint32_t)r2;
+  }
+
+
+  // ---------------------------------------------------------------- control path
+
+  // walk the attributes in place, true if `type` is present.
+  static bool hasAttribute(const uint8_t* data, size_t size, StunAttributeType type) {
+    size_t end = 20 + (size_t)((data[2] << 8) | data[3]);
+    if (end > size) {
+      return false;
+    }
+    for (size_t pos = 20; pos + 4 <= end;) {
+      uint16_t t = (uint16_t)((data[pos] << 8) | data[pos + 1]);
+      size_t len = (size_t)((data[pos + 2] << 8) | data[pos + 3]);
+      if (t == (uint16_t)type) {
+        return true;
+      }
+      pos += 4 + len + ((4 - (len & 3)) & 3);
+    }
+    return false;
+  }
+
+  static bool endsWithFingerprint(const uint8_t* data, size_t size) {
+    size_t msgLen = (size_t)((data[2] << 8) | data[3]);
+    if (msgLen < 8 || 20 + msgLen > size) {
+      return false;
+    }
+    const uint8_t* attr = data + 20 + msgLen - 8;
+    return attr[0] == 0x80 && attr[1] == 0x28;
+  }
+
+  void onStunMessage(BatchedUdpSocket::Datagram& d) {
+    if (d.size < 20) {
+      stats.dropped++;
+      return;
+    }
+    bool hasFingerprint = endsWithFingerprint(d.data, d.size);
+    StunMessage req;
+    if (StunMessage::parse(d.data, d.size, req, hasFingerprint) != 0) {
+      stats.dropped++;
+      return;
+    }
+    if (req.getClass() != StunClass::request) {
+      stats.dropped++;  // indications other than Send, or stray responses.
+      return;
+    }
+    stats.requests++;
+
+    Auth auth;
+    if (!authenticate(d, req, hasFingerprint, auth)) {
+      return;
+    }
+    const Auth* signer = authRequired() ? &auth : nullptr;
+
+    switch (req.getMethod()) {
+      case StunMethod::Allocate:
+        onAllocate(d.endpoint, req, signer);
+        break;
+      case StunMethod::Refresh:
+        onRefresh(d.endpoint, req, signer);
+        break;
+      case StunMethod::CreatePermission:
+        onCreatePermission(d.endpoint, req, signer);
+        break;
+      case StunMethod::ChannelBind:
+        onChannelBind(d.endpoint, req, signer);
+        break;
+      default:
+        sendError(d.endpoint, req, 400, "Bad Request", signer);
+        break;
+    }
+  }
+
+  bool authRequired() const { return !options.users.empty() || rest.enabled(); }
+
+  static int64_t unixSeconds() {
+    using namespace std::chrono;
+    return duration_cast<seconds>(system_clock::now().time_since_epoch()).count();
+  }
+
+  // password of auth.username that signed the request, from the static users or REST.
+  bool findPassword(BatchedUdpSocket::Datagram& d, bool hasFingerprint, Auth& auth) {
+    auto user = options.users.find(auth.username);
+    if (user != options.users.end()) {
+      auth.password = user->second;
+      return StunMessage::checkMessageIntegrity(d.data, d.size, hasFingerprint, auth.username,
+                                                auth.password, options.realm);
+    }
+    for (string& password : rest.candidates(auth.username, unixSeconds())) {
+      if (StunMessage::checkMessageIntegrity(d.data, d.size, hasFingerprint, auth.username,
+                                             password, options.realm)) {
+        auth.password = std::move(password);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // long-term credentials (RFC 5389 10.2.2). Return false if an error was sent.
+  bool authenticate(BatchedUdpSocket::Datagram& d, StunMessage& req, bool hasFingerprint,
+                    Auth& auth) {
+    if (!authRequired()) {
+      return true;
+    }
+    if (!hasAttribute(d.data, d.size, StunAttributeType::MESSAGE_INTEGRITY)) {
+      sendError(d.endpoint, req, 401, "Unauthorized", nullptr, true);
+      return false;
+    }
+    auth.username = req.getAttr_USERNAME();
+    if (!findPassword(d, hasFingerprint, auth)) {
+      sendError(d.endpoint, req, 401, "Unauthorized", nullptr, true);
+      return false;
+    }
+    if (nonces.check(req.getAttr_NONCE(), d.endpoint, now) != StatelessNonce::Result::valid) {
+      sendError(d.endpoint, req, 438, "Stale Nonce", nullptr, true);
+      return false;
+    }
+    return true;
+  }
+
+  StunMessage response(const StunMessage& req, StunClass clz) {
+    StunMessage r;
+    uint32_t transId[3];
+    std::copy(req.getTransactionId(), req.getTransactionId() + 3, transId);
+    r.setTransactionId(transId);
+    r.setMethod(req.getMethod());
+    r.setClass(clz);
+    r.setFingerprint(true);
+    return r;
+  }
+
+  void send(StunMessage& msg, const asio::ip::udp::endpoint& to, const Auth* signer) {
+    if (signer != nullptr) {
+      msg.setIntegrityKey(signer->username, options.realm, signer->password);
+    }
+    std::vector<uint8_t> bin = msg.binary();
+    if (replyConnection != nullptr) {
+      replyConnection->send(bin.data(), bin.size());
+    } else {
+      listener->send(bin.data(), bin.size(), to);
+    }
+  }
+
+  void sendError(const asio::ip::udp::endpoint& to, const StunMessage& req, int code,
+                 const string& reason, const Auth* signer, bool withNonce = false) {
+    StunMessage r = response(req, StunClass::errorResponse);
+    r.setAttr_ERROR_CODE(code, reason);
+    if (withNonce) {
+      r.setAttr_REALM(options.realm);
+      string nonce = nonces.generate(to, now);
+      r.setAttr_NONCE((const uint8_t*)nonce.data(), nonce.size());
+    }
+    send(r, to, signer);
+    stats.errorResponses++;
+  }
+
+  uint32_t grantedLifetime(StunMessage& req) {
+    uint32_t lifetime = options.defaultLifetime;
+    uint32_t requested;
+    if (req.getAttr_LIFETIME(requested)) {
+      lifetime = requested == 0 ? 0 : std::min(std::max(requested, options.defaultLifetime),
+                                               options.maxLifetime);
+    }
+    return lifetime;
+  }
+
+  // bind the relayed socket of `a` on `port`, which it then owns. false if port is 0 or the
+  // bind fails; a reserved neighbour (token) is returned to the pool then.
+  bool openRelayOn(Allocation& a, uint16_t port, uint64_t token) {
+    if (port == 0) {
+      return false;
+    }
+    PortAllocator::Lease lease(&ports, port);
+    try {
+      a.relay.reset(new BatchedUdpSocket(
+          ioContext, asio::ip::udp::endpoint(options.relayAddress, port), options.relayBatch));
+    } catch (std::exception& e) {
+      W_LOG("relayed socket bind on port {} failed: {}", port, e.what());
+      if (token != 0) {
+        ports.release(ports.redeem(token, now));
+      }
+      return false;
+    }
+    a.port = std::move(lease);
+    a.reservationToken = token;
+    return true;
+  }
+
+  // pick a port from the pool as EVEN-PORT asks, try the next one if it is taken.
+  bool openRelay(Allocation& a, bool evenPort, bool reserveNext) {
+    for (int i = 0; i < maxBindAttempts; i++) {
+      uint64_t token = 0;
+      uint16_t port = !evenPort     ? ports.allocate()
+                      : reserveNext ? ports.allocatePair(token, now)
+                                    : ports.allocateEven();
+      if (port == 0) {
+        W_LOG("relay port range {}-{} exhausted", options.minPort, options.maxPort);
+        return false;
+      }
+      if (openRelayOn(a, port, token)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void sendAllocateSuccess(Record& a, StunMessage& req, const Auth* signer) {
+    Allocation& state = allocations.state(a);
+    StunMessage r = response(req, StunClass::successResponse);
+    r.setAttr_XOR_RELAYED_ADDRESS(state.relayed);
+    int64_t lifetimeMs = std::max<int64_t>(0, allocations.expiryOf(a) - now);
+    r.setAttr_LIFETIME((uint32_t)(lifetimeMs / 1000));
+    r.setAttr_XOR_MAPPED_ADDRESS(state.peers.client);
+    if (state.reservationToken != 0) {
+      r.setAttr_RESERVATION_TOKEN(state.reservationToken);
+    }
+    send(r, state.peers.client, signer);
+  }
+
+  // RFC 5766 6.2.
+  void onAllocate(const asio::ip::udp::endpoint& client, StunMessage& req,
+                  const Auth* signer) {
+    Record* existing = findAllocation(client, replyConnection);
+    bool held = allocations.find(clientKey(client, replyConnection)) != nullptr;
+    if (existing == nullptr && held) {
+      // the 5-tuple is still held by a connection whose close is not handled yet.
+      sendError(client, req, 437, "Allocation Mismatch", signer);
+      return;
+    }
+    if (existing != nullptr) {
+      const uint32_t* id = req.getTransactionId();
+      if (std::equal(id, id + 3, allocations.state(*existing).allocateTransId)) {
+        sendAllocateSuccess(*existing, req, signer);  // retransmission
+      } else {
+        sendError(client, req, 437, "Allocation Mismatch", signer);
+      }
+      return;
+    }
+
+    uint8_t transport = req.getAttr_REQUESTED_TRANSPORT();
+    if (transport == 0) {
+      sendError(client, req, 400, "Bad Request", signer);
+      return;
+    }
+    if (transport != 17) {
+      sendError(client, req, 442, "Unsupported Transport Protocol", signer);
+      return;
+    }
+    bool reserveNext = false;
+    uint64_t token = 0;
+    bool evenPort = req.getAttr_EVEN_PORT(reserveNext);
+    bool redeem = req.getAttr_RESERVATION_TOKEN(token);
+    if (evenPort && redeem) {
+      sendError(client, req, 400, "Bad Request", signer);
+      return;
+    }
+    if (allocations.size() >= allocations.maxSize()) {
+      sendError(client, req, 508, "Insufficient Capacity", signer);
+      return;
+    }
+
+    std::unique_ptr<Allocation> a(new Allocation());
+    a->peers.client = client;
+    a->peers.tcp = replyConnection;
+    bool opened = redeem ? openRelayOn(*a, ports.redeem(token, now), 0)
+                         : openRelay(*a, evenPort, reserveNext);
+    if (!opened) {
+      sendError(client, req, 508, "Insufficient Capacity", signer);
+      return;
+    }
+    if (options.gro) {
+      a->relay->enableGro();
+    }
+    a->relayed = a->relay->socket().local_endpoint();
+    std::copy(req.getTransactionId(), req.getTransactionId() + 3, a->allocateTransId);
+    a->username = signer != nullptr ? signer->username : "";
+    a->peers.limit.configure(options.allocationLimit);
+    if (options.userLimits) {
+      a->peers.userLimit = options.userLimits->bucketOf(a->username);
+    }
+    if (counterShard != nullptr) {
+      Accounting& acc = a->peers.accounting;
+      acc.counters = options.counters;
+      acc.allocation = acc.counters->acquire(fmt::format("allocation:{}:{}/{}",
+                                                         client.address().to_string(),
+                                                         client.port(), a->relayed.port()));
+      acc.user = acc.counters->acquire("user:" + a->username);
+    }
+
+    Allocation& state = *a;
+    int64_t expireAt = now + (int64_t)std::max(grantedLifetime(req), 1u) * 1000;
+    Record* r = allocations.insert(clientKey(client, replyConnection), std::move(a), expireAt);
+    lastAllocation = nullptr;
+    r->channels = &state.peers;
+    r->relay = state.relay.get();
+    r->relay->startReceive([this, r](BatchedUdpSocket::Datagram* batch, size_t count) {
+      onPeerDatagrams(*r, batch, count);
+    });
+    stats.allocationsCreated++;
+
+    D_LOG("allocation {}:{} relayed on {}:{}", client.address().to_string(), client.port(),
+          state.relayed.address().to_string(), state.relayed.port());
+    sendAllocateSuccess(*r, req, signer);
+  }
+
+  // common checks of requests on an existing allocation, send the error if any.
+  Record* allocationFor(const asio::ip::udp::endpoint& client, StunMessage& req,
+                        const Auth* signer) {
+    Record* a = findAllocation(client, replyConnection);
+    if (a == nullptr) {
+      sendError(client, req, 437, "Allocation Mismatch", signer);
+      return nullptr;
+    }
+    if (signer != nullptr && signer->username != allocations.state(*a).username) {
+      sendError(client, req, 441, "Wrong Credentials", signer);
+      return nullptr;
+    }
+    return a;
+  }
+
+  // RFC 5766 7.2.
+  void onRefresh(const asio::ip::udp::endpoint& client, StunMessage& req, const Auth* signer) {
+    Record* a = allocationFor(client, req, signer);
+    if (a == nullptr) {
+      return;
+    }
+    uint32_t lifetime = grantedLifetime(req);
+    StunMessage r = response(req, StunClass::successResponse);
+    r.setAttr_LIFETIME(lifetime);
+    if (lifetime == 0) {
+      eraseAllocation(*a);
+    } else {
+      allocations.setExpiry(*a, now + (int64_t)lifetime * 1000);
+    }
+    send(r, client, signer);
+  }
+
+  // RFC 5766 9.2.
+  void onCreatePermission(const asio::ip::udp::endpoint& client, StunMessage& req,
+                          const Auth* signer) {
+    Record* a = allocationFor(client, req, signer);
+    if (a == nullptr) {
+      return;
+    }
+    std::vector<asio::ip::udp::endpoint> peers = req.getAttr_XOR_PEER_ADDRESS();
+    if (peers.empty()) {
+      sendError(client, req, 400, "Bad Request", signer);
+      return;
+    }
+    for (auto& peer : peers) {
+      a->channels->permissions[PeerKey::of(peer, false)] = now + permissionLifetimeMs;
+    }
+    StunMessage r = response(req, StunClass::successResponse);
+    send(r, client, signer);
+  }
+
+  // RFC 5766 11.2.
+  void onChannelBind(const asio::ip::udp::endpoint& client, StunMessage& req,
+                     const Auth* signer) {
+    Record* a = allocationFor(client, req, signer);
+    if (a == nullptr) {
+      return;
+    }
+    uint16_t channel = req.getAttr_CHANNEL_NUMBER();
+    std::vector<asio::ip::udp::endpoint> peers = req.getAttr_XOR_PEER_ADDRESS();
+    if (channel < PermissionCache::minChannel || channel > PermissionCache::maxChannel ||
+        peers.size() != 1) {
+      sendError(client, req, 400, "Bad Request", signer);
+      return;
+    }
+    const asio::ip::udp::endpoint& peer = peers[0];
+
+    // a channel is bound to one peer and a peer to one channel, for the allocation lifetime.
+    PeerTable& table = *a->channels;
+    Channel* c = table.channels.bind(channel, peer);
+    if (c == nullptr) {
+      sendError(client, req, 400, "Bad Request", signer);
+      return;
+    }
+    c->expireAt = now + channelLifetimeMs;
+    table.permissions[PeerKey::of(peer, false)] = now + permissionLifetimeMs;
+
+    StunMessage r = response(req, StunClass::successResponse);
+    send(r, client, signer);
+  }
+
+
+  // ---------------------------------------------------------------- expiry
+
+  void sweep() {
+    now = clockMs();
+    size_t expired = allocations.sweep(now, [](Record&, Allocation&) {});
+    ports.expire(now);
+    nonces.rotate(now);
+    if (expired > 0) {
+      lastAllocation = nullptr;
+      stats.allocationsExpired += expired;
+    }
+    // stale permissions only cost memory, purge them every permissionPurgeRounds sweeps so
+    // the per second sweep stays a scan of the expiry array.
+    if (++sweepRound % permissionPurgeRounds == 0) {
+      allocations.forEach([this](Record&, Allocation& a) {
+        auto& permissions = a.peers.permissions;
+        for (auto p = permissions.begin(); p != permissions.end();) {
+          p = now >= p->second ? permissions.erase(p) : std::next(p);
+        }
+        // expired channel numbers stay reserved for the peer (RFC 5766 11.), until the
+        // allocation goes away; only the permission table shrinks here.
+      });
+    }
+    armSweep();
+  }
+
+  void armSweep() {
+    sweepTimer.expires_after(std::chrono::seconds(1));
+    sweepTimer.async_wait([this](const asio::error_code& ec) {
+      if (!ec) {
+        sweep();
+      }
+    });
+  }
+
+  void init() {
+    if (options.counters) {
+      counterShard = &options.counters->shard(options.counterShard);
+    }
+    if (!options.userLimits && options.userLimit.bytesPerSecond > 0) {
+      options.userLimits = std::make_shared<UserRateLimits>(options.userLimit);
+    }
+    if (options.relayAddress.is_unspecified()) {
+      options.relayAddress = listener->socket().local_endpoint().address();
+      if (options.relayAddress.is_unspecified()) {
+        W_LOG("TurnServer relay address is unspecified, set Options::relayAddress");
+      }
+    }
+    if (options.gro) {
+      listener->enableGro();
+    }
+  }
+
+
+ public:
+  TurnServer(asio::io_context& ioContext_, const asio::ip::udp::endpoint& listen,
+             const Options& options_)
+      : ioContext(ioContext_),
+        options(options_),
+        listener(new BatchedUdpSocket(ioContext_, listen, options_.batch)),
+        sweepTimer(ioContext_),
+        nonces(options_.nonce, clockMs()),
+        rest(options_.restSecrets),
+        random(std::random_device()()),
+        ports(options_.minPort, options_.maxPort),
+        allocations(options_.maxAllocations, clockMs()) {
+    init();
+  }
+
+  TurnServer(asio::io_context& ioContext_, const asio::ip::udp::endpoint& listen)
+      : TurnServer(ioContext_, listen, Options()) {}
+
+  // adopt a bound listening socket, e.g. one SO_REUSEPORT socket per shard.
+  TurnServer(asio::io_context& ioContext_, asio::ip::udp::socket&& listenSocket,
+             const Options& options_)
+      : ioContext(ioContext_),
+        options(options_),
+        listener(new BatchedUdpSocket(ioContext_, std::move(listenSocket), options_.batch)),
+        sweepTimer(ioContext_),
+        nonces(options_.nonce, clockMs()),
+        rest(options_.restSecrets),
+        random(std::random_device()()),
+        ports(options_.minPort, options_.maxPort),
+        allocations(options_.maxAllocations, clockMs()) {
+    init();
+  }
+
+  TurnServer(const TurnServer&) = delete;
+  TurnServer& operator=(const TurnServer&) = delete;
+
+  void start() {
+    now = clockMs();
+    listener->startReceive([this](BatchedUdpSocket::Datagram* batch, size_t count) {
+      onClientDatagrams(batch, count);
+    });
+    if (options.tcp) {
+      auto local = listener->socket().local_endpoint();
+      acceptor.reset(new asio::ip::tcp::acceptor(
+          ioContext, asio::ip::tcp::endpoint(local.address(), local.port())));
+      accept();
+    }
+    armSweep();
+    I_LOG("TurnServer listening on {}:{}{}, relay address {}, auth={}",
+          listener->socket().local_endpoint().address().to_string(),
+          listener->socket().local_endpoint().port(), options.tcp ? " udp+tcp" : "",
+          options.relayAddress.to_string(), authRequired());
+  }
+
+  // drop every allocation and stop listening.
+  void stop() {
+    settleRelays();
+    sweepTimer.cancel();
+    allocations.clear();
+    lastAllocation = nullptr;
+    listener->socket().close();
+    if (acceptor) {
+      acceptor->close();
+    }
+    for (auto& pair : connections) {
+      pair.second->close();
+    }
+    connections.clear();
+  }
+
+  asio::ip::udp::endpoint localEndpoint() const {
+    return listener->socket().local_endpoint();
+  }
+
+  size_t allocationCount() const { return allocations.size(); }
+  size_t connectionCount() const { return connections.size(); }
+
+  // bytes held by the server: allocation table, relayed sockets and per-allocation state.
+  // Permissions are counted as one hash node each.
+  size_t memoryBytes() {
+    size_t rst = sizeof(*this) + listener->memoryBytes() + allocations.memoryBytes();
+    allocations.forEach([&rst](Record&, Allocation& a) {
+      const size_t node = 4 * sizeof(void*);
+      rst += sizeof(Allocation) + a.relay->memoryBytes() + a.username.capacity() +
+             a.peers.permissions.size() * (sizeof(PeerKey) + sizeof(int64_t) + node) +
+             a.peers.channels.memoryBytes();
+    });
+    return rst;
+  }
+
+  const Stats& statistics() const { return stats; }
+  // rotate REST secrets: add the new one, remove the old one once its usernames expired.
+  void addRestSecret(const string& secret) { rest.addSecret(secret); }
+  void removeRestSecret(const string& secret) { rest.removeSecret(secret); }
+
+  // the nonce a 401 to this client would carry.
+  string nonceFor(const asio::ip::udp::endpoint& client) const {
+    return nonces.generate(client, clockMs());
+  }
+};
+
+
+}  // namespace HelloCoturn
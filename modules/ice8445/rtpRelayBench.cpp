@@ -0,0 +1,337 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "asio.hpp"
+#include "seeker/logger.h"
+#include "seeker/pacer.h"
+#include "EndpointResolver.h"
+#include "RelayFrame.h"
+#include "RtpStream.h"
+#include "TurnClient.h"
+
+using asio::ip::udp;
+using HelloCoturn::RtpReceiverStats;
+using HelloCoturn::RtpSource;
+using HelloCoturn::TurnClient;
+using Endpoints = HelloCoturn::EndpointResolver::Endpoints;
+
+
+struct BenchOptions {
+  double bitrateKbps = 64;
+  int64_t ptimeMs = 20;
+  size_t payload = 0;  // 0: bitrate * ptime, one packet per ptime
+  int64_t seconds = 10;
+  uint32_t clockRate = 90000;
+  std::string peerAddress = "127.0.0.1";
+};
+
+
+/*
+One stream: a TURN session sending RTP as ChannelData to the relay, and the local peer
+socket the relay delivers it to.
+*/
+struct Stream {
+  TurnClient::Session* session = nullptr;
+  udp::socket peer;
+  seeker::Pacer::StreamId paced = 0;
+  RtpSource source;
+  RtpReceiverStats stats;
+  uint16_t channel = 0;
+  double credit = 0;  // payload bytes the bitrate allows but not sent yet
+  uint64_t sent = 0;
+  uint64_t sendErrors = 0;
+  std::vector<uint8_t> tx;
+  std::vector<uint8_t> rx;
+
+  Stream(asio::io_context& ioContext, uint32_t clockRate, size_t payload)
+      : peer(ioContext),
+        stats(clockRate),
+        tx(RtpSource::headerBytes + payload),
+        rx(RtpSource::headerBytes + payload + 64) {}
+
+  // against what was sent: the receiver's RFC 3550 count cannot see losses at the tail.
+  uint64_t lost() const { return sent > stats.received() ? sent - stats.received() : 0; }
+};
+
+
+/*
+Paced RTP through the relay: open one allocation per stream with a ChannelBind towards a
+peer socket of this process, stream for `seconds`, then report per stream what the peer got.
+All streams share one seeker::Pacer, each wakeup sends the packets of every stream due.
+*/
+class RtpRelayBench {
+  asio::io_context& ioContext;
+  TurnClient& client;
+  BenchOptions options;
+  std::vector<std::unique_ptr<Stream>> streams;
+  size_t pendingSetups = 0;
+  size_t failedSetups = 0;
+  std::chrono::steady_clock::time_point startedAt;
+  asio::steady_timer control;
+  seeker::Pacer pacer;
+  std::vector<Stream*> pacedStreams;  // by pacer stream id
+
+  double bytesPerPtime() const {
+    return options.bitrateKbps * 1000 / 8 * options.ptimeMs / 1000;
+  }
+
+  void onSetup(Stream& s, const TurnClient::SetupResult& r) {
+    if (r.errorCode != 0 || r.channels.empty() || r.channels[0] == 0) {
+      W_LOG("stream setup failed, error={}", r.errorCode);
+      failedSetups++;
+      client.close(*s.session);
+      s.session = nullptr;
+    } else {
+      s.channel = r.channels[0];
+    }
+    if (--pendingSetups == 0) {
+      startStreams();
+    }
+  }
+
+  void startStreams() {
+    I_LOG("{} streams ready, {} failed, streaming {}s at {}kbps, ptime {}ms, payload {}B",
+          streams.size() - failedSetups, failedSetups, options.seconds, options.bitrateKbps,
+          options.ptimeMs, options.payload);
+    startedAt = std::chrono::steady_clock::now();
+    std::chrono::milliseconds ptime(options.ptimeMs);
+    for (size_t i = 0; i < streams.size(); i++) {
+      Stream& s = *streams[i];
+      if (s.session == nullptr) {
+        continue;
+      }
+      receive(s);
+      // spread the streams over one ptime instead of sending them all at once.
+      s.paced = pacer.add(ptime, ptime * i / streams.size());
+      pacedStreams.resize(std::max<size_t>(pacedStreams.size(), s.paced + 1));
+      pacedStreams[s.paced] = &s;
+    }
+    pacer.resetStatistics();
+    control.expires_at(startedAt + std::chrono::seconds(options.seconds));
+    control.async_wait([this](const asio::error_code&) { stop(); });
+  }
+
+  void onDue(std::vector<seeker::Pacer::Due>& due) {
+    for (auto& d : due) {
+      Stream& s = *pacedStreams[d.stream];
+      s.credit += bytesPerPtime();
+      while (s.credit >= options.payload) {
+        s.credit -= options.payload;
+        send(s);
+      }
+      s.source.advance((uint32_t)(options.clockRate * options.ptimeMs / 1000));
+    }
+  }
+
+  void send(Stream& s) {
+    size_t size = s.source.write(s.tx.data(), options.payload, RtpSource::nowNs());
+    auto frame = HelloCoturn::RelayFrame::channelData(s.channel, s.tx.data(), size);
+    asio::error_code ec;
+    s.session->udpSocket().send(frame.buffers(), 0, ec);
+    if (ec) {
+      s.sendErrors++;
+    } else {
+      s.sent++;
+    }
+  }
+
+  void receive(Stream& s) {
+    s.peer.async_receive(asio::buffer(s.rx), [this, &s](const asio::error_code& ec, size_t n) {
+      if (ec) {
+        return;
+      }
+      s.stats.onPacket(s.rx.data(), n, RtpSource::nowNs());
+      receive(s);
+    });
+  }
+
+  void stop() {
+    for (auto& s : streams) {
+      if (s->session != nullptr) {
+        pacer.remove(s->paced);
+      }
+    }
+    // let the packets in flight arrive.
+    control.expires_after(std::chrono::milliseconds(500));
+    control.async_wait([this](const asio::error_code&) {
+      for (auto& s : streams) {
+        asio::error_code ignored;
+        s->peer.close(ignored);
+      }
+      report();
+      release();
+    });
+  }
+
+  void report() {
+    double seconds = (double)options.seconds;
+    uint64_t sent = 0, received = 0, bytes = 0, sendErrors = 0, lost = 0;
+    double delaySum = 0, delayMax = 0, jitterSum = 0, jitterMax = 0;
+    size_t measured = 0;
+    for (size_t i = 0; i < streams.size(); i++) {
+      Stream& s = *streams[i];
+      if (s.channel == 0) {
+        continue;
+      }
+      const RtpReceiverStats& r = s.stats;
+      auto line = fmt::format(
+          "stream {} channel {:#x}: sent={} received={} lost={} ({:.2f}%) {:.1f}kbps "
+          "delay {:.3f}/{:.3f}ms jitter {:.3f}ms",
+          i, s.channel, s.sent, r.received(), s.lost(), s.sent ? s.lost() * 100.0 / s.sent : 0,
+          r.bytes() * 8 / seconds / 1000, r.meanDelayMs(), r.maxDelayMs(), r.jitterMs());
+      if (streams.size() <= 16) {
+        I_LOG("{}", line);
+      } else {
+        D_LOG("{}", line);
+      }
+      sent += s.sent;
+      sendErrors += s.sendErrors;
+      received += r.received();
+      bytes += r.bytes();
+      lost += s.lost();
+      if (r.received() == 0) {
+        continue;
+      }
+      measured++;
+      delaySum += r.meanDelayMs();
+      delayMax = std::max(delayMax, r.maxDelayMs());
+      jitterSum += r.jitterMs();
+      jitterMax = std::max(jitterMax, r.jitterMs());
+    }
+    size_t n = std::max<size_t>(measured, 1);
+    I_LOG("sent={} sendErrors={} received={} lost={} ({:.3f}%)", sent, sendErrors, received,
+          lost, sent > 0 ? lost * 100.0 / sent : 0.0);
+    I_LOG("delivered {:.3f}Mbps, {:.0f}pps", bytes * 8 / seconds / 1e6, received / seconds);
+    I_LOG("one-way delay mean {:.3f}ms max {:.3f}ms, jitter mean {:.3f}ms max {:.3f}ms",
+          delaySum / n, delayMax, jitterSum / n, jitterMax);
+    auto& p = pacer.statistics();
+    I_LOG("pacer: {} releases in {} wakeups, late mean {:.1f}us max {:.1f}us, {} over 100us",
+          p.released, p.wakeups, p.meanLateUs(), p.lateMaxNs / 1e3, p.lateOver100us);
+  }
+
+  // delete the allocations, run() returns once the last one is gone.
+  void release() {
+    for (auto& s : streams) {
+      if (s->session == nullptr) {
+        continue;
+      }
+      TurnClient::Session* session = s->session;
+      s->session = nullptr;
+      session->refresh(0, [this, session](int) {
+        client.close(*session);
+        if (client.sessionCount() == 0) {
+          client.closeIdleConnections();
+        }
+      });
+    }
+  }
+
+ public:
+  RtpRelayBench(asio::io_context& ioContext_, TurnClient& client_, const BenchOptions& o)
+      : ioContext(ioContext_),
+        client(client_),
+        options(o),
+        control(ioContext_),
+        pacer(ioContext_, [this](std::vector<seeker::Pacer::Due>& due) { onDue(due); }) {
+    if (options.payload == 0) {
+      options.payload = (size_t)bytesPerPtime();
+    }
+    options.payload = std::min(std::max(options.payload, RtpSource::minPayload),
+                               HelloCoturn::RelayFrame::maxPayload - RtpSource::headerBytes);
+  }
+
+  void start(size_t count) {
+    asio::ip::address peerAddress = asio::ip::make_address(options.peerAddress);
+    pendingSetups = count;
+    for (size_t i = 0; i < count; i++) {
+      streams.emplace_back(new Stream(ioContext, options.clockRate, options.payload));
+      Stream& s = *streams.back();
+      s.source.ssrc = (uint32_t)(0x10000 + i);
+      s.peer.open(peerAddress.is_v6() ? udp::v6() : udp::v4());
+      s.peer.bind(udp::endpoint(peerAddress, 0));
+      s.session = &client.open();
+      s.session->setup({s.peer.local_endpoint()},
+                       [this, &s](const TurnClient::SetupResult& r) { onSetup(s, r); });
+    }
+  }
+};
+
+
+/*
+usage: rtpRelayBench serverHost port streams [username password] [key=value ...]
+  keys: bitrate=kbps (64), ptime=ms (20), payload=bytes (bitrate * ptime, one packet per
+  ptime; smaller payloads send several packets per ptime), seconds=10, peer=127.0.0.1.
+  streams synthetic RTP through `streams` allocations to peer sockets of this process and
+  prints throughput, loss, one-way delay and RFC 3550 jitter.
+*/
+int main(int argc, char* argv[]) {
+  seeker::Logger::init();
+
+  if (argc < 4) {
+    std::cout << "usage: rtpRelayBench server port streams [username password] [key=value ...]"
+              << std::endl;
+    return 1;
+  }
+
+  try {
+    asio::io_context ioContext(1);
+    std::string host = argv[1];
+    uint16_t port = (uint16_t)std::stoi(argv[2]);
+    size_t count = std::stoul(argv[3]);
+
+    TurnClient::Options options;
+    options.maxSessions = count;
+    BenchOptions bench;
+    std::vector<std::string> credentials;
+    for (int i = 4; i < argc; i++) {
+      std::string arg = argv[i];
+      auto eq = arg.find('=');
+      if (eq == std::string::npos) {
+        credentials.push_back(arg);
+        continue;
+      }
+      std::string key = arg.substr(0, eq);
+      std::string value = arg.substr(eq + 1);
+      if (key == "bitrate") {
+        bench.bitrateKbps = std::stod(value);
+      } else if (key == "ptime") {
+        bench.ptimeMs = std::stoll(value);
+      } else if (key == "payload") {
+        bench.payload = std::stoul(value);
+      } else if (key == "seconds") {
+        bench.seconds = std::stoll(value);
+      } else if (key == "peer") {
+        bench.peerAddress = value;
+      } else {
+        std::cout << "unknown option: " << arg << std::endl;
+        return 1;
+      }
+    }
+    if (credentials.size() == 2) {
+      options.username = credentials[0];
+      options.password = credentials[1];
+    }
+
+    HelloCoturn::EndpointResolver resolver(ioContext);
+    std::unique_ptr<TurnClient> client;
+    std::unique_ptr<RtpRelayBench> rtp;
+    resolver.resolve(host, port, [&](const asio::error_code& ec, const Endpoints& servers) {
+      if (ec) {
+        E_LOG("resolve {} failed: {}", host, ec.message());
+        return;
+      }
+      client.reset(new TurnClient(ioContext, servers.front(), options));
+      rtp.reset(new RtpRelayBench(ioContext, *client, bench));
+      rtp->start(count);
+    });
+    ioContext.run();
+  } catch (std::exception& ex) {
+    std::cout << "Got exception: " << ex.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -3,6 +3,7 @@
 #include "asio.hpp"
 #include "seeker/logger.h"
 #include "seeker/random.h"
+#include "EndpointResolver.h"
 #include "MessageBuilder.h"
 #include <iomanip>
 
@@ -75,13 +76,26 @@ void sendAndReceiveTest1() {
   asio::io_context ioContext;
 
   std::string host = "152.136.24.142";
-  std::string port = "52010";
-
-  udp::resolver resolver(ioContext);
-  udp::endpoint remote = *(resolver.resolve(udp::v4(), host, port).begin());
+  uint16_t port = 52010;
+
+  HelloCoturn::EndpointResolver resolver(ioContext);
+  udp::endpoint remote;
+  resolver.resolve(host, port,
+                   [&](const asio::error_code& ec,
+                       const HelloCoturn::EndpointResolver::Endpoints& endpoints) {
+                     if (ec) {
+                       E_LOG("resolve {} failed: {}", host, ec.message());
+                       return;
+                     }
+                     remote = endpoints.front();
+                   });
+  ioContext.run();
+  if (remote.port() == 0) {
+    return;
+  }
 
   udp::socket socket(ioContext);
-  socket.open(udp::v4());
+  socket.open(remote.protocol());
 
   std::vector<uint8_t> sendBuf = buildAllocation(600);
   socket.send_to(asio::buffer(sendBuf), remote);
@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include "asio.hpp"
+#include "seeker/logger.h"
+#include "EndpointResolver.h"
+#include "TurnClient.h"
+
+using asio::ip::udp;
+using HelloCoturn::TurnClient;
+using Endpoints = HelloCoturn::EndpointResolver::Endpoints;
+
+
+struct LoadStats {
+  size_t started = 0;
+  size_t done = 0;
+  size_t failed = 0;
+  size_t firstRelays = 0;  // sessions that got a first relay time, summed below
+  int64_t firstRelayMsSum = 0;
+  int64_t firstRelayMsMax = 0;
+  // new tcp / tls connections: connect and handshake apart from the TURN setup
+  size_t connections = 0;
+  size_t resumed = 0;
+  double connectMsSum = 0;
+  double handshakeMsSum = 0;
+  double turnMsSum = 0;  // setupMs minus connect and handshake
+};
+
+
+#include "asio/yield.hpp"
+
+/*
+One session: the pipelined setup (Allocate, then CreatePermission and ChannelBind at once),
+then delete the allocation. A stackless coroutine: the function object itself is the
+handler of every step, its whole state is these few members.
+*/
+class SessionFlow : asio::coroutine {
+  TurnClient* client;
+  TurnClient::Session* session;
+  udp::endpoint peer;
+  LoadStats* stats;
+  int errorCode = 0;
+
+  void fail(int code) {
+    W_LOG("session flow failed, error={}", code);
+    stats->failed++;
+  }
+
+ public:
+  SessionFlow(TurnClient& client_, const udp::endpoint& peer_, LoadStats& stats_)
+      : client(&client_), session(&client_.open()), peer(peer_), stats(&stats_) {}
+
+  void operator()(const TurnClient::SetupResult& r) {
+    errorCode = r.errorCode;
+    if (r.firstRelayMs >= 0) {
+      stats->firstRelays++;
+      stats->firstRelayMsSum += r.firstRelayMs;
+      stats->firstRelayMsMax = std::max(stats->firstRelayMsMax, r.firstRelayMs);
+    }
+    if (r.errorCode == 0 && r.connectMs >= 0) {
+      double handshakeMs = std::max(r.handshakeMs, 0.0);
+      stats->connections++;
+      stats->resumed += r.resumed ? 1 : 0;
+      stats->connectMsSum += r.connectMs;
+      stats->handshakeMsSum += handshakeMs;
+      stats->turnMsSum += r.setupMs - r.connectMs - handshakeMs;
+    }
+    (*this)(0);
+  }
+
+  void operator()(int) {
+    reenter(this) {
+      stats->started++;
+      yield session->setup({peer}, std::move(*this));
+      if (errorCode != 0) {
+        fail(errorCode);
+        yield break;
+      }
+      yield session->refresh(0, std::move(*this));
+      stats->done++;
+    }
+    if (is_complete()) {
+      client->close(*session);
+      if (client->sessionCount() == 0) {
+        client->closeIdleConnections();
+      }
+    }
+  }
+};
+
+#include "asio/unyield.hpp"
+
+
+/*
+usage: turnClientLoad serverHost port sessions [username password] [peerAddress:port] [tcp|tls]
+  run `sessions` concurrent pipelined setups (Allocate, then CreatePermission and
+  ChannelBind together) from one thread. A last argument tcp or tls talks to the server over
+  TCP or TLS; with tls the server certificate is checked against CA_CERT_FILE and the host.
+*/
+int main(int argc, char* argv[]) {
+  seeker::Logger::init();
+
+  std::string transport = argc > 4 ? argv[argc - 1] : "";
+  bool tcp = transport == "tcp" || transport == "tls";
+  if (tcp) {
+    argc--;
+  }
+  if (argc < 4) {
+    std::cout << "usage: turnClientLoad server port sessions [username password] [peer:port]"
+              << std::endl;
+    return 1;
+  }
+
+  try {
+    asio::io_context ioContext(1);
+    std::string host = argv[1];
+    uint16_t port = (uint16_t)std::stoi(argv[2]);
+    size_t sessions = std::stoul(argv[3]);
+
+    // every flow asks for the server, the resolver looks it up once.
+    HelloCoturn::EndpointResolver resolver(ioContext);
+
+    TurnClient::Options options;
+    options.maxSessions = sessions;
+    if (transport == "tcp") {
+      options.transport = TurnClient::Transport::tcp;
+    } else if (transport == "tls") {
+#ifdef HELLOCOTURN_WITH_TLS
+      // the CA bundle is parsed here, once for every connection.
+      HelloCoturn::TlsContext::global();
+      options.transport = TurnClient::Transport::tls;
+      asio::error_code ec;
+      asio::ip::make_address(host, ec);
+      // a name, not an IP literal: that one is checked against the certificate's IP entries.
+      options.serverName = ec ? host : "";
+#else
+      std::cout << "built without TLS support." << std::endl;
+      return 1;
+#endif
+    }
+    if (argc > 5) {
+      options.username = argv[4];
+      options.password = argv[5];
+    }
+    std::string peerText = argc > 6 ? argv[6] : "";
+
+    std::unique_ptr<TurnClient> client;
+    LoadStats stats;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < sessions; i++) {
+      resolver.resolve(host, port, [&](const asio::error_code& ec, const Endpoints& servers) {
+        if (ec) {
+          E_LOG("resolve {} failed: {}", host, ec.message());
+          return;
+        }
+        if (!client) {
+          client.reset(new TurnClient(ioContext, servers.front(), options));
+        }
+        udp::endpoint peer(servers.front().address(), 9);
+        if (!peerText.empty()) {
+          auto colon = peerText.rfind(':');
+          peer = udp::endpoint(asio::ip::make_address(peerText.substr(0, colon)),
+                               (unsigned short)std::stoi(peerText.substr(colon + 1)));
+        }
+        SessionFlow(*client, peer, stats)(0);
+      });
+    }
+    ioContext.run();
+
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+    I_LOG("sessions={} done={} failed={} in {}ms, {:.0f} flows/s", stats.started, stats.done,
+          stats.failed, ms, ms > 0 ? stats.done * 1000.0 / ms : 0.0);
+    if (client && tcp) {
+      size_t n = std::max(stats.connections, (size_t)1);
+      I_LOG("{} connections={} reused={} resumed={}", transport, stats.connections,
+            client->connectionsReused(), stats.resumed);
+      I_LOG("mean connect {:.2f}ms, handshake {:.2f}ms, TURN setup after them {:.2f}ms",
+            stats.connectMsSum / n, stats.handshakeMsSum / n, stats.turnMsSum / n);
+    }
+    I_LOG("time to first relayed packet: mean {:.1f}ms, max {}ms",
+          stats.firstRelays > 0 ? (double)stats.firstRelayMsSum / stats.firstRelays : 0.0,
+          stats.firstRelayMsMax);
+  } catch (std::exception& ex) {
+    std::cout << "Got exception: " << ex.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
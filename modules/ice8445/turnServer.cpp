@@ -0,0 +1,88 @@
+#include <iostream>
+#include <string>
+#include "asio.hpp"
+#include "seeker/logger.h"
+#include "ShardedTurnServer.h"
+
+using asio::ip::udp;
+
+
+/*
+usage: turnServer [listenAddress] [port] [relayAddress]
+                  [user:password | secret=S | tcp | shards=N ...]
+  defaults: 0.0.0.0 3478, relay address = listen address (127.0.0.1 if unspecified).
+  secret=S accepts time-limited REST credentials made with the shared secret S.
+  tcp also accepts clients over TCP on the same port.
+  shards=N runs N servers, one thread each, on SO_REUSEPORT sockets of the same port.
+    0 is one per CPU, default 1.
+  without credentials the server accepts unauthenticated requests.
+*/
+int main(int argc, char* argv[]) {
+  seeker::Logger::init();
+
+  try {
+    std::string listenAddress = argc > 1 ? argv[1] : "0.0.0.0";
+    unsigned short port = (unsigned short)(argc > 2 ? std::stoi(argv[2]) : 3478);
+
+    HelloCoturn::TurnServer::Options options;
+    size_t shards = 1;
+    if (argc > 3) {
+      options.relayAddress = asio::ip::make_address(argv[3]);
+    } else {
+      auto address = asio::ip::make_address(listenAddress);
+      options.relayAddress =
+          address.is_unspecified() ? asio::ip::make_address("127.0.0.1") : address;
+    }
+    for (int i = 4; i < argc; i++) {
+      std::string credential = argv[i];
+      if (credential == "tcp") {
+        options.tcp = true;
+        continue;
+      }
+      if (credential.compare(0, 7, "shards=") == 0) {
+        shards = (size_t)std::stoul(credential.substr(7));
+        continue;
+      }
+      if (credential.compare(0, 7, "secret=") == 0) {
+        options.restSecrets.push_back(credential.substr(7));
+        continue;
+      }
+      auto colon = credential.find(':');
+      if (colon == std::string::npos) {
+        std::cout << "bad credential, expect username:password: " << credential << std::endl;
+        return 1;
+      }
+      options.users[credential.substr(0, colon)] = credential.substr(colon + 1);
+    }
+
+    HelloCoturn::ShardedTurnServer server(
+        udp::endpoint(asio::ip::make_address(listenAddress), port), options, shards);
+    server.start();
+
+    // the shards run on their own threads, this one only waits for a signal.
+    asio::io_context ioContext(1);
+    asio::signal_set signals(ioContext, SIGINT, SIGTERM);
+    signals.async_wait([&](const asio::error_code&, int) {
+      size_t allocations = 0;
+      HelloCoturn::TurnServer::Stats total;
+      server.forEach([&](HelloCoturn::TurnServer& shard) {
+        auto& s = shard.statistics();
+        allocations += shard.allocationCount();
+        total.toPeerPackets += s.toPeerPackets;
+        total.toClientPackets += s.toClientPackets;
+        total.dropped += s.dropped;
+      });
+      I_LOG("stopping, shards={} allocations={} toPeer={} toClient={} dropped={}",
+            server.size(), allocations, total.toPeerPackets, total.toClientPackets,
+            total.dropped);
+      server.stop();
+    });
+
+    ioContext.run();
+  } catch (std::exception& ex) {
+    std::cout << "Got exception: " << ex.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
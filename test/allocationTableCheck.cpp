@@ -0,0 +1,69 @@
+#include <cstdint>
+#include <memory>
+#include "asio.hpp"
+#include "AllocationTable.h"
+#include "check.h"
+
+using HelloCoturn::AllocationTable;
+using HelloCoturn::PeerKey;
+
+
+struct Cold {
+  int id = 0;
+};
+struct Channels {};
+using Table = AllocationTable<Cold, Channels>;
+
+
+static PeerKey keyOf(int i) {
+  return PeerKey::of(asio::ip::udp::endpoint(asio::ip::make_address_v4(0x0A000000u + i),
+                                             (unsigned short)(1000 + i)));
+}
+
+
+/*
+AllocationTable expiry: a sweep erases exactly the allocations due, leaves the others
+reachable, and a clear() right after it (TurnServer::stop()) only touches live slots.
+*/
+int main() {
+  const int64_t epoch = 1000000;
+  const int n = 100;
+  Table table(128, epoch);
+  for (int i = 0; i < n; i++) {
+    std::unique_ptr<Cold> c(new Cold());
+    c->id = i;
+    // odd ones expire after 10 s, even ones after 100 s.
+    CHECK(table.insert(keyOf(i), std::move(c), epoch + (i % 2 ? 10000 : 100000)) != nullptr);
+  }
+  CHECK(table.size() == (size_t)n);
+
+  int swept = 0;
+  size_t expired = table.sweep(epoch + 20000, [&](Table::Record&, Cold& c) {
+    CHECK(c.id % 2 == 1);
+    swept++;
+  });
+  CHECK(expired == (size_t)n / 2 && swept == n / 2);
+  CHECK(table.size() == (size_t)n / 2);
+  for (int i = 0; i < n; i++) {
+    Table::Record* r = table.find(keyOf(i));
+    CHECK((r != nullptr) == (i % 2 == 0));
+    if (r != nullptr) {
+      CHECK(table.state(*r).id == i);
+    }
+  }
+
+  // the freed slots are reused, then everything goes at once.
+  for (int i = n; i < n + 10; i++) {
+    std::unique_ptr<Cold> c(new Cold());
+    CHECK(table.insert(keyOf(i), std::move(c), epoch + 100000) != nullptr);
+  }
+  table.clear();
+  CHECK(table.size() == 0);
+  for (int i = 0; i < n + 10; i++) {
+    CHECK(table.find(keyOf(i)) == nullptr);
+  }
+  CHECK(table.insert(keyOf(0), std::unique_ptr<Cold>(new Cold()), epoch + 1000) != nullptr);
+  CHECK(table.size() == 1);
+
+  return checkFailures;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdio>
+
+
+// the checks under test/ count failed CHECKs and return the count from main(), 0 is a pass.
+static int checkFailures = 0;
+
+#define CHECK(cond)                                                                    \
+  do {                                                                                 \
+    if (!(cond)) {                                                                     \
+      std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);   \
+      checkFailures++;                                                                 \
+    }                                                                                  \
+  } while (0)
@@ -0,0 +1,86 @@
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include "seeker/hdrHistogram.h"
+#include "check.h"
+
+using seeker::HdrHistogram;
+
+
+/*
+HdrHistogram indexing: every percentile must land on the slot of the exact answer, so it is
+at least the exact value and above it by less than one slot width, which is the unit
+(2^floor(log2(lowest))) or exact / 10^digits, whichever is larger. Checked over values that
+straddle bucket boundaries, a log-normal spread over 10 decades and layouts with lowest > 1;
+plus clamping and add().
+*/
+static void checkLayout(int64_t lowest, int64_t highest, int digits, uint64_t seed) {
+  HdrHistogram h(lowest, highest, digits);
+  std::vector<int64_t> values;
+  for (int shift = 0; shift < 62 && ((int64_t)1 << shift) <= highest; shift++) {
+    int64_t p = (int64_t)1 << shift;
+    for (int64_t v : {p - 1, p, p + 1}) {
+      if (v <= highest) {
+        values.push_back(v);
+      }
+    }
+  }
+  std::mt19937_64 random(seed);
+  std::lognormal_distribution<double> spread(10, 4);
+  while (values.size() < 200000) {
+    values.push_back(std::min((int64_t)spread(random), highest));
+  }
+  for (int64_t v : values) {
+    h.record(v);
+  }
+  std::sort(values.begin(), values.end());
+
+  double resolution = 1;
+  for (int i = 0; i < digits; i++) {
+    resolution /= 10;
+  }
+  int64_t unit = 1;
+  while (unit * 2 <= lowest) {
+    unit *= 2;
+  }
+
+  CHECK(h.count() == values.size());
+  CHECK(h.min() == values.front());
+  CHECK(h.max() == values.back());
+  CHECK(h.clamped() == 0);
+  int64_t previous = 0;
+  for (double percentile = 0; percentile <= 100; percentile += 0.125) {
+    uint64_t rank = (uint64_t)(percentile / 100.0 * values.size() + 0.5);
+    int64_t exact = values[std::max<uint64_t>(rank, 1) - 1];
+    int64_t found = h.valueAtPercentile(percentile);
+    double tolerance = std::max((double)unit, exact * resolution);
+    CHECK(found >= exact && found - exact < tolerance);
+    CHECK(found >= previous);
+    previous = found;
+  }
+  CHECK(h.valueAtPercentile(100) == values.back());
+
+  // values above highest are clamped and counted.
+  HdrHistogram other(lowest, highest, digits);
+  other.record(highest + 1, 3);
+  CHECK(other.clamped() == 3 && other.max() == highest);
+
+  h.add(other);
+  CHECK(h.count() == values.size() + 3);
+  CHECK(h.clamped() == 3);
+  CHECK(h.valueAtPercentile(100) == highest);
+
+  h.reset();
+  CHECK(h.count() == 0 && h.valueAtPercentile(50) == 0);
+}
+
+
+int main() {
+  checkLayout(1, 60000000000LL, 3, 1);
+  checkLayout(1, 3600000000LL, 2, 2);
+  checkLayout(1000, 60000000000LL, 3, 3);
+  checkLayout(3, 1000000, 5, 4);
+  checkLayout(1, (int64_t)1 << 62, 1, 5);
+  return checkFailures;
+}
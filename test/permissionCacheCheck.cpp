@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "asio.hpp"
+#include "PermissionCache.h"
+#include "check.h"
+
+using HelloCoturn::PermissionCache;
+using Endpoint = asio::ip::udp::endpoint;
+
+
+static Endpoint peerOf(int i) {
+  return Endpoint(asio::ip::make_address_v4(0x0A000000u + i), (unsigned short)(1000 + i));
+}
+
+static void grantAll(PermissionCache& cache, int64_t now, std::vector<Endpoint>& peers) {
+  std::vector<Endpoint> dropped;
+  cache.onPermissionResult(peers, 0, now, dropped);
+  CHECK(dropped.empty());
+  peers.clear();
+}
+
+static bool holds(const std::vector<Endpoint>& peers, int i) {
+  return std::find(peers.begin(), peers.end(), peerOf(i)) != peers.end();
+}
+
+
+/*
+PermissionCache coalescing: peers installed a few ms apart are renewed by the first
+renewal that fires, together with anything else active that comes due within the renew
+margin. Peers due later than that, idle peers, and a clock with nothing due yet are left
+alone.
+*/
+int main() {
+  const int64_t margin = PermissionCache::Options().renewMarginMs;
+  const int64_t lifetime = PermissionCache::permissionLifetimeMs;
+  PermissionCache cache;
+  std::vector<Endpoint> peers;
+
+  // peers 0..2 staggered by a few ms, 3 just outside the margin, 4 never used again.
+  const int64_t installedAt[] = {0, 7, 2500, margin + 1, 3000};
+  for (int i = 0; i < 5; i++) {
+    int64_t now = installedAt[i];
+    cache.addPeer(peerOf(i), now);
+    cache.collectPermissions(now, peers);
+    CHECK(peers.size() == 1 && holds(peers, i));
+    grantAll(cache, now, peers);
+  }
+  CHECK(cache.permissionCount() == 5);
+
+  int64_t now = 100 * 1000;
+  for (int i = 0; i < 4; i++) {
+    cache.touch(peerOf(i), now);
+  }
+
+  int64_t firstDue = lifetime - margin;
+  CHECK(cache.nextDueAt() == firstDue);
+  cache.collectPermissions(firstDue - 1, peers);
+  CHECK(peers.empty());
+
+  cache.collectPermissions(firstDue, peers);
+  CHECK(peers.size() == 3);
+  CHECK(holds(peers, 0) && holds(peers, 1) && holds(peers, 2));
+  grantAll(cache, firstDue, peers);
+
+  // peer 3 is due on its own, it must not drag the fresh batch along.
+  int64_t lateDue = installedAt[3] + lifetime - margin;
+  CHECK(cache.nextDueAt() == lateDue);
+  cache.collectPermissions(lateDue, peers);
+  CHECK(peers.size() == 1 && holds(peers, 3));
+  grantAll(cache, lateDue, peers);
+
+  // the idle peer expired without a renewal and is dropped on the next pass.
+  int64_t idleExpiry = installedAt[4] + lifetime;
+  CHECK(cache.nextDueAt() == idleExpiry);
+  CHECK(!cache.permitted(peerOf(4), idleExpiry));
+  cache.collectPermissions(idleExpiry, peers);
+  CHECK(peers.empty());
+  CHECK(cache.permissionCount() == 4);
+
+  // the batch stays aligned: one renewal for all three the next time round.
+  for (int i = 0; i < 3; i++) {
+    cache.touch(peerOf(i), idleExpiry + 1000);
+  }
+  int64_t nextDue = firstDue + lifetime - margin;
+  CHECK(cache.nextDueAt() == nextDue);
+  cache.collectPermissions(nextDue, peers);
+  CHECK(peers.size() == 3);
+  CHECK(!holds(peers, 3));
+  grantAll(cache, nextDue, peers);
+
+  return checkFailures;
+}
@@ -0,0 +1,140 @@
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+#include "PortAllocator.h"
+#include "check.h"
+
+using HelloCoturn::PortAllocator;
+
+
+// true if the model has a port of the range that is eligible.
+template <typename Eligible>
+static bool anyEligible(uint16_t minPort, uint16_t maxPort, Eligible&& eligible) {
+  for (uint32_t p = minPort; p <= maxPort; p++) {
+    if (eligible((uint16_t)p)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+
+/*
+PortAllocator's bitmaps against a plain array of used ports, over ranges whose ends fall
+inside and on the edges of bitmap words and summaries: random allocate, EVEN-PORT, pairs,
+redeem, claim and release. A port handed out must have been free and of the asked kind, and
+0 only comes when the model has no such port left. A fresh pool hands out the range in
+order from its random start, wrapping around once.
+*/
+static void checkRange(uint16_t minPort, uint16_t maxPort, uint64_t seed) {
+  size_t rangeSize = (size_t)maxPort - minPort + 1;
+  {
+    PortAllocator pool(minPort, maxPort, seed);
+    uint16_t first = pool.allocate();
+    uint16_t expected = first;
+    for (size_t i = 1; i < rangeSize; i++) {
+      expected = expected == maxPort ? minPort : (uint16_t)(expected + 1);
+      CHECK(pool.allocate() == expected);
+    }
+    CHECK(pool.allocate() == 0);
+    CHECK(pool.available() == 0);
+    pool.release(first);
+    CHECK(pool.allocate() == first);
+  }
+
+  PortAllocator pool(minPort, maxPort, seed);
+  std::vector<bool> used(65536, false);
+  std::vector<std::pair<uint64_t, uint16_t>> tokens;  // token, reserved odd port
+  size_t usedCount = 0;
+  std::mt19937 random((uint32_t)seed);
+
+  auto isFree = [&](uint16_t p) { return p >= minPort && p <= maxPort && !used[p]; };
+  auto take = [&](uint16_t p) {
+    CHECK(isFree(p));
+    used[p] = true;
+    usedCount++;
+  };
+  auto reserved = [&](uint16_t p) {
+    for (auto& t : tokens) {
+      if (t.second == p) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  for (int round = 0; round < 20000; round++) {
+    int op = (int)(random() % 10);
+    if (op < 3) {
+      uint16_t p = pool.allocate();
+      if (p != 0) {
+        take(p);
+      } else {
+        CHECK(usedCount == rangeSize);
+      }
+    } else if (op == 3) {
+      uint16_t p = pool.allocateEven();
+      if (p != 0) {
+        CHECK((p & 1) == 0);
+        take(p);
+      } else {
+        CHECK(!anyEligible(minPort, maxPort,
+                           [&](uint16_t q) { return (q & 1) == 0 && isFree(q); }));
+      }
+    } else if (op == 4) {
+      uint64_t token = 0;
+      uint16_t p = pool.allocatePair(token, 0);
+      if (p != 0) {
+        CHECK((p & 1) == 0 && token != 0);
+        take(p);
+        take((uint16_t)(p + 1));
+        tokens.emplace_back(token, (uint16_t)(p + 1));
+      } else {
+        CHECK(!anyEligible(minPort, maxPort, [&](uint16_t q) {
+          return (q & 1) == 0 && q < maxPort && isFree(q) && isFree((uint16_t)(q + 1));
+        }));
+      }
+    } else if (op == 5 && !tokens.empty()) {
+      auto t = tokens.back();
+      tokens.pop_back();
+      CHECK(pool.redeem(t.first, 1) == t.second);
+      CHECK(pool.redeem(t.first, 1) == 0);
+    } else if (op == 6) {
+      uint16_t p = (uint16_t)(minPort + random() % rangeSize);
+      bool wasFree = isFree(p);
+      CHECK(pool.claim(p) == wasFree);
+      if (wasFree) {
+        take(p);
+      }
+    } else if (usedCount > 0) {
+      uint16_t p = (uint16_t)(minPort + random() % rangeSize);
+      if (used[p] && !reserved(p)) {
+        pool.release(p);
+        used[p] = false;
+        usedCount--;
+      }
+    }
+    CHECK(pool.available() == rangeSize - usedCount);
+    if (checkFailures > 0) {
+      return;
+    }
+  }
+
+  // reservations nobody redeemed go back to the pool.
+  CHECK(pool.reservationCount() == tokens.size());
+  pool.expire(PortAllocator::reservationLifetimeMs);
+  usedCount -= tokens.size();
+  CHECK(pool.reservationCount() == 0);
+  CHECK(pool.available() == rangeSize - usedCount);
+}
+
+
+int main() {
+  checkRange(PortAllocator::defaultMinPort, PortAllocator::defaultMaxPort, 1);
+  checkRange(1001, 1300, 2);
+  checkRange(4095, 4161, 3);
+  checkRange(50001, 50004, 4);
+  checkRange(1, 65535, 5);
+  return checkFailures;
+}
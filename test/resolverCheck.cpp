@@ -0,0 +1,56 @@
+#include <string>
+#include <vector>
+#include "asio.hpp"
+#include "EndpointResolver.h"
+#include "check.h"
+
+using HelloCoturn::EndpointResolver;
+
+
+/*
+EndpointResolver on localhost: requests made while the lookup is in flight join it, the
+next one is answered from the cache, an IP literal never reaches the resolver.
+*/
+int main() {
+  asio::io_context ioContext;
+  EndpointResolver resolver(ioContext);
+  std::vector<EndpointResolver::Endpoints> answers;
+  auto onAnswer = [&](const asio::error_code& ec, const EndpointResolver::Endpoints& found) {
+    CHECK(!ec);
+    answers.push_back(found);
+  };
+
+  for (int i = 0; i < 3; i++) {
+    resolver.resolve("localhost", 3478, onAnswer);
+  }
+  CHECK(resolver.statistics().lookups == 1);
+  CHECK(resolver.statistics().coalesced == 2);
+  ioContext.run();
+  CHECK(answers.size() == 3);
+
+  ioContext.restart();
+  resolver.resolve("localhost", 3478, onAnswer);
+  resolver.resolve("127.0.0.1", 3478, onAnswer);
+  ioContext.run();
+  CHECK(answers.size() == 5);
+  CHECK(resolver.statistics().lookups == 1);
+  CHECK(resolver.statistics().hits == 1);
+  CHECK(resolver.size() == 1);
+
+  for (auto& found : answers) {
+    CHECK(!found.empty());
+    for (auto& ep : found) {
+      CHECK(ep.address().is_loopback());
+      CHECK(ep.port() == 3478);
+    }
+  }
+  CHECK(answers[0] == answers[3]);
+
+  ioContext.restart();
+  resolver.clear();
+  resolver.resolve("localhost", 3478, onAnswer);
+  ioContext.run();
+  CHECK(resolver.statistics().lookups == 2);
+
+  return checkFailures;
+}
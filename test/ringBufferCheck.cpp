@@ -0,0 +1,170 @@
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "seeker/ringBuffer.h"
+#include "check.h"
+
+using seeker::FutexWait;
+using seeker::MpscRing;
+using seeker::SpscRing;
+using seeker::YieldWait;
+
+
+const uint64_t itemsPerProducer = 20000;
+
+
+/*
+One producer, one consumer, a ring much smaller than the stream so both sides keep finding
+it full or empty. Single and batch calls are mixed on both sides, the consumer must see
+0, 1, 2... without a gap or a repeat.
+*/
+template <typename Wait>
+static void checkSpsc() {
+  SpscRing<uint64_t, Wait> ring(50);
+  CHECK(ring.maxSize() == 64);
+
+  std::thread producer([&ring]() {
+    uint64_t next = 0;
+    while (next < itemsPerProducer) {
+      if (next % 3 == 0) {
+        ring.push(next++);
+        continue;
+      }
+      uint64_t batch[7];
+      size_t n = 0;
+      while (n < 7 && next + n < itemsPerProducer) {
+        batch[n] = next + n;
+        n++;
+      }
+      next += ring.pushBatch(batch, n);
+    }
+  });
+
+  uint64_t expected = 0;
+  bool ordered = true;
+  while (expected < itemsPerProducer) {
+    uint64_t batch[16];
+    size_t n = 1;
+    if (expected % 5 == 0) {
+      ring.pop(batch[0]);
+    } else {
+      n = ring.popBatchWait(batch, 16);
+    }
+    for (size_t i = 0; i < n; i++) {
+      ordered &= batch[i] == expected++;
+    }
+  }
+  producer.join();
+  CHECK(ordered);
+  CHECK(expected == itemsPerProducer);
+  CHECK(ring.size() == 0);
+}
+
+
+/*
+N producers into one MPSC ring, items tagged (producer << 32 | sequence). Items of different
+producers interleave, but each producer's own sequence must come out complete and in order.
+*/
+template <typename Wait>
+static void checkMpsc(size_t producerCount) {
+  MpscRing<uint64_t, Wait> ring(64);
+
+  std::vector<std::thread> producers;
+  for (size_t p = 0; p < producerCount; p++) {
+    producers.emplace_back([&ring, p]() {
+      uint64_t tag = (uint64_t)p << 32;
+      uint64_t next = 0;
+      while (next < itemsPerProducer) {
+        if (next % 2 == 0) {
+          ring.push(tag | next++);
+          continue;
+        }
+        uint64_t batch[5];
+        size_t n = 0;
+        while (n < 5 && next + n < itemsPerProducer) {
+          batch[n] = tag | (next + n);
+          n++;
+        }
+        next += ring.pushBatch(batch, n);
+      }
+    });
+  }
+
+  std::vector<uint64_t> expected(producerCount, 0);
+  uint64_t total = 0;
+  bool ordered = true;
+  while (total < itemsPerProducer * producerCount) {
+    uint64_t batch[32];
+    size_t n = ring.popBatchWait(batch, 32);
+    for (size_t i = 0; i < n; i++) {
+      size_t p = (size_t)(batch[i] >> 32);
+      if (p >= producerCount) {
+        ordered = false;
+        continue;
+      }
+      ordered &= (batch[i] & 0xFFFFFFFFu) == expected[p]++;
+    }
+    total += n;
+  }
+  for (auto& t : producers) {
+    t.join();
+  }
+  CHECK(ordered);
+  for (uint64_t n : expected) {
+    CHECK(n == itemsPerProducer);
+  }
+  CHECK(ring.size() == 0);
+}
+
+
+/*
+A consumer asleep on an empty FutexWait ring is woken by a late push, and a producer asleep
+on a full one by a late pop.
+*/
+static void checkWakeup() {
+  SpscRing<int, FutexWait> ring(2);
+  std::thread consumer([&ring]() {
+    int value = 0;
+    ring.pop(value);
+    CHECK(value == 1);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  ring.push(1);
+  consumer.join();
+
+  ring.push(2);
+  ring.push(3);
+  std::thread producer([&ring]() { ring.push(4); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  for (int expected = 2; expected <= 4; expected++) {
+    int value = 0;
+    ring.pop(value);
+    CHECK(value == expected);
+  }
+  producer.join();
+}
+
+
+/*
+SpinWait is left out: its waiter never gives the core away, on a single core machine each
+full or empty ring costs a whole time slice. The other two share its code paths.
+*/
+int main() {
+  bool thrown = false;
+  try {
+    seeker::ringCapacityFor(0);
+  } catch (std::runtime_error&) {
+    thrown = true;
+  }
+  CHECK(thrown);
+
+  checkSpsc<YieldWait>();
+  checkSpsc<FutexWait>();
+  checkMpsc<YieldWait>(4);
+  checkMpsc<FutexWait>(4);
+  checkWakeup();
+
+  return checkFailures;
+}
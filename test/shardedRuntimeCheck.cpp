@@ -0,0 +1,70 @@
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "ShardedRuntime.h"
+#include "check.h"
+
+using HelloCoturn::ShardedRuntime;
+
+
+struct Log {
+  std::vector<uint64_t> seen;  // producer << 32 | sequence
+  bool wrongThread = false;
+};
+using Runtime = ShardedRuntime<Log>;
+
+
+/*
+ShardedRuntime::post from several threads at once, move-only tasks, more of them than an
+inbox holds so some spill to asio: every task runs once on its shard's own thread, and each
+producer's tasks run in the order they were posted.
+*/
+int main() {
+  const size_t producerCount = 3;
+  const uint64_t perShard = 5000;
+  Runtime runtime(2, false);
+  runtime.start();
+
+  std::vector<std::thread> producers;
+  for (size_t p = 0; p < producerCount; p++) {
+    producers.emplace_back([&runtime, p]() {
+      for (uint64_t i = 0; i < perShard; i++) {
+        for (size_t shard = 0; shard < runtime.size(); shard++) {
+          std::unique_ptr<uint64_t> tag(new uint64_t((uint64_t)p << 32 | i));
+          runtime.post(shard, [tag = std::move(tag)](Runtime::Shard& s) {
+            s.state.wrongThread |= Runtime::current() != &s;
+            s.state.seen.push_back(*tag);
+          });
+        }
+      }
+    });
+  }
+  for (auto& t : producers) {
+    t.join();
+  }
+
+  for (size_t shard = 0; shard < runtime.size(); shard++) {
+    std::promise<void> done;
+    runtime.post(shard, [&done](Runtime::Shard&) { done.set_value(); });
+    done.get_future().wait();
+  }
+  runtime.stop();
+  runtime.join();
+
+  for (size_t shard = 0; shard < runtime.size(); shard++) {
+    Log& log = runtime.shard(shard).state;
+    CHECK(!log.wrongThread);
+    CHECK(log.seen.size() == producerCount * perShard);
+    std::vector<uint64_t> next(producerCount, 0);
+    bool ordered = true;
+    for (uint64_t tag : log.seen) {
+      size_t p = (size_t)(tag >> 32);
+      ordered &= p < producerCount && (tag & 0xFFFFFFFFu) == next[p]++;
+    }
+    CHECK(ordered);
+  }
+
+  return checkFailures;
+}
@@ -0,0 +1,120 @@
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <vector>
+#include "asio.hpp"
+#include "ShardedTurnServer.h"
+#include "check.h"
+
+using asio::ip::udp;
+using HelloCoturn::ShardedTurnServer;
+using HelloCoturn::StunClass;
+using HelloCoturn::StunMessage;
+using HelloCoturn::StunMethod;
+using HelloCoturn::TurnServer;
+
+
+struct Client {
+  udp::socket socket;
+  uint8_t buffer[2048];
+  std::vector<StunClass> answers;
+  udp::endpoint relayed;
+  int errorCode = 0;
+
+  explicit Client(asio::io_context& ioContext)
+      : socket(ioContext, udp::endpoint(asio::ip::make_address("127.0.0.1"), 0)) {}
+
+  void allocate(const udp::endpoint& server, uint32_t seed) {
+    StunMessage message{};
+    uint32_t transId[3] = {seed, seed * 7 + 1, (uint32_t)answers.size()};
+    message.setTransactionId(transId);
+    message.setMethod(StunMethod::Allocate);
+    message.setClass(StunClass::request);
+    message.setAttr_REQUESTED_TRANSPORT();
+    message.setAttr_LIFETIME(600);
+    message.setFingerprint(true);
+    auto bytes = message.binary();
+    socket.send_to(asio::buffer(bytes), server);
+  }
+
+  void receive() {
+    socket.async_receive(asio::buffer(buffer), [this](const asio::error_code& ec, size_t n) {
+      StunMessage msg{};
+      if (ec || StunMessage::parse(buffer, n, msg, true) != 0) {
+        return;
+      }
+      answers.push_back(msg.getClass());
+      if (msg.getClass() == StunClass::successResponse) {
+        msg.getAttr_XOR_RELAYED_ADDRESS(relayed);
+      } else {
+        errorCode = msg.getAttr_ERROR_CODE();
+      }
+    });
+  }
+};
+
+
+using Clients = std::vector<std::unique_ptr<Client>>;
+
+static void exchange(asio::io_context& ioContext, Clients& clients, const udp::endpoint& to,
+                     uint32_t round) {
+  for (size_t i = 0; i < clients.size(); i++) {
+    clients[i]->receive();
+    clients[i]->allocate(to, (uint32_t)(round * 1000 + i));
+  }
+  ioContext.restart();
+  ioContext.run_for(std::chrono::seconds(5));
+}
+
+
+/*
+ShardedTurnServer with two shards: Allocates from many clients are spread over both
+shards, every client gets a relayed port of its own, and a second Allocate from the same
+client lands on the shard that holds its allocation (437 Allocation Mismatch, any other
+shard would grant a new one).
+*/
+int main() {
+  TurnServer::Options options;
+  options.relayAddress = asio::ip::make_address("127.0.0.1");
+  options.minPort = 41000;
+  options.maxPort = 41999;
+  ShardedTurnServer server(udp::endpoint(asio::ip::make_address("127.0.0.1"), 0), options, 2,
+                           false);
+  CHECK(server.size() == 2);
+  server.start();
+
+  asio::io_context ioContext;
+  Clients clients;
+  for (int i = 0; i < 32; i++) {
+    clients.emplace_back(new Client(ioContext));
+  }
+
+  exchange(ioContext, clients, server.localEndpoint(), 1);
+  std::set<uint16_t> ports;
+  for (auto& c : clients) {
+    CHECK(c->answers.size() == 1 && c->answers[0] == StunClass::successResponse);
+    CHECK(c->relayed.port() >= options.minPort && c->relayed.port() <= options.maxPort);
+    ports.insert(c->relayed.port());
+  }
+  CHECK(ports.size() == clients.size());
+
+  std::vector<size_t> perShard;
+  server.forEach([&](TurnServer& shard) { perShard.push_back(shard.allocationCount()); });
+  CHECK(perShard.size() == 2);
+  CHECK(perShard[0] + perShard[1] == clients.size());
+  CHECK(perShard[0] > 0 && perShard[1] > 0);
+
+  exchange(ioContext, clients, server.localEndpoint(), 2);
+  for (auto& c : clients) {
+    CHECK(c->answers.size() == 2 && c->answers[1] == StunClass::errorResponse);
+    CHECK(c->errorCode == 437);
+  }
+
+  server.stop();
+  size_t left = 0;
+  server.forEach([&](TurnServer& shard) { left += shard.allocationCount(); });
+  CHECK(left == 0);
+
+  return checkFailures;
+}
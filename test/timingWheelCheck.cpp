@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <thread>
+#include <vector>
+#include "seeker/timingWheel.h"
+#include "check.h"
+
+using seeker::AsioTimingWheel;
+using seeker::TimingWheel;
+
+
+/*
+AsioTimingWheel: schedule() must not run handlers that came due while the io_context was
+busy, callers may be iterating the containers those handlers erase from. The new delay is
+still measured from now, not from the last wakeup.
+*/
+static void checkAsioDriver() {
+  using clock = std::chrono::steady_clock;
+  using std::chrono::milliseconds;
+  asio::io_context ioContext;
+  std::vector<int> fired;
+  clock::time_point firedAt[2];
+  AsioTimingWheel<int> wheel(ioContext, milliseconds(1), [&](std::vector<int>& expired) {
+    for (int i : expired) {
+      firedAt[i] = clock::now();
+      fired.push_back(i);
+    }
+  });
+
+  wheel.schedule(milliseconds(2), 0);
+  std::this_thread::sleep_for(milliseconds(20));
+  clock::time_point scheduled = clock::now();
+  wheel.schedule(milliseconds(30), 1);
+  CHECK(fired.empty());
+
+  ioContext.run();
+  CHECK(fired == std::vector<int>({0, 1}));
+  CHECK(firedAt[1] - scheduled >= milliseconds(29));
+  CHECK(wheel.size() == 0);
+}
+
+
+/*
+TimingWheel cascading: timers from 1 tick to past 2^24 ticks (all four levels), the clock
+moved by random steps, single ticks up to jumps over several level-1 rotations. Every timer
+must fire in the advance() whose range (previous tick, toTick] holds its expiry, a cancelled
+one never, and nextEventTick() must never be later than the earliest pending expiry.
+*/
+int main() {
+  TimingWheel<uint32_t> wheel;
+  std::mt19937_64 random(2026);
+
+  struct Timer {
+    uint64_t expire = 0;
+    TimingWheel<uint32_t>::TimerId id = 0;
+    bool cancelled = false;
+    bool fired = false;
+  };
+  std::vector<Timer> timers;
+
+  auto schedule = [&](uint64_t ticks) {
+    Timer t;
+    t.expire = wheel.now() + ticks;
+    t.id = wheel.schedule(ticks, (uint32_t)timers.size());
+    timers.push_back(t);
+  };
+
+  const uint64_t spans[] = {1, 2, 255, 256, 257, 65535, 65536, 65537, 70000, (1u << 24) + 5};
+  for (uint64_t ticks : spans) {
+    schedule(ticks);
+  }
+  for (int i = 0; i < 3000; i++) {
+    schedule(1 + random() % ((i % 3 == 0) ? (1u << 26) : (1u << 17)));
+  }
+  for (size_t i = 0; i < timers.size(); i += 7) {
+    CHECK(wheel.cancel(timers[i].id));
+    CHECK(!wheel.cancel(timers[i].id));
+    timers[i].cancelled = true;
+  }
+
+  uint64_t end = (1u << 26) + 2;
+  while (wheel.now() < end) {
+    uint64_t earliest = UINT64_MAX;
+    for (auto& t : timers) {
+      if (!t.cancelled && !t.fired) {
+        earliest = std::min(earliest, t.expire);
+      }
+    }
+    CHECK(wheel.nextEventTick() <= earliest);
+
+    uint64_t from = wheel.now();
+    uint64_t step = random() % 4 == 0 ? 1 + random() % 300000 : 1 + random() % 300;
+    uint64_t to = std::min(from + step, end);
+    wheel.advance(to, [&](std::vector<uint32_t>& expired) {
+      for (uint32_t i : expired) {
+        Timer& t = timers[i];
+        CHECK(!t.cancelled && !t.fired);
+        CHECK(t.expire > from && t.expire <= to);
+        t.fired = true;
+        // scheduling from the handler lands relative to the new time.
+        if (timers.size() < 6000) {
+          schedule(1 + random() % 1000);
+        }
+      }
+    });
+    CHECK(wheel.now() == to);
+    if (checkFailures > 0) {
+      break;
+    }
+  }
+
+  for (auto& t : timers) {
+    CHECK(t.cancelled || t.fired);
+    if (t.fired) {
+      CHECK(!wheel.cancel(t.id));
+    }
+  }
+  CHECK(wheel.size() == 0);
+  CHECK(wheel.nextEventTick() == UINT64_MAX);
+
+  checkAsioDriver();
+  return checkFailures;
+}
@@ -0,0 +1,75 @@
+#include <cstdint>
+#include <map>
+#include <random>
+#include <tuple>
+#include "TransactionTable.h"
+#include "check.h"
+
+using HelloCoturn::TransactionKey;
+using HelloCoturn::TransactionTable;
+
+
+/*
+TransactionTable against a std::map under random inserts and erases at the full load factor:
+after every backward shift deletion each live key must still be found with its value, and an
+erased key must be gone. A small table keeps the probe runs long and wrapping around.
+*/
+int main() {
+  using Model = std::map<std::tuple<uint32_t, uint32_t, uint32_t>, int>;
+  const size_t maxOutstanding = 56;
+  TransactionTable<int> table(maxOutstanding);
+  Model model;
+  std::mt19937 random(2026);
+
+  auto keyOf = [](const Model::value_type& pair) {
+    uint32_t id[3] = {std::get<0>(pair.first), std::get<1>(pair.first),
+                      std::get<2>(pair.first)};
+    return TransactionKey(id);
+  };
+
+  for (int round = 0; round < 20000; round++) {
+    bool grow = model.size() < maxOutstanding && (model.size() < 8 || random() % 2 == 0);
+    if (grow) {
+      uint32_t id[3] = {(uint32_t)random(), (uint32_t)random(), (uint32_t)random()};
+      CHECK(table.insert(TransactionKey(id), round) != nullptr);
+      CHECK(table.insert(TransactionKey(id), -1) == nullptr);
+      model[std::make_tuple(id[0], id[1], id[2])] = round;
+    } else {
+      auto it = model.begin();
+      std::advance(it, random() % model.size());
+      TransactionKey key = keyOf(*it);
+      if (round % 2 == 0) {
+        CHECK(table.erase(key));
+      } else {
+        TransactionTable<int>::Slot taken;
+        CHECK(table.take(key, taken) && taken.value == it->second);
+      }
+      CHECK(table.find(key) == nullptr);
+      CHECK(!table.erase(key));
+      model.erase(it);
+    }
+
+    CHECK(table.size() == model.size());
+    for (auto& pair : model) {
+      auto* slot = table.find(keyOf(pair));
+      CHECK(slot != nullptr && slot->value == pair.second);
+    }
+    if (checkFailures > 0) {
+      break;
+    }
+  }
+
+  // full: one more is refused.
+  while (model.size() < maxOutstanding) {
+    uint32_t id[3] = {(uint32_t)random(), (uint32_t)random(), 0};
+    CHECK(table.insert(TransactionKey(id), 0) != nullptr);
+    model[std::make_tuple(id[0], id[1], id[2])] = 0;
+  }
+  uint32_t extra[3] = {1, 2, 3};
+  CHECK(table.insert(TransactionKey(extra), 0) == nullptr);
+  size_t visited = 0;
+  table.forEach([&](TransactionTable<int>::Slot&) { visited++; });
+  CHECK(visited == maxOutstanding);
+
+  return checkFailures;
+}